@@ -36,6 +36,7 @@ Algorithm::Algorithm()
 	prevBest = 0;
 	returnValueList = 0;
 	totalNodesExpanded = 0;
+	cancel = 0;
 	rand.srand(time((time_t*)0));
 }
 
@@ -69,6 +70,7 @@ Algorithm::Algorithm(const Algorithm& a)
 	PRUNING = a.PRUNING;
 	t1 = a.t1;
 	t2 = a.t2;
+	cancel = a.cancel;
 }
 
 
@@ -309,6 +311,11 @@ bool Algorithm::searchExpired(GameState *g)
 		LOG("Time's up...we quit.\n");
 		return true;
 	}
+	if (searchCancelled())
+	{
+		LOG("Search cancelled\n");
+		return true;
+	}
 	if ((useNODELIMIT) && (nodesExpanded >= SEARCHNODELIMIT))
 	{
 		LOG("Stopped with %ld nodes expanded\n", nodesExpanded);
@@ -1,6 +1,7 @@
 //#include "random.h"
 #include "GameState.h"
 #include "States.h"
+#include "SearchContext.h"
 
 #ifndef _ALGORITHM_H
 #define _ALGORITHM_H
@@ -73,6 +74,14 @@ public:
 
 	void logNodes();
 
+	/*
+	 * setCancelToken: stop the search once the token is cancelled; searchExpired
+	 * then returns true. Clones share the token.
+	 */
+	virtual void setCancelToken(const CancelToken *token) { cancel = token; }
+	const CancelToken *getCancelToken() const { return cancel; }
+	bool searchCancelled() const { return cancel && cancel->isCancelled(); }
+
 	void setBranchingFactorLimit(unsigned long val);
 	int getIterationSearchLimit();
 
@@ -145,6 +154,7 @@ private:
 	unsigned long SEARCHNODELIMIT;
 	unsigned long BFLIMIT;
 	double t1, t2;
+	const CancelToken *cancel;
 
 	returnValue *returnValueList;
 };
@@ -10,7 +10,7 @@ namespace hearts {
 
 //#define _PRINT_
 
-static unsigned long randPoints[4][32] =
+static const unsigned long randPoints[4][32] =
 { 
 { 0x73E15852, 0x54DB3DA1, 0x76F5551E, 0x79DACE40, 0x3C344C2F, 0x54E53189, 0x477C5801, 0x43D6F45A, 
 	0x4A432334, 0x7D28582E, 0x70475F46, 0x1031EDFE, 0x57F84ADC, 0x4D4170DD, 0x16569135, 0x2E4D82A5, 
@@ -37,7 +37,7 @@ static unsigned long randPoints[4][32] =
 }
 };
 
-static unsigned long randNumbers[4][64] =
+static const unsigned long randNumbers[4][64] =
 {
 	{ 0x73D6B0CE,	0xDEFFE50,	0x4CC6A7CB,	0x70EC79A2,	0x2FBB009E,	0x4D96C269,	0x61C39297,	0x1467F26D,
 		0x607B041B,	0x14C31C74,	0x6CBC369B,	0x4DEDB8D8,	0x6F665299,	0x1727C359,	0x1AC4ECA6,	0x1AC02A7F,
@@ -183,6 +183,12 @@ void CardGameState::Reset(int NEWSEED)
 		//printf("Starting new card game with SEED: %d\n", NEWSEED);
 		d.Shuffle(NEWSEED);
 	}
+	Clear();
+	this->DealCards();
+}
+
+void CardGameState::Clear()
+{
 	currPlr = currTrick = 0;
 	firstPlayer = 0;
 	
@@ -204,7 +210,6 @@ void CardGameState::Reset(int NEWSEED)
 	t = new Trick[numCards+1];
 	for (int x = 0; x < numCards+1; x++)
 		t[x].reset(numPlayers, trump);
-	this->DealCards();
 }
 
 void CardGameState::SetInitialCards(std::vector<std::vector<card> > &theCards)
@@ -761,6 +766,101 @@ card CardGameState::getRelativeRank(card c)
 	return Deck::getcard(Deck::getsuit(c), position);
 }
 
+static bool suitBefore(int a, int b, const uint64_t *masks, int numMasks)
+{
+	for (int x = 0; x < numMasks; x++)
+	{
+		uint16_t wa = (masks[x]>>(16*a))&0xFFFF;
+		uint16_t wb = (masks[x]>>(16*b))&0xFFFF;
+		if (wa != wb)
+			return (wa > wb);
+	}
+	return false;
+}
+
+void suitPermutation::canonicalize(int freeSuits, const uint64_t *masks, int numMasks)
+{
+	int slots[4], order[4];
+	int n = 0;
+	setIdentity();
+	for (int s = 0; s < 4; s++)
+	{
+		if ((freeSuits>>s)&1)
+		{
+			slots[n] = order[n] = s;
+			n++;
+		}
+	}
+	for (int x = 0; x < n; x++)
+	{
+		for (int y = x+1; y < n; y++)
+		{
+			if (suitBefore(order[y], order[x], masks, numMasks))
+			{
+				int tmp = order[x];
+				order[x] = order[y];
+				order[y] = tmp;
+			}
+		}
+	}
+	for (int x = 0; x < n; x++)
+		to[order[x]] = slots[x];
+	for (int s = 0; s < 4; s++)
+		from[to[s]] = s;
+}
+
+uint64_t suitPermutation::map(uint64_t cards) const
+{
+	uint64_t result = 0;
+	for (int s = 0; s < 4; s++)
+		result |= ((cards>>(16*s))&0xFFFF)<<(16*to[s]);
+	return result;
+}
+
+uint64_t suitPermutation::unmap(uint64_t cards) const
+{
+	uint64_t result = 0;
+	for (int s = 0; s < 4; s++)
+		result |= ((cards>>(16*s))&0xFFFF)<<(16*from[s]);
+	return result;
+}
+
+int CardGameState::getInterchangeableSuits() const
+{
+	int free = 0xF;
+	if ((trump >= 0) && (trump < 4))
+		free &= ~(1<<trump);
+	if ((special >= 0) && (special < 4))
+		free &= ~(1<<special);
+	return free;
+}
+
+void CardGameState::getCanonicalSuits(suitPermutation &p) const
+{
+	uint64_t masks[3*MAXPLAYERS];
+	int n = 0;
+	for (unsigned int x = 0; x < numPlayers; x++)
+	{
+		masks[n++] = cards[x].getHand();
+		masks[n++] = played[x].getHand();
+		masks[n++] = taken[x].getHand();
+	}
+	p.canonicalize(getInterchangeableSuits(), masks, n);
+}
+
+void CardGameState::getCanonicalSuits(int who, suitPermutation &p) const
+{
+	uint64_t masks[1+2*MAXPLAYERS];
+	int n = 0;
+	masks[n++] = cards[who].getHand();
+	for (unsigned int x = 0; x < numPlayers; x++)
+	{
+		masks[n++] = played[x].getHand();
+		masks[n++] = taken[x].getHand();
+	}
+	p.canonicalize(getInterchangeableSuits(), masks, n);
+}
+
 HashState *CardGameState::getHashState(HashState *mem)
 {
 	if (getCurrTrick()->curr != 0)
@@ -1047,36 +1147,34 @@ void iiCardState::getCards(uint64_t val, std::vector<card> &theCards, int availa
     }
 }
 
+// Pascal's triangle up to 64 cards, built once; searches only read it
+struct chooseTable {
+	chooseTable()
+	{
+		for (int n = 0; n < kSize; n++)
+		{
+			table[n][0] = 1;
+			for (int k = 1; k < kSize; k++)
+				table[n][k] = (n == 0)?0:(table[n-1][k-1]+table[n-1][k]);
+		}
+	}
+	enum { kSize = 65 };
+	uint64_t table[kSize][kSize];
+};
+
 uint64_t iiCardState::choose(int n, int k)
 {
-	static std::vector<std::vector<uint64_t> > lookups;
+	static const chooseTable lookups; // thread-safe initialization
 
 	if (k > n)
         return 0;
-	
-//    if (k > n/2)
-//        k = n-k; // Take advantage of symmetry
-
-	if (n >= (int)lookups.size())
-		lookups.resize(n+1);
-	if (k >= (int)lookups[n].size())
-		lookups[n].resize(k+1);
-	if (lookups[n][k] != 0)
-		return lookups[n][k];
+	if (n < chooseTable::kSize)
+		return lookups.table[n][k];
 
-	//printf("%d choose %d\n", n, k);
-	
     long double accum = 1;
     for (int i = 1; i <= k; i++)
 		accum = accum * (n-k+i) / i;
-	
-    lookups[n][k] = (uint64_t)(accum+0.5);
 	return accum + 0.5; // avoid rounding error
-	
-//	uint64_t ans=1;
-//	for (int x = 0; x < m; x++)
-//		ans=(ans*(n-x))/(x+1);
-//	return ans;
 }
 
 
@@ -1564,55 +1662,6 @@ card Deck::Deal()
 	return x;
 }
 
-int Trick::Winner() const
-{
-	if (curr == 0)
-		return -1;
-	int suit, x = 0;
-	int winner = x;
-	card rank;
-
-	suit = Deck::getsuit(play[x]);
-	rank = Deck::getrank(play[x]);
-
-	for (x = 1; x < curr; x++)
-	{
-		if (((Deck::getsuit(play[x]) == suit) && (Deck::getrank(play[x]) < rank)) ||
-				((Deck::getsuit(play[x]) == trump) && (suit != trump)))
-		{
-			rank = Deck::getrank(play[x]);
-			suit = Deck::getsuit(play[x]);
-			winner = x;
-		}
-	}
-	//printf("Player %d took the trick\n", player[winner]);
-	return player[winner];
-}
-
-int Trick::WinningCard() const
-{
-    if (curr == 0)
-        return -1;
-    int suit, x = 0;
-    int winner = x;
-    card rank;
-    
-    suit = Deck::getsuit(play[x]);
-    rank = Deck::getrank(play[x]);
-    
-    for (x = 1; x < curr; x++)
-    {
-        if (((Deck::getsuit(play[x]) == suit) && (Deck::getrank(play[x]) < rank)) ||
-            ((Deck::getsuit(play[x]) == trump) && (suit != trump)))
-        {
-            rank = Deck::getrank(play[x]);
-            suit = Deck::getsuit(play[x]);
-            winner = x;
-        }
-    }
-    return play[winner];
-}
-
 int Trick::bestRankWin() const
 {
 	card c = WinningCard();
@@ -1644,25 +1693,12 @@ void Trick::Display()
 	printf("\n");
 }
 
-void Trick::AddCard(card c, int who)
-{
-	play[curr] = c;
-	player[curr] = who;
-	curr++;
-}
-
-card Trick::RemoveCard()
-{
-	card last = play[curr];
-	curr--;
-	return last;
-}
-
 void Trick::reset(int numP, int t)
 {
 	np = numP;
 	trump = t;
 	curr = 0;
+	cards = 0;
 }
 
 void cardHashState::Print(int val) const
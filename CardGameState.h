@@ -122,31 +122,60 @@ private:
 };
 
 
+/**
+ * The winner is kept up to date as cards are added and removed, so
+ * Winner() and WinningCard() don't rescan the trick.
+ */
 class Trick {
 public:
 	Trick(int t = -1) { reset(0, t);}
-	virtual ~Trick() {}
-	virtual int Winner() const;
-	virtual int WinningCard() const;
-	virtual int bestRankWin() const;
+	int Winner() const { return (curr == 0)?-1:player[win[curr-1]]; }
+	int WinningCard() const { return (curr == 0)?-1:play[win[curr-1]]; }
+	int bestRankWin() const;
 	//virtual int LosingCard();
 	//virtual int Points(); // not being used - eval is proper place to overload
 	void Display();
 	void Print() { Display(); }
 	void print() { Display(); }
-	void AddCard(card c, int who);
-	card RemoveCard();
+	inline void AddCard(card c, int who);
+	inline card RemoveCard();
 	bool Done() { return (curr>=np); }
 	void reset(int numP, int t = -1);
 	int np;
 	int curr;
 	card play[MAXPLAYERS];
 	int player[MAXPLAYERS];
+	uint64_t cards; // the cards played to the trick
 private:
 	int trump; // suit which is trump. -1 for no trump
-	int points;
+	int win[MAXPLAYERS]; // index of the winning card after each play
 };
 
+inline void Trick::AddCard(card c, int who)
+{
+	play[curr] = c;
+	player[curr] = who;
+	cards |= ((uint64_t)1)<<c;
+	int best = 0;
+	if (curr != 0)
+	{
+		best = win[curr-1];
+		int suit = Deck::getsuit(play[best]);
+		if (((Deck::getsuit(c) == suit) && (Deck::getrank(c) < Deck::getrank(play[best]))) ||
+			((Deck::getsuit(c) == trump) && (suit != trump)))
+			best = curr;
+	}
+	win[curr] = best;
+	curr++;
+}
+
+inline card Trick::RemoveCard()
+{
+	curr--;
+	cards &= ~(((uint64_t)1)<<play[curr]);
+	return play[curr];
+}
+
 typedef enum {
 	kLeadCard,
 	kFollowCard,
@@ -171,6 +200,33 @@ public:
 	cardContext context;
 };
 
+/**
+ * A renaming of the suits. Suits that the rules treat identically (see
+ * CardGameState::getInterchangeableSuits) can be permuted without changing
+ * the game, so states that differ only by such a renaming share one
+ * canonical form. map() takes real cards to canonical ones and unmap()
+ * takes canonical cards (e.g. a move found for the canonical state) back.
+ */
+class suitPermutation {
+public:
+	suitPermutation() { setIdentity(); }
+	void setIdentity()
+	{ for (int s = 0; s < 4; s++) to[s] = from[s] = s; }
+	// order the free suits (bit s set for suit s) by their words in masks[0],
+	// then masks[1] and so on, highest first
+	void canonicalize(int freeSuits, const uint64_t *masks, int numMasks);
+	inline card map(card c) const
+	{ return Deck::getcard(to[Deck::getsuit(c)], Deck::getrank(c)); }
+	inline card unmap(card c) const
+	{ return Deck::getcard(from[Deck::getsuit(c)], Deck::getrank(c)); }
+	uint64_t map(uint64_t cards) const;
+	uint64_t unmap(uint64_t cards) const;
+	bool isIdentity() const
+	{ return (to[0] == 0) && (to[1] == 1) && (to[2] == 2) && (to[3] == 3); }
+
+	int to[4], from[4];
+};
+
 class CardGame : public Game {
 public:
 	CardGame(GameState *gs) :Game(gs) { started = false; }
@@ -190,6 +246,9 @@ public:
 	virtual ~CardGameState();
 	virtual CardGameState *create();
 	virtual void Reset(int NEWSEED = -1);
+	// Reset without shuffling or dealing, leaving every hand empty for a
+	// position that is set up card by card
+	virtual void Clear();
 	virtual void SetInitialCards(std::vector<std::vector<card> > &cards);
 	
 	virtual void DealCards();
@@ -224,6 +283,12 @@ public:
 	//virtual HashState *getPartitionHashState(GameState *g, int me);
 	virtual uint64_t HashCurrentState(int who) const { return cards[who].getHand(); }
 
+	// bit s is set when suit s may be renamed; not the trump or special suit
+	virtual int getInterchangeableSuits() const;
+	// canonical suits for the full state, or for what player who can see
+	virtual void getCanonicalSuits(suitPermutation &p) const;
+	virtual void getCanonicalSuits(int who, suitPermutation &p) const;
+
 	Deck allplayed; // cards from all players
 	Deck cards[MAXPLAYERS];
 	Deck played[MAXPLAYERS];
@@ -8,41 +8,55 @@
  */
 
 #include "CardProbabilityData.h"
+#include <cstdlib>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 namespace hearts {
 
 cardProbData::cardProbData(char *file)
 {
-	probGivenLead.resize(64);
-	freq1.resize(64);
-	for (unsigned x = 0; x < 64; x++)
+	mapped = false;
+#ifndef _WIN32
+	void *m = mmap(0, sizeof(cardProbTables), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (m != MAP_FAILED)
 	{
-		probGivenLead[x].resize(64);
-		freq1[x].resize(64);
+		tables = (cardProbTables *)m;
+		mapped = true;
 	}
+	else
+#endif
+		tables = (cardProbTables *)calloc(1, sizeof(cardProbTables));
+
+	probGivenLead = tables->probGivenLead;
+	probGivenLeadAndPlay = tables->probGivenLeadAndPlay;
+	freq1 = tables->freq1;
+	freq2 = tables->freq2;
 
-	freq2.resize(64);
-	for (unsigned int x = 0; x < freq2.size(); x++)
-	{
-		freq2[x].resize(64);
-		for (unsigned int y = 0; y < freq2[x].size(); y++)
-		{
-			freq2[x][y].resize(64);
-		}
-	}
-	
-	
-	probGivenLeadAndPlay.resize(64);
-	for (unsigned x = 0; x < 64; x++)
-	{
-		probGivenLeadAndPlay[x].resize(64);
-		for (unsigned y = 0; y < 64; y++)
-		{
-			probGivenLeadAndPlay[x][y].resize(64);
-		}
-	}
 	if (file)
 		load(file);
+	setWritable(false);
+}
+
+cardProbData::~cardProbData()
+{
+#ifndef _WIN32
+	if (mapped)
+	{
+		munmap(tables, sizeof(cardProbTables));
+		return;
+	}
+#endif
+	free(tables);
+}
+
+void cardProbData::setWritable(bool writable)
+{
+#ifndef _WIN32
+	if (mapped)
+		mprotect(tables, sizeof(cardProbTables), writable?(PROT_READ|PROT_WRITE):PROT_READ);
+#endif
 }
 
 void cardProbData::save(char *file)
@@ -94,6 +108,7 @@ void cardProbData::load(char *file)
 {
 	FILE *f = fopen(file, "r");
 	if (!f) return;
+	setWritable(true);
 	for (int x = 0; x < 64; x++)
 	{
 		for (int y = 0; y < 64; y++)
@@ -133,6 +148,7 @@ void cardProbData::load(char *file)
 	}
 
 	fclose(f);
+	setWritable(false);
 }
 
 } // namespace hearts
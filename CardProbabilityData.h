@@ -16,20 +16,38 @@
 
 namespace hearts {
 
+/**
+ * The model tables in one flat block, so they can live in a mapping of
+ * their own instead of thousands of small heap allocations.
+ */
+class cardProbTables {
+public:
+	float probGivenLead[64][64];
+	float probGivenLeadAndPlay[64][64][64];
+	float freq1[64][64];
+	float freq2[64][64][64];
+};
+
+/**
+ * The opponent model. The tables are kept in an anonymous shared mapping
+ * that is read-only except while load() fills it, so processes forked
+ * after the model is built (hearts_server --workers) share one copy.
+ */
 class cardProbData {
 public:
 	cardProbData(char *file = 0);
+	~cardProbData();
 	void save(char *file);
 	void load(char *file);
 	
 	// given that I lead x, what's the probability I have y. [64][64]
-	std::vector<std::vector<float> > probGivenLead;
+	float (*probGivenLead)[64];
 	// given that x is lead and I play y, what's the probability I have z [64][64][64]
-	std::vector<std::vector<std::vector<float> > > probGivenLeadAndPlay;
+	float (*probGivenLeadAndPlay)[64][64];
 	// frequency of cards given passes [64][64]
-	std::vector<std::vector<float> > freq1;
+	float (*freq1)[64];
 	// frequency of cards given 2 passes [64][64][64]
-	std::vector<std::vector<std::vector<float> > > freq2;
+	float (*freq2)[64][64];
 
 	// given that you lead x, I follow y, what is the probability of length z in each of 4 suits [64][64][4][13]
 	std::vector<std::vector<uint32_t> > suitLengthProbGivenLeadAndPlay;
@@ -39,6 +57,13 @@ public:
 	std::vector<std::vector<uint32_t> > suitLengthProbGivenPass;
 	// prior from data; before pass counts of lengths [4][13]
 	std::vector<std::vector<uint32_t> > suitLengthsPrior;
+private:
+	cardProbData(const cardProbData &);
+	cardProbData &operator=(const cardProbData &);
+	void setWritable(bool writable);
+
+	cardProbTables *tables;
+	bool mapped; // else allocated on the heap
 };
 
 } // namespace hearts
@@ -0,0 +1,156 @@
+/*
+ *  FlatMC.cpp
+ *  Hearts
+ *
+ */
+
+#include "FlatMC.h"
+#include "Player.h"
+#include "fpUtil.h"
+#include <cassert>
+#include <sstream>
+
+namespace hearts {
+
+FlatMC::FlatMC(int numRuns)
+{
+	pm = 0;
+	ownModule = false;
+	numSamples = numRuns;
+	epsilon = 0.1;
+	crn = true;
+}
+
+FlatMC::FlatMC(const FlatMC &f)
+:Algorithm(f)
+{
+	numSamples = f.numSamples;
+	epsilon = f.epsilon;
+	crn = f.crn;
+	pm = f.pm?f.pm->cloneModule():0;
+	ownModule = (pm != 0);
+	if (!pm)
+		pm = f.pm;
+}
+
+FlatMC::~FlatMC()
+{
+	if (ownModule)
+		delete pm;
+}
+
+void FlatMC::setPlayoutModule(UCTModule *m)
+{
+	if (ownModule)
+		delete pm;
+	pm = m;
+	ownModule = false;
+}
+
+const char *FlatMC::getName()
+{
+	std::stringstream out;
+	out << "FlatMC_N-" << numSamples;
+	if (pm)
+		out << "_PM-" << pm->GetModuleName();
+	out << "_e-" << epsilon;
+	if (crn)
+		out << "_CRN";
+	name = out.str();
+	return name.c_str();
+}
+
+// the legal moves, unlinked
+static void getMoveList(GameState *g, std::vector<Move *> &moves)
+{
+	for (Move *m = g->getMoves(); m; )
+	{
+		Move *next = m->next;
+		m->next = 0;
+		moves.push_back(m);
+		m = next;
+	}
+}
+
+void FlatMC::EvaluateMoves(GameState *g, std::vector<Move *> &moves, std::vector<double> &values)
+{
+	assert(pm != 0);
+	int me = g->getNextPlayerNum();
+	values.assign(moves.size(), 0);
+	if (moves.size() == 0)
+		return;
+	// reseeding is ours; the state's own draws go on as if we hadn't searched
+	mt_random saved = g->r, roundStart;
+	int perMove = numSamples/(int)moves.size();
+	if (perMove < 1)
+		perMove = 1;
+	// one seed per round; every move of the round plays out from it
+	int rounds = 0;
+	for (; rounds < perMove; rounds++)
+	{
+		if (searchCancelled())
+			break;
+		uint32_t seed = rand.rand_long();
+		if (crn)
+			roundStart.srand(seed);
+		for (unsigned int x = 0; x < moves.size(); x++)
+		{
+			if (crn)
+			{
+				// copying the seeded generator is cheaper than seeding it again
+				g->r = roundStart;
+				pm->setSeed(seed);
+			}
+			ApplyMove(g, moves[x]);
+			maxnval *v = pm->DoRandomPlayout(g, who, epsilon);
+			UndoMove(g, moves[x]);
+			values[x] += v->getValue(me);
+			delete v;
+		}
+	}
+	g->r = saved;
+	if (rounds > 0)
+		for (unsigned int x = 0; x < moves.size(); x++)
+			values[x] /= rounds;
+}
+
+returnValue *FlatMC::Play(GameState *g, Player *p)
+{
+	resetCounters(g);
+	who = p;
+	std::vector<Move *> moves;
+	std::vector<double> values;
+	getMoveList(g, moves);
+	EvaluateMoves(g, moves, values);
+	if (moves.size() == 0)
+		return 0;
+	int best = 0;
+	for (unsigned int x = 1; x < moves.size(); x++)
+		if (fgreater(values[x], values[best]))
+			best = x;
+	minimaxval *rv = new minimaxval(values[best], moves[best]->clone(g));
+	for (unsigned int x = 0; x < moves.size(); x++)
+		g->freeMove(moves[x]);
+	logNodes();
+	return rv;
+}
+
+returnValue *FlatMC::Analyze(GameState *g, Player *p)
+{
+	who = p;
+	std::vector<Move *> moves;
+	std::vector<double> values;
+	getMoveList(g, moves);
+	EvaluateMoves(g, moves, values);
+	minimaxval *rv = 0;
+	for (unsigned int x = 0; x < moves.size(); x++)
+	{
+		minimaxval *tmp = new minimaxval(values[x], moves[x]->clone(g));
+		tmp->next = rv;
+		rv = tmp;
+		g->freeMove(moves[x]);
+	}
+	return rv;
+}
+
+} // namespace hearts
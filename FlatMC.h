@@ -0,0 +1,67 @@
+/*
+ *  FlatMC.h
+ *  Hearts
+ *
+ *  Flat Monte Carlo at the root: every legal move is played out the same
+ *  number of times with the playout module, with no tree below it. With
+ *  common random numbers the k-th playout of every move starts from the
+ *  same seed, so two moves are compared on the same sequence of random
+ *  choices and the difference between their values is not swamped by
+ *  playout noise.
+ *
+ */
+
+#ifndef FLATMC_H
+#define FLATMC_H
+
+#include "Algorithm.h"
+#include "algorithmStates.h"
+#include "UCT.h"
+#include <string>
+#include <vector>
+
+namespace hearts {
+
+/**
+ * A drop-in for UCT under iiMonteCarlo: Analyze returns the mean playout
+ * value of each root move for the player to move. numRuns is the number
+ * of playouts for all moves together, as for UCT, so the two can be
+ * compared at equal cost.
+ *
+ * Seeding needs a module that supports UCTModule::setSeed; the state's
+ * own generator, which HeartsGameState::getRandomMove draws from, is
+ * seeded too. Clones play out with their own clone of the module where
+ * the module can be cloned, so the seeds of threads searching at once
+ * don't interleave.
+ */
+class FlatMC : public Algorithm {
+public:
+	FlatMC(int numRuns = 10000);
+	FlatMC(const FlatMC &f);
+	~FlatMC();
+	Algorithm *clone() const { return new FlatMC(*this); }
+	virtual const char *getName();
+
+	// the module isn't owned; clones own their copies of it
+	void setPlayoutModule(UCTModule *m);
+	void setEpsilonPlayout(double v) { epsilon = v; }
+	void setCommonRandomNumbers(bool use) { crn = use; }
+	bool getCommonRandomNumbers() const { return crn; }
+
+	virtual returnValue *Play(GameState *g, Player *p);
+	returnValue *Analyze(GameState *g, Player *p);
+private:
+	// mean playout value of each move for the player to move
+	void EvaluateMoves(GameState *g, std::vector<Move *> &moves, std::vector<double> &values);
+
+	UCTModule *pm;
+	bool ownModule;
+	int numSamples;
+	double epsilon;
+	bool crn;
+	std::string name;
+};
+
+} // namespace hearts
+
+#endif
@@ -2,6 +2,10 @@
 //#include "mathUtil.h"
 #include "fpUtil.h"
 #include "HeartsGameHistories.h"
+#include "HeartsPass.h"
+#include "HeartsBook.h"
+#include "HeartsTime.h"
+#include "HeartsStrength.h"
 
 namespace hearts {
 
@@ -136,13 +140,111 @@ int HeartsCardGame::Rank(int who)
 }
 
 
-void HeartsGameState::Reset(int SD)
+void HeartsGameState::Clear()
 {
 	for (unsigned int x = 0; x < MAXPLAYERS; x++)
 		passes[x].resize(0);
 	numCardsPassed = 0;
-	currPlr = 0;
-	CardGameState::Reset(SD);
+	CardGameState::Clear();
+}
+
+static bool positionError(const char **error, const char *why)
+{
+	if (error)
+		*error = why;
+	return false;
+}
+
+bool HeartsGameState::SetPosition(const HeartsPosition &p, const char **error)
+{
+	Clear();
+	setRules(p.rules);
+	passDir = kHold;
+	int numP = getNumPlayers();
+	if ((p.who < 0) || (p.who >= numP))
+		return positionError(error, "no such player");
+	if ((int)p.tricks.size() > numCards)
+		return positionError(error, "too many tricks");
+
+	// bitboards of the cards accounted for, and of those taken in the tricks
+	uint64_t hand = p.hand.getHand(), seen = hand;
+	uint64_t trickTaken[MAXPLAYERS] = {0};
+	if (hand&~getFullDeck())
+		return positionError(error, "not a card");
+	if ((int)p.hand.count() > numCards)
+		return positionError(error, "too many cards in hand");
+	int leader = p.tricks.empty()?0:p.tricks[0].leader;
+	for (unsigned int x = 0; x < p.tricks.size(); x++)
+	{
+		const HeartsPositionTrick &pt = p.tricks[x];
+		if ((pt.leader < 0) || (pt.leader >= numP))
+			return positionError(error, "no such player");
+		if (pt.leader != leader)
+			return positionError(error, "a trick isn't led by the winner of the last");
+		if ((int)pt.cards.size() > numP)
+			return positionError(error, "too many cards in a trick");
+		if (((int)pt.cards.size() < numP) && (x+1 != p.tricks.size()))
+			return positionError(error, "a trick before the last isn't complete");
+		for (unsigned int y = 0; y < pt.cards.size(); y++)
+		{
+			card c = pt.cards[y];
+			int who = (pt.leader+y)%numP;
+			if ((c < 0) || (c >= 64) || !((getFullDeck()>>c)&1))
+				return positionError(error, "not a card");
+			if ((seen>>c)&1)
+				return positionError(error, "a card is played twice or still in hand");
+			seen |= ((uint64_t)1)<<c;
+			t[x].AddCard(c, who);
+			played[who].set(c);
+			original[who].set(c);
+			if ((int)t[x].curr < numP)
+				continue;
+			// the trick is complete: what ApplyMove does at its last card
+			leader = t[x].Winner();
+			trickTaken[leader] |= t[x].cards;
+		}
+	}
+
+	for (int x = 0; x < numP; x++)
+	{
+		// a taken card may also be listed in a trick, if x won that trick
+		uint64_t took = p.taken[x].getHand();
+		if (took&~getFullDeck())
+			return positionError(error, "not a card");
+		if (took&seen&~trickTaken[x])
+			return positionError(error, "a taken card is still in hand or won by another player");
+		for (int y = 0; y < numP; y++)
+		{
+			if ((y != x) && (took&p.taken[y].getHand()))
+				return positionError(error, "a card is taken by two players");
+		}
+		taken[x].setHand(trickTaken[x]|took);
+		allplayed.addHand(trickTaken[x]|took);
+	}
+	cards[p.who].addHand(&p.hand);
+	original[p.who].addHand(&p.hand);
+
+	// as ApplyMove leaves it: a trick's winning card counts as played only
+	// once the trick is over
+	currTrick = 0;
+	while ((currTrick < (int)p.tricks.size()) && (t[currTrick].curr == numP))
+		currTrick++;
+	for (int x = 0; x < t[currTrick].curr; x++)
+		if (t[currTrick].play[x] != t[currTrick].WinningCard())
+			allplayed.set(t[currTrick].play[x]);
+
+	bool started = (seen != hand) || !allplayed.empty();
+	if (!started)
+	{
+		// passing, if the rules pass this hand, comes first
+		if ((int)p.hand.count() == numCards)
+			setPassDir(p.passDir);
+		setFirstPlayer(leader);
+		return true;
+	}
+	firstPlayer = p.tricks.empty()?leader:p.tricks[0].leader;
+	currPlr = (leader+t[currTrick].curr)%numP;
+	return true;
 }
 
 CardGameState *HeartsGameState::create()
@@ -791,19 +893,33 @@ double HeartsGameState::score(int who) const
 	return scores;
 }
 
-int HeartsGameState::score(const Trick *ct) const
+bool HeartsGameState::getSettledPiles(uint64_t *finalTaken, uint64_t &finalPlayed) const
 {
-	int points=0;
-	for (int x = 0; x < ct->curr; x++)
+	if (!donePassing() || CardGameState::Done())
+		return false;
+	const Trick *trick = getCurrTrick();
+	uint64_t hands[MAXPLAYERS];
+	for (unsigned int x = 0; x < numPlayers; x++)
 	{
-		if (!(rules&kHeartsArentPoints))
-			if (Deck::getsuit(ct->play[x]) == HEARTS)
-				points++;
-		if ((ct->play[x] == Deck::getcard(SPADES, QUEEN)) && (rules&kQueenPenalty))
-			points+=13;
-		if ((ct->play[x] == Deck::getcard(DIAMONDS, JACK)) && (rules&kJackBonus))
-			points-=10;
+		hands[x] = cards[x].getHand();
+		finalTaken[x] = taken[x].getHand();
 	}
+	finalPlayed = allplayed.getHand();
+	return settleHand(rules, numPlayers, hands, trick->cards, (trick->curr == 0)?CardGameState::getNextPlayerNum():-1,
+	                  finalTaken, finalPlayed);
+}
+
+int HeartsGameState::score(const Trick *ct) const
+{
+	Deck played;
+	played.setHand(ct->cards);
+	int points=0;
+	if (!(rules&kHeartsArentPoints))
+		points += played.suitCount(HEARTS);
+	if ((rules&kQueenPenalty) && played.has(SPADES, QUEEN))
+		points+=13;
+	if ((rules&kJackBonus) && played.has(DIAMONDS, JACK))
+		points-=10;
 	return points;
 }
 
@@ -1154,11 +1270,102 @@ SimpleHeartsPlayer::SimpleHeartsPlayer(Algorithm *alg)
 :CardPlayer(alg)
 {
 	modelLevel = 0;
+	passEval = 0;
+	book = 0;
+	timer = 0;
+	havePass = false;
+}
+
+Move *SimpleHeartsPlayer::Play()
+{
+	HeartsGameState *hgs = (HeartsGameState *)g;
+	int me = g->getPlayerNum(this);
+	if (!hgs->donePassing())
+	{
+		if (hgs->cards[me].count()+hgs->passes[me].size() != 13)
+			return CardPlayer::Play();
+
+		// the whole set is chosen with the first card and then passed in order
+		unsigned int next = hgs->passes[me].size();
+		if (next == 0)
+		{
+			havePass = false;
+			if (book)
+				havePass = book->getPass(hgs->cards[me].getHand(), hgs->getPassDir(), hgs->getRules(), passCards);
+			if ((!havePass) && (passEval))
+			{
+				passEval->selectPassCards(hgs, me, passCards, algorithm?algorithm->getCancelToken():0);
+				havePass = true;
+			}
+		}
+		if (!havePass)
+			return CardPlayer::Play();
+		for (unsigned int x = 0; x < next; x++)
+			if (hgs->passes[me][x] != passCards[x])
+				return CardPlayer::Play();
+		Move *pass = getLegalMove(hgs, passCards[next]);
+		if (pass)
+			return pass;
+	}
+	else if (book)
+	{
+		card c;
+		if (book->getPlay(hgs, me, c))
+		{
+			Move *play = getLegalMove(hgs, c);
+			if (play)
+				return play;
+		}
+	}
+	if ((timer) && (hgs->donePassing()))
+		return TimedPlay(hgs, me);
+	return CardPlayer::Play();
+}
+
+Move *SimpleHeartsPlayer::TimedPlay(HeartsGameState *hgs, int me)
+{
+	int budget = timer->Budget(hgs, me);
+	if (budget == 0)
+	{
+		Move *moves = hgs->getMoves();
+		Move *forced = moves->clone(hgs);
+		hgs->freeMove(moves);
+		return forced;
+	}
+	iiMonteCarlo *mc = dynamic_cast<iiMonteCarlo *>(algorithm);
+	if (!mc)
+		return CardPlayer::Play();
+
+	int worlds = timer->Worlds(budget);
+	int oldWorlds = mc->getNumModels();
+	HeartsConfidence confidence(mc->getObserver());
+	mc->setObserver(&confidence);
+	mc->setNumModels(worlds);
+	Move *m = CardPlayer::Play();
+	mc->setObserver(confidence.getNext());
+	mc->setNumModels(oldWorlds);
+	timer->Spent(worlds*timer->getSimulationsPerWorld(), confidence.getConfidence());
+	return m;
+}
+
+Move *SimpleHeartsPlayer::getLegalMove(HeartsGameState *hgs, card c)
+{
+	Move *moves = hgs->getMoves();
+	Move *result = 0;
+	for (Move *m = moves; m; m = m->next)
+	{
+		if (((CardMove*)m)->c == c)
+		{
+			result = m->clone(hgs);
+			break;
+		}
+	}
+	hgs->freeMove(moves);
+	return result;
 }
 
 const char *SimpleHeartsPlayer::getName()
 {
-	static char name[255];
 	iiGameState *igs = getiiModel();
 	sprintf(name, "Simple(%s,%s)", igs->GetName(), algorithm->getName());
 	delete igs;
@@ -1418,54 +1625,31 @@ double SimpleHeartsPlayer::cutoffEval(unsigned int who)
 
 maxnval *SimpleHeartsPlayer::DoRandomPlayout(GameState *gs, Player *p, double epsilon)
 {
-	//bool shootDanger = false;
-	std::vector<Move *> moves;
-	CardGameState *cgs = (CardGameState *)gs;
-	// first pass, don't think about shooting...
-	while (!cgs->Done())
-	{
-//		if (canShoot(cgs))
-//		{
-//			moves.push_back(DoShootPlay(cgs));
-//			shootDanger = true;
-//		}
-//		else if (shootDanger == true)
-//		{
-//			moves.push_back(cgs->getRandomMove());
-//		}
-//		else
-		moves.push_back(DoMinPlay(cgs, epsilon));
-		gs->ApplyMove(moves.back());
-	}
-	maxnval *v = new maxnval();
-	double sum = 0;
-	for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-		sum+=(26-cgs->score(x));
-	for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-		v->eval[x] = (26-cgs->score(x));///sum;
+	// don't think about shooting (see canShoot/DoShootPlay)
+	return Playout((HeartsGameState *)gs, epsilon);
+}
 
-	while (moves.size() > 0)
-	{
-		gs->UndoMove(moves.back());
-		gs->freeMove(moves.back());
-		moves.pop_back();
-	}
+maxnval *SimpleHeartsPlayer::Evaluate(HeartsGameState *hgs)
+{
+	maxnval *v = new maxnval();
+	for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+		v->eval[x] = (26-hgs->HeartsGameState::score(x));
 	return v;
 }
 
-Move *SimpleHeartsPlayer::DoMinPlay(CardGameState *cgs, double epsilon)
+Move *SimpleHeartsPlayer::DoMinPlay(HeartsGameState *hgs, double epsilon)
 {
 	if (0||(rand.rand_double() < epsilon)) // x% chance of a rand move
 	{
-		return cgs->getRandomMove();
+		return hgs->HeartsGameState::getRandomMove();
 	}
 		
-	const Trick *trick = cgs->getCurrTrick();
+	const Trick *trick = hgs->getCurrTrick();
 	card winningCard = trick->WinningCard();
 //	int winner = trick->Winner();
 	mt_random rand;
 	
-	Move *m = cgs->getMoves();
+	Move *m = hgs->HeartsGameState::getMoves();
 	Move *best = m;
 	if (winningCard == -1) // leading, play random
 	{
@@ -1476,9 +1660,7 @@ Move *SimpleHeartsPlayer::DoMinPlay(CardGameState *cgs, double epsilon)
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	else if (Deck::getsuit(winningCard) == Deck::getsuit(((CardMove*)best)->c)) // follow randomly
 	{
@@ -1489,9 +1671,7 @@ Move *SimpleHeartsPlayer::DoMinPlay(CardGameState *cgs, double epsilon)
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	else { // sloughing -- high to low
 		double count = 0;
@@ -1507,9 +1687,7 @@ Move *SimpleHeartsPlayer::DoMinPlay(CardGameState *cgs, double epsilon)
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	assert(0);
 	return 0;
@@ -1582,7 +1760,6 @@ Player *GlobalHeartsPlayer::clone() const
 
 const char *GlobalHeartsPlayer::getName()
 {
-	static char name[255];
 	iiGameState *igs = getiiModel();
 	sprintf(name, "GlobalHearts(%s,%s)", igs->GetName(), algorithm->getName());
 	delete igs;
@@ -1626,7 +1803,6 @@ double GlobalHeartsPlayer2::cutoffEval(unsigned int who)
 
 const char *GlobalHeartsPlayer2::getName()
 {
-	static char name[255];
 	iiGameState *igs = getiiModel();
 	sprintf(name, "GlobalHearts2(%s,%s)", igs->GetName(), algorithm->getName());
 	delete igs;
@@ -1662,7 +1838,6 @@ double GlobalHeartsPlayer3::cutoffEval(unsigned int who)
 
 const char *GlobalHeartsPlayer3::getName()
 {
-	static char name[255];
 	iiGameState *igs = getiiModel();
 	sprintf(name, "GlobalHearts3(%s,%s)", igs->GetName(), algorithm->getName());
 	delete igs;
@@ -1701,69 +1876,39 @@ Player *SafeSimpleHeartsPlayer::clone() const
 
 const char *SafeSimpleHeartsPlayer::getName()
 {
-	static char name[255];
 	iiGameState *igs = getiiModel();
 	sprintf(name, "SafeSimple(0.90,%s,%s)", igs->GetName(), algorithm->getName());
 	delete igs;
 	return name;
 }
 
-maxnval *HeartsPlayout::DoRandomPlayout(GameState *gs, Player *p, double epsilon)
+maxnval *HeartsPlayout::Evaluate(HeartsGameState *hgs)
 {
-	//bool shootDanger = false;
-	std::vector<Move *> moves;
-	CardGameState *cgs = (CardGameState *)gs;
-	int havePoints = 0;
-	for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
-		if (cgs->taken[x].getSuit(HEARTS) || cgs->taken[x].has(SPADES, QUEEN))
-			havePoints++;
-	// first pass, don't think about shooting...
-	while (!cgs->Done())
-	{
-		moves.push_back(DoMinPlay(cgs, (havePoints > 1), epsilon));
-		gs->ApplyMove(moves.back());
-	}
 	maxnval *v = new maxnval();
 	double sum = 0;
-	for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-		sum+=(26-cgs->score(x));
-	for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-		v->eval[x] = (26-cgs->score(x))/sum;
-	
-	while (moves.size() > 0)
-	{
-		gs->UndoMove(moves.back());
-		gs->freeMove(moves.back());
-		moves.pop_back();
-	}
+	for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+		sum+=(26-hgs->HeartsGameState::score(x));
+	for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+		v->eval[x] = (26-hgs->HeartsGameState::score(x))/sum;
 	return v;
 }
 
-Move *HeartsPlayout::DoMinPlay(CardGameState *cgs, bool split, double epsilon)
+Move *HeartsPlayout::DoMinPlay(HeartsGameState *hgs, bool split, double epsilon)
 {
 	if (rand.rand_double() < epsilon) // x% chance of a rand move
 	{
-		return cgs->getRandomMove();
+		return hgs->HeartsGameState::getRandomMove();
 	}
 	
-	const Trick *trick = cgs->getCurrTrick();
+	const Trick *trick = hgs->getCurrTrick();
 	card winningCard = trick->WinningCard();
 
-	//	int winner = trick->Winner();
-	if (trick->curr == 0) // trick just taken!
-	{
-		int havePoints = 0;
-		for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
-			if (cgs->taken[x].getSuit(HEARTS) || cgs->taken[x].has(SPADES, QUEEN))
-				havePoints++;
-		if (havePoints > 1)
-			split = true;
-	}
-	
-	Move *m = cgs->getMoves();
+	Move *m = hgs->HeartsGameState::getMoves();
 	Move *best = m;
 	if (winningCard == -1) // leading, play random
 	{
+		if (history && history->mast) // or as MAST favours
+			return TakeMove(hgs, m, SampleMove(m, rand));
 		double count = 0;
 		for (Move *t = m->next; t; t = t->next)
 		{
@@ -1771,12 +1916,12 @@ Move *HeartsPlayout::DoMinPlay(CardGameState *cgs, bool split, double epsilon)
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	else if (Deck::getsuit(winningCard) == Deck::getsuit(((CardMove*)best)->c)) // follow randomly
 	{
+		if (history && history->mast) // or as MAST favours
+			return TakeMove(hgs, m, SampleMove(m, rand));
 		double count = 0;
 		for (Move *t = m->next; t; t = t->next)
 		{
@@ -1784,9 +1929,7 @@ Move *HeartsPlayout::DoMinPlay(CardGameState *cgs, bool split, double epsilon)
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	else { // sloughing -- high to low
 		double count = 0;
@@ -1802,9 +1945,7 @@ Move *HeartsPlayout::DoMinPlay(CardGameState *cgs, bool split, double epsilon)
 			if ((rand.rand_double() <= 1/count) || (Deck::getsuit(((CardMove*)t)->c) == HEARTS))
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	assert(0);
 	return 0;
@@ -1813,91 +1954,50 @@ Move *HeartsPlayout::DoMinPlay(CardGameState *cgs, bool split, double epsilon)
 
 maxnval *HeartsPlayoutCheckShoot::DoRandomPlayout(GameState *gs, Player *p, double epsilon)
 {
-	//bool shootDanger = false;
-	std::vector<Move *> moves;
-	CardGameState *cgs = (CardGameState *)gs;
-	int havePoints = 0;
-	for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
-		if (cgs->taken[x].getSuit(HEARTS) || cgs->taken[x].has(SPADES, QUEEN))
-			havePoints++;
+	HeartsGameState *hgs = (HeartsGameState *)gs;
+	me = gs->getPlayerNum(p);
 	// first pass, don't think about shooting...
-	while (!cgs->Done())
-	{
-		moves.push_back(DoMinPlay(cgs, (havePoints > 1), epsilon));
-		gs->ApplyMove(moves.back());
-	}
-	maxnval *v = new maxnval();
-	double sum = 0;
-	for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-		sum+=(26-cgs->score(x));
-	for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-		v->eval[x] = (26-cgs->score(x))/sum;
-	
-	bool playoutWasShoot = false;
-	int me = gs->getPlayerNum(p);
-	if (cgs->taken[me].getSuit(HEARTS)==0x1FFF && cgs->taken[me].has(SPADES, QUEEN))
-		playoutWasShoot = true;
-	
-	while (moves.size() > 0)
-	{
-		gs->UndoMove(moves.back());
-		gs->freeMove(moves.back());
-		moves.pop_back();
-	}
-	
+	shooting = false;
+	maxnval *v = Playout(hgs, epsilon);
+
 	// Did we shoot - do max play instead
 	if (playoutWasShoot)
 	{
 		printf("Re-doing shoot.\n");
-		while (!cgs->Done())
-		{
-			moves.push_back(DoMaxPlay(cgs, me, epsilon));
-			gs->ApplyMove(moves.back());
-		}
-		maxnval *v = new maxnval();
-		double sum = 0;
-		for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-			sum+=(26-cgs->score(x));
-		for (unsigned int x = 0; x < gs->getNumPlayers(); x++)
-			v->eval[x] = (26-cgs->score(x))/sum;
-		
-		while (moves.size() > 0)
-		{
-			gs->UndoMove(moves.back());
-			gs->freeMove(moves.back());
-			moves.pop_back();
-		}
-
+		shooting = true;
+		delete Playout(hgs, epsilon);
 	}
+	return v;
+}
 
+maxnval *HeartsPlayoutCheckShoot::Evaluate(HeartsGameState *hgs)
+{
+	maxnval *v = new maxnval();
+	double sum = 0;
+	for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+		sum+=(26-hgs->HeartsGameState::score(x));
+	for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+		v->eval[x] = (26-hgs->HeartsGameState::score(x))/sum;
+	playoutWasShoot = (hgs->taken[me].getSuit(HEARTS)==0x1FFF && hgs->taken[me].has(SPADES, QUEEN));
 	return v;
 }
 
-Move *HeartsPlayoutCheckShoot::DoMinPlay(CardGameState *cgs, bool split, double epsilon)
+Move *HeartsPlayoutCheckShoot::DoMinPlay(HeartsGameState *hgs, bool split, double epsilon)
 {
 	if (rand.rand_double() < epsilon) // x% chance of a rand move
 	{
-		return cgs->getRandomMove();
+		return hgs->HeartsGameState::getRandomMove();
 	}
 	
-	const Trick *trick = cgs->getCurrTrick();
+	const Trick *trick = hgs->getCurrTrick();
 	card winningCard = trick->WinningCard();
 
-	//	int winner = trick->Winner();
-	if (trick->curr == 0) // trick just taken!
-	{
-		int havePoints = 0;
-		for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
-			if (cgs->taken[x].getSuit(HEARTS) || cgs->taken[x].has(SPADES, QUEEN))
-				havePoints++;
-		if (havePoints > 1)
-			split = true;
-	}
-	
-	Move *m = cgs->getMoves();
+	Move *m = hgs->HeartsGameState::getMoves();
 	Move *best = m;
 	if (winningCard == -1) // leading, play random
 	{
+		if (history && history->mast) // or as MAST favours
+			return TakeMove(hgs, m, SampleMove(m, rand));
 		double count = 0;
 		for (Move *t = m->next; t; t = t->next)
 		{
@@ -1905,12 +2005,12 @@ Move *HeartsPlayoutCheckShoot::DoMinPlay(CardGameState *cgs, bool split, double
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	else if (Deck::getsuit(winningCard) == Deck::getsuit(((CardMove*)best)->c)) // follow randomly
 	{
+		if (history && history->mast) // or as MAST favours
+			return TakeMove(hgs, m, SampleMove(m, rand));
 		double count = 0;
 		for (Move *t = m->next; t; t = t->next)
 		{
@@ -1918,9 +2018,7 @@ Move *HeartsPlayoutCheckShoot::DoMinPlay(CardGameState *cgs, bool split, double
 			if (rand.rand_double() <= 1/count)
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	else { // sloughing -- high to low
 		double count = 0;
@@ -1936,17 +2034,15 @@ Move *HeartsPlayoutCheckShoot::DoMinPlay(CardGameState *cgs, bool split, double
 			if ((rand.rand_double() <= 1/count) || (Deck::getsuit(((CardMove*)t)->c) == HEARTS))
 				best = t;
 		}
-		best = best->clone(cgs);
-		cgs->freeMove(m);
-		return best;
+		return TakeMove(hgs, m, best);
 	}
 	assert(0);
 	return 0;
 }
 
-Move *HeartsPlayoutCheckShoot::DoMaxPlay(CardGameState *cgs, int me, double epsilon)
+Move *HeartsPlayoutCheckShoot::DoMaxPlay(HeartsGameState *hgs, int me, double epsilon)
 {
-	return cgs->getRandomMove();
+	return hgs->HeartsGameState::getRandomMove();
 }
 
 void HeartsCardPlayer::selectPassCards(int dir, card &a, card &b, card &c)
@@ -2122,16 +2218,7 @@ double HeartsCardPlayer::cutoffEval(unsigned int who)
 			int hnd = cgs->cards[x].getSuit(y);
 			if ((hnd == 0) && (x == owner) && (cgs->allplayed.suitCount(x) < 8))
 				shorts++;
-			int cnt = 0;
-			while (hnd)
-			{
-				if (hnd&0x1)
-				{
-					cardeval[x] += cnt;
-				}
-				hnd >>= 1;
-				cnt++;
-			}
+			cardeval[x] += getRankSum(hnd);
 		}
 	}
 	for (int x = 0; x < numP; x++)
@@ -2325,6 +2412,64 @@ double HeartsCardPlayer::scoreUpperBound(unsigned int who)
 	return g->getNumPlayers()*(othersPoints+pointsOut);
 }
 
+int HeartsGameState::interchangeableSuits(int rules)
+{
+	int free = (1<<SPADES)|(1<<DIAMONDS)|(1<<CLUBS);
+	if (rules&(kQueenPenalty|kQueenBreaksHearts|kNoQueenFirstTrick))
+		free &= ~(1<<SPADES);
+	if (rules&(kJackBonus|kShootingNeedsJack))
+		free &= ~(1<<DIAMONDS);
+	if (rules&(kLeadClubs|kLead2Clubs))
+		free &= ~(1<<CLUBS);
+	return free;
+}
+
+int HeartsGameState::getInterchangeableSuits() const
+{
+	int free = CardGameState::getInterchangeableSuits()&~(1<<HEARTS);
+	if ((rules&(kQueenPenalty|kQueenBreaksHearts|kNoQueenFirstTrick)) && !allplayed.has(SPADES, QUEEN))
+		free &= ~(1<<SPADES);
+	if ((rules&(kJackBonus|kShootingNeedsJack)) && !allplayed.has(DIAMONDS, JACK))
+		free &= ~(1<<DIAMONDS);
+	if ((rules&(kLeadClubs|kLead2Clubs)) && (currTrick == 0) && (t[0].curr == 0))
+		free &= ~(1<<CLUBS);
+	return free;
+}
+
+void HeartsGameState::getCanonicalSuits(suitPermutation &p) const
+{
+	uint64_t masks[4*MAXPLAYERS];
+	int n = 0;
+	for (unsigned int x = 0; x < numPlayers; x++)
+	{
+		masks[n] = 0;
+		for (unsigned int y = 0; y < passes[x].size(); y++)
+			masks[n] |= ((uint64_t)1)<<passes[x][y];
+		n++;
+		masks[n++] = cards[x].getHand();
+		masks[n++] = played[x].getHand();
+		masks[n++] = taken[x].getHand();
+	}
+	p.canonicalize(getInterchangeableSuits(), masks, n);
+}
+
+void HeartsGameState::getCanonicalSuits(int who, suitPermutation &p) const
+{
+	uint64_t masks[2+2*MAXPLAYERS];
+	int n = 0;
+	masks[n++] = cards[who].getHand();
+	masks[n] = 0;
+	for (unsigned int y = 0; y < passes[who].size(); y++)
+		masks[n] |= ((uint64_t)1)<<passes[who][y];
+	n++;
+	for (unsigned int x = 0; x < numPlayers; x++)
+	{
+		masks[n++] = played[x].getHand();
+		masks[n++] = taken[x].getHand();
+	}
+	p.canonicalize(getInterchangeableSuits(), masks, n);
+}
+
 HashState *HeartsGameState::getHashState(HashState *)
 {
 	if (getCurrTrick()->curr != 0)
@@ -2337,6 +2482,7 @@ HashState *HeartsGameState::getHashState(HashState *)
 	hs->ghs = cHS;
 	cHS->nextp = getNextPlayerNum();
 	cHS->nump = getNumPlayers();
+	cHS->numCards = 0;
 
 	for (int w = 0; w < cHS->nump; w++)
 	{
@@ -2823,8 +2969,10 @@ void HeartsShooter::selectPassCards(int dir, card &a, card &b, card &c)
 	} while ((c == b) && (c == a));
 }
 
-cardProbData iiHeartsState::cpd;
+// one model for both states; the tables aren't copied into each
+static const cardProbData opponentModel;
 //("/Users/nathanst/Desktop/model.txt");
+const cardProbData &iiHeartsState::cpd = opponentModel;
 
 GameState *iiHeartsState::getGameState(double &prob)
 {
@@ -3175,7 +3323,7 @@ double iiHeartsState::GetTrickOdds(int player, Trick &t, int which, Deck &d)
 }
 
 //cardProbData advancedIIHeartsState::cpd("model.txt");
-cardProbData advancedIIHeartsState::cpd;
+const cardProbData &advancedIIHeartsState::cpd = opponentModel;
 	
 advancedIIHeartsState::advancedIIHeartsState()
 :iiHeartsState()
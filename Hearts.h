@@ -6,6 +6,8 @@
 //#include "mathUtil.h"
 #include "UCT.h"
 #include "CardProbabilityData.h"
+#include <atomic>
+#include <memory>
 
 #ifndef HEARTS_H
 #define HEARTS_H
@@ -62,6 +64,31 @@ enum tScoreUtility {
  kMaximizeLeaderGlobal
 };
 
+/*
+ * A hand as one player sees it part way through, for
+ * HeartsGameState::SetPosition: their own cards, the tricks so far and the
+ * cards others are known to have taken without the tricks they came from.
+ */
+class HeartsPositionTrick {
+public:
+	HeartsPositionTrick(int l = 0) :leader(l) {}
+	int leader;
+	std::vector<card> cards; // in the order played, from the leader round
+};
+
+class HeartsPosition {
+public:
+	HeartsPosition() :rules(0), passDir(kHold), who(0) {}
+	int rules;
+	int passDir; // the hand's; used only if no card has been played yet
+	int who;     // whose cards are known
+	Deck hand;   // who's cards not yet played
+	// tricks in the order played, every one but the last complete; with
+	// none, or an empty last one, its leader is the player to lead
+	std::vector<HeartsPositionTrick> tricks;
+	Deck taken[MAXPLAYERS];
+};
+
 class HeartsGameState : public CardGameState
 {
 public:
@@ -74,7 +101,11 @@ public:
 	virtual void ApplyMove(Move *move);
 	virtual void UndoMove(Move *move);
 	HashState *getHashState(HashState*);
-	void Reset(int SEED = -1);
+	void Clear();
+	// Install p directly, without dealing or replaying its tricks. Returns
+	// false if p isn't a consistent hand, with error saying why; the state
+	// is then only fit to be cleared or set again.
+	bool SetPosition(const HeartsPosition &p, const char **error = 0);
 	void DealCards();
 	Move *getMoves();
 	Move *getAllMoves();
@@ -82,15 +113,24 @@ public:
 	bool IsLegalMove(Move *m);
 	void setPassDir(int dir);
 	int getPassDir() { return passDir; }
-	bool donePassing() { return ((!(rules&kDoPassCards)) || (passDir == kHold) || (numCardsPassed == getNumPlayers()*3)); }
+	bool donePassing() const { return ((!(rules&kDoPassCards)) || (passDir == kHold) || (numCardsPassed == (int)getNumPlayers()*3)); }
 	int Pass();
 	int score(const Trick *t) const;
 	double score(int who) const;
+	// settleHand on this state; false while passing
+	bool getSettledPiles(uint64_t *taken, uint64_t &allplayed) const;
 	int Winner() const;
 	void setFirstPlayer(int first);
 	virtual void waitEndTrick();
 	iiGameState *getiiGameState(bool consistent, int who, Player *playerModel);
 
+	// suits the rules single out stay fixed until their special card is played
+	int getInterchangeableSuits() const;
+	void getCanonicalSuits(suitPermutation &p) const;
+	void getCanonicalSuits(int who, suitPermutation &p) const;
+	// the interchangeable suits before any card has been played
+	static int interchangeableSuits(int rules);
+
 	void MeasureProperties();
 
 	int passDir;
@@ -140,29 +180,236 @@ public:
 	virtual double score(unsigned int who) { return g->score(who); }
 };
 
-class HeartsPlayout : public UCTModule {
+/**
+ * Whether the rest of a hand can still change a score. It can't once no
+ * point card is left in a hand or in the trick being played, or once the
+ * player to lead holds only cards that beat every other card left in
+ * their suits: the leader then takes every remaining trick. hands are
+ * the players' cards, trick the cards of the current trick and leader
+ * the player to lead, -1 during a trick. When the outcome is settled,
+ * taken and allplayed are changed to the piles the hand will end with,
+ * as far as HeartsGameState::score looks at them, and true is returned.
+ */
+inline bool settleHand(int rules, int numPlayers, const uint64_t *hands, uint64_t trick, int leader,
+                       uint64_t *taken, uint64_t &allplayed)
+{
+	uint64_t points = 0;
+	if (!(rules&kHeartsArentPoints))
+		points |= ((uint64_t)0x1FFF)<<(16*HEARTS);
+	if (rules&kQueenPenalty)
+		points |= ((uint64_t)1)<<Deck::getcard(SPADES, QUEEN);
+	if (rules&(kJackBonus|kShootingNeedsJack))
+		points |= ((uint64_t)1)<<Deck::getcard(DIAMONDS, JACK);
+	uint64_t left = trick;
+	for (int x = 0; x < numPlayers; x++)
+		left |= hands[x];
+
+	if ((left&points) == 0)
+	{
+		// who takes the rest still matters to a player without a trick
+		if (rules&kNoTrickBonus)
+			for (int x = 0; x < numPlayers; x++)
+				if (taken[x] == 0)
+					return false;
+		allplayed |= left;
+		return true;
+	}
+	if (leader == -1)
+		return false;
+	uint64_t others = 0;
+	for (int x = 0; x < numPlayers; x++)
+		if (x != leader)
+			others |= hands[x];
+	for (int s = 0; s < 4; s++)
+	{
+		uint64_t mine = (hands[leader]>>(16*s))&0xFFFF;
+		uint64_t theirs = (others>>(16*s))&0xFFFF;
+		// lower bits are higher cards: all of mine must sit below their highest
+		if (mine && theirs && (mine >= (theirs&(~theirs+1))))
+			return false;
+	}
+	taken[leader] |= left;
+	allplayed |= left;
+	return true;
+}
+
+/**
+ * Playout loop for HeartsGameState with the move policy bound at compile
+ * time. Policy provides ChooseMove(HeartsGameState*, double epsilon) and
+ * Evaluate(HeartsGameState*); every call on the state is qualified, so the
+ * whole loop can be inlined instead of making several virtual calls a ply.
+ */
+/**
+ * Playouts stopped once the outcome was settled, and the plies they
+ * skipped. A module and the copies cloneModule() makes for other threads
+ * share one count.
+ */
+class playoutSettleCounts {
 public:
-	maxnval *DoRandomPlayout(GameState *g, Player *p, double epsilon);
-	Move *DoMinPlay(CardGameState *cgs, bool split, double epsilon);
+	playoutSettleCounts() :playouts(0), plies(0) {}
+	void add(uint64_t skipped)
+	{
+		playouts.fetch_add(1, std::memory_order_relaxed);
+		plies.fetch_add(skipped, std::memory_order_relaxed);
+	}
+	uint64_t getPlayouts() const { return playouts.load(std::memory_order_relaxed); }
+	uint64_t getPlies() const { return plies.load(std::memory_order_relaxed); }
+private:
+	std::atomic<uint64_t> playouts, plies;
+};
+
+template <class Policy>
+class HeartsPlayoutEngine {
+protected:
+	HeartsPlayoutEngine() :history(0), settleCounts(std::make_shared<playoutSettleCounts>()) {}
+
+	maxnval *Playout(HeartsGameState *hgs, double epsilon)
+	{
+		Move *moves[52+3*MAXPLAYERS];
+		int n = 0;
+		Policy *policy = static_cast<Policy*>(this);
+		uint64_t taken[MAXPLAYERS], allplayed;
+		bool settled = false;
+		while (!hgs->CardGameState::Done())
+		{
+			if ((hgs->getCurrTrick()->curr == 0) && hgs->HeartsGameState::getSettledPiles(taken, allplayed))
+			{
+				settled = true;
+				break;
+			}
+			moves[n] = policy->ChooseMove(hgs, epsilon);
+			if (history)
+				history->Played(moves[n]->player, ((CardMove*)moves[n])->c&(kMoveSlots-1));
+			hgs->HeartsGameState::ApplyMove(moves[n]);
+			n++;
+		}
+		maxnval *v;
+		if (settled)
+			v = EvaluateSettled(hgs, taken, allplayed);
+		else
+			v = policy->Evaluate(hgs);
+		while (n > 0)
+		{
+			n--;
+			hgs->HeartsGameState::UndoMove(moves[n]);
+			hgs->freeMove(moves[n]);
+		}
+		return v;
+	}
+
+	// Policy::Evaluate on the piles the hand will end with
+	maxnval *EvaluateSettled(HeartsGameState *hgs, const uint64_t *taken, uint64_t allplayed)
+	{
+		const int numPlayers = hgs->getNumPlayers();
+		uint64_t oldTaken[MAXPLAYERS], oldPlayed = hgs->allplayed.getHand();
+		uint64_t skipped = 0;
+		for (int x = 0; x < numPlayers; x++)
+		{
+			oldTaken[x] = hgs->taken[x].getHand();
+			skipped += hgs->cards[x].count();
+			hgs->taken[x].setHand(taken[x]);
+		}
+		hgs->allplayed.setHand(allplayed);
+		settleCounts->add(skipped);
+		maxnval *v = static_cast<Policy*>(this)->Evaluate(hgs);
+		for (int x = 0; x < numPlayers; x++)
+			hgs->taken[x].setHand(oldTaken[x]);
+		hgs->allplayed.setHand(oldPlayed);
+		return v;
+	}
+
+	// unlink m from the move list and return the rest of the list to the pool
+	static Move *TakeMove(HeartsGameState *hgs, Move *list, Move *m)
+	{
+		if (list == m)
+			list = m->next;
+		else {
+			Move *prev = list;
+			while (prev->next != m)
+				prev = prev->next;
+			prev->next = m->next;
+		}
+		m->next = 0;
+		hgs->freeMove(list);
+		return m;
+	}
+
+	// the move of list m that history's MAST values pick
+	Move *SampleMove(Move *m, mt_random &r) const
+	{
+		Move *choices[52];
+		int slots[52];
+		int n = 0;
+		for (Move *t = m; t; t = t->next, n++)
+		{
+			choices[n] = t;
+			slots[n] = ((CardMove*)t)->c&(kMoveSlots-1);
+		}
+		return choices[history->Sample(m->player, slots, n, r)];
+	}
+
+	UCTHistory *history;
+public:
+	// playouts stopped once the outcome was settled, and the plies they skipped
+	uint64_t getSettledPlayouts() const { return settleCounts->getPlayouts(); }
+	uint64_t getPliesSaved() const { return settleCounts->getPlies(); }
+private:
+	std::shared_ptr<playoutSettleCounts> settleCounts;
+};
+
+class HeartsPlayout : public UCTModule, public HeartsPlayoutEngine<HeartsPlayout> {
+public:
+	maxnval *DoRandomPlayout(GameState *g, Player *p, double epsilon)
+	{ return Playout((HeartsGameState *)g, epsilon); }
+	Move *DoMinPlay(HeartsGameState *hgs, bool split, double epsilon);
 	const char *GetModuleName() { return "HPlayout"; }
+	void setSeed(uint32_t seed) { rand.srand(seed); }
+	UCTModule *cloneModule() const { return new HeartsPlayout(*this); }
+	void setHistory(UCTHistory *h) { history = h; }
+
+	Move *ChooseMove(HeartsGameState *hgs, double epsilon) { return DoMinPlay(hgs, false, epsilon); }
+	maxnval *Evaluate(HeartsGameState *hgs);
 private:
 	mt_random rand;
 };
 
-	class HeartsPlayoutCheckShoot : public UCTModule {
+	class HeartsPlayoutCheckShoot : public UCTModule, public HeartsPlayoutEngine<HeartsPlayoutCheckShoot> {
 public:
 	maxnval *DoRandomPlayout(GameState *g, Player *p, double epsilon);
-	Move *DoMinPlay(CardGameState *cgs, bool split, double epsilon);
-	Move *DoMaxPlay(CardGameState *cgs, int me, double epsilon);
+	Move *DoMinPlay(HeartsGameState *hgs, bool split, double epsilon);
+	Move *DoMaxPlay(HeartsGameState *hgs, int me, double epsilon);
 	const char *GetModuleName() { return "HCheckPlayout"; }
+	// me, shooting and playoutWasShoot belong to the playout in progress, so
+	// each thread needs its own copy
+	UCTModule *cloneModule() const { return new HeartsPlayoutCheckShoot(*this); }
+	void setHistory(UCTHistory *h) { history = h; }
+
+	Move *ChooseMove(HeartsGameState *hgs, double epsilon)
+	{ return shooting?DoMaxPlay(hgs, me, epsilon):DoMinPlay(hgs, false, epsilon); }
+	maxnval *Evaluate(HeartsGameState *hgs);
 private:
 	mt_random rand;
+	int me;
+	bool shooting, playoutWasShoot;
 };
 
-class SimpleHeartsPlayer : public CardPlayer, HeartsPlayer, public UCTModule {
+class HeartsPassEvaluator;
+class HeartsOpeningBook;
+class HeartsTimeManager;
+
+class SimpleHeartsPlayer : public CardPlayer, HeartsPlayer, public UCTModule,
+	public HeartsPlayoutEngine<SimpleHeartsPlayer> {
 public:
 	SimpleHeartsPlayer(Algorithm *alg);//, tScoreUtility u);
+	virtual Move *Play();
 	void selectPassCards(int dir, card &a, card &b, card &c);
+	// when set, the pass is chosen by the evaluator instead of the search
+	void setPassEvaluator(HeartsPassEvaluator *pe) { passEval = pe; }
+	// when set, book moves for the pass and first trick are played without searching
+	void setOpeningBook(const HeartsOpeningBook *b) { book = b; }
+	// when set, each play's worlds come from the time manager's budget
+	void setTimeManager(HeartsTimeManager *t) { timer = t; }
+	HeartsTimeManager *getTimeManager() const { return timer; }
 	void setModelLevel(int val) { modelLevel = val; }
 	virtual const char *getName();
 	virtual const char *GetModuleName() { return "Simple"; }
@@ -172,13 +419,24 @@ public:
 	double score(unsigned int who);
 	virtual double cutoffEval(unsigned int who = uINF);
 	maxnval *DoRandomPlayout(GameState *g, Player *p, double epsilon);
+
+	Move *ChooseMove(HeartsGameState *hgs, double epsilon) { return DoMinPlay(hgs, epsilon); }
+	maxnval *Evaluate(HeartsGameState *hgs);
 protected:
 	mt_random rand;
+	char name[255]; // getName(), per player so concurrent searches don't share it
 private:
-	Move *DoMinPlay(CardGameState *cgs, double epsilon);
+	Move *DoMinPlay(HeartsGameState *hgs, double epsilon);
 	Move *DoShootPlay(CardGameState *cgs);
 	bool canShoot(CardGameState *cgs);
 	int modelLevel;
+	Move *getLegalMove(HeartsGameState *hgs, card c);
+	Move *TimedPlay(HeartsGameState *hgs, int me);
+	HeartsPassEvaluator *passEval;
+	const HeartsOpeningBook *book;
+	HeartsTimeManager *timer;
+	card passCards[3];
+	bool havePass;
 };
 
 class GlobalHeartsPlayer : public SimpleHeartsPlayer {
@@ -253,7 +511,7 @@ public:
 	int passDir;
 	int numCardsPassed;
 	std::vector<card> passes[MAXPLAYERS];
-	static cardProbData cpd;
+	static const cardProbData &cpd;
 private:
 	double GetTrickOdds(int player, Trick &t, int which, Deck &d);
 	double GetProbability(int player, std::vector<card> &newCards, Trick *t, Deck &d);
@@ -268,7 +526,7 @@ public:
 	~advancedIIHeartsState();
 	virtual GameState *getGameState(double &prob);
 	virtual const char *GetName() { return "OM-2"; }
-	static cardProbData cpd;
+	static const cardProbData &cpd;
 private:
 	double GetTrickOdds(int player, Trick &t, int which, Deck &d);
 	double GetProbability(int player, std::vector<card> &newCards, Trick *t, Deck &d);
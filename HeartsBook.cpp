@@ -0,0 +1,265 @@
+/*
+ *  HeartsBook.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsBook.h"
+#include "HeartsPass.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hearts {
+
+static const char bookMagic[8] = {'H', 'R', 'T', 'B', 'O', 'O', 'K', '1'};
+
+class bookHeader {
+public:
+	char magic[8];
+	uint32_t count;
+	uint32_t entrySize;
+};
+
+static_assert(sizeof(bookEntry) == 64, "book entries are stored as 64 byte records");
+
+bool bookEntry::operator<(const bookEntry &e) const
+{
+	if (hand != e.hand) return hand < e.hand;
+	if (passed != e.passed) return passed < e.passed;
+	if (rules != e.rules) return rules < e.rules;
+	if (passDir != e.passDir) return passDir < e.passDir;
+	if (kind != e.kind) return kind < e.kind;
+	return memcmp(trick, e.trick, 3) < 0;
+}
+
+bool bookEntry::sameKey(const bookEntry &e) const
+{
+	return !(*this < e) && !(e < *this);
+}
+
+HeartsOpeningBook::HeartsOpeningBook()
+{
+	entries = 0;
+	count = 0;
+	mapping = 0;
+	mappingSize = 0;
+}
+
+HeartsOpeningBook::~HeartsOpeningBook()
+{
+	close();
+}
+
+bool HeartsOpeningBook::load(const char *file)
+{
+	close();
+#ifdef _WIN32
+	// no mmap; read the whole book instead
+	FILE *f = fopen(file, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	mappingSize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	mapping = malloc(mappingSize);
+	if ((mapping == 0) || (fread(mapping, 1, mappingSize, f) != mappingSize))
+	{
+		fclose(f);
+		close();
+		return false;
+	}
+	fclose(f);
+#else
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(bookHeader)))
+	{
+		::close(fd);
+		return false;
+	}
+	mappingSize = st.st_size;
+	mapping = mmap(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		mapping = 0;
+		mappingSize = 0;
+		return false;
+	}
+#endif
+	const bookHeader *h = (const bookHeader *)mapping;
+	if ((mappingSize < sizeof(bookHeader)) ||
+		(memcmp(h->magic, bookMagic, 8) != 0) || (h->entrySize != sizeof(bookEntry)) ||
+		(mappingSize < sizeof(bookHeader)+(size_t)h->count*sizeof(bookEntry)))
+	{
+		close();
+		return false;
+	}
+	entries = (const bookEntry *)(h+1);
+	count = h->count;
+	return true;
+}
+
+void HeartsOpeningBook::close()
+{
+	if (mapping)
+	{
+#ifdef _WIN32
+		free(mapping);
+#else
+		munmap(mapping, mappingSize);
+#endif
+	}
+	mapping = 0;
+	mappingSize = 0;
+	entries = 0;
+	count = 0;
+}
+
+const bookEntry *HeartsOpeningBook::find(const bookEntry &key) const
+{
+	const bookEntry *e = std::lower_bound(entries, entries+count, key);
+	if ((e != entries+count) && e->sameKey(key))
+		return e;
+	return 0;
+}
+
+static int bookRules(int rules)
+{
+	return rules&~kDoPassCards;
+}
+
+static int bookPassDir(int passDir, int rules)
+{
+	return (rules&kDoPassCards)?passDir:kHold;
+}
+
+void HeartsOpeningBook::getPassKey(uint64_t hand, int passDir, int rules, bookEntry &key, suitPermutation &suits)
+{
+	memset(&key, 0, sizeof(key));
+	key.hand = HeartsPassEvaluator::canonicalHand(hand, bookRules(rules), suits);
+	key.rules = bookRules(rules);
+	key.passDir = passDir;
+	key.kind = kBookPass;
+	key.trick[0] = key.trick[1] = key.trick[2] = 0xFF;
+}
+
+bool HeartsOpeningBook::getPlayKey(HeartsGameState *hgs, int who, bookEntry &key, suitPermutation &suits)
+{
+	if ((hgs->getCurrTrickNum() != 0) || (!hgs->donePassing()))
+		return false;
+	int rules = hgs->getRules();
+	int passDir = bookPassDir(hgs->getPassDir(), rules);
+	const Trick *t = hgs->getCurrTrick();
+	if (t->curr > 3)
+		return false;
+
+	// suits tied in the hand are ordered by the cards passed, then the trick
+	uint64_t masks[5];
+	masks[0] = hgs->cards[who].getHand();
+	masks[1] = 0;
+	if (passDir != kHold)
+		for (unsigned int x = 0; x < hgs->passes[who].size(); x++)
+			masks[1] |= ((uint64_t)1)<<hgs->passes[who][x];
+	for (int x = 0; x < 3; x++)
+		masks[2+x] = (x < t->curr)?(((uint64_t)1)<<t->play[x]):0;
+	suits.canonicalize(HeartsGameState::interchangeableSuits(bookRules(rules)), masks, 5);
+
+	memset(&key, 0, sizeof(key));
+	key.hand = suits.map(masks[0]);
+	key.passed = suits.map(masks[1]);
+	key.rules = bookRules(rules);
+	key.passDir = passDir;
+	key.kind = kBookPlay;
+	for (int x = 0; x < 3; x++)
+		key.trick[x] = (x < t->curr)?suits.map(t->play[x]):0xFF;
+	return true;
+}
+
+bool HeartsOpeningBook::getPass(uint64_t hand, int passDir, int rules, card *pass) const
+{
+	if (count == 0)
+		return false;
+	bookEntry key;
+	suitPermutation suits;
+	getPassKey(hand, passDir, rules, key, suits);
+	const bookEntry *e = find(key);
+	if ((e == 0) || (e->numMoves == 0))
+		return false;
+	int best = 0;
+	for (int x = 1; x < e->numMoves; x++)
+		if (e->moves[x].weight > e->moves[best].weight)
+			best = x;
+	for (int x = 0; x < 3; x++)
+		pass[x] = suits.unmap((card)e->moves[best].c[x]);
+	std::sort(pass, pass+3);
+	return true;
+}
+
+bool HeartsOpeningBook::getPlay(HeartsGameState *hgs, int who, card &c) const
+{
+	if (count == 0)
+		return false;
+	bookEntry key;
+	suitPermutation suits;
+	if (!getPlayKey(hgs, who, key, suits))
+		return false;
+	const bookEntry *e = find(key);
+	if ((e == 0) || (e->numMoves == 0))
+		return false;
+	int best = 0;
+	for (int x = 1; x < e->numMoves; x++)
+		if (e->moves[x].weight > e->moves[best].weight)
+			best = x;
+	c = suits.unmap((card)e->moves[best].c[0]);
+	return true;
+}
+
+static bool sameKey(const bookEntry &a, const bookEntry &b)
+{
+	return a.sameKey(b);
+}
+
+bool HeartsOpeningBook::write(const char *file, std::vector<bookEntry> &book)
+{
+	// stable sort + keeping the last of each run lets later entries win
+	std::stable_sort(book.begin(), book.end());
+	std::reverse(book.begin(), book.end());
+	book.erase(std::unique(book.begin(), book.end(), sameKey), book.end());
+	std::reverse(book.begin(), book.end());
+
+	FILE *f = fopen(file, "wb");
+	if (!f)
+		return false;
+	bookHeader h;
+	memcpy(h.magic, bookMagic, 8);
+	h.count = book.size();
+	h.entrySize = sizeof(bookEntry);
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+	if (ok && (book.size() > 0))
+		ok = (fwrite(&book[0], sizeof(bookEntry), book.size(), f) == book.size());
+	fclose(f);
+	return ok;
+}
+
+bool HeartsOpeningBook::read(const char *file, std::vector<bookEntry> &book)
+{
+	HeartsOpeningBook b;
+	if (!b.load(file))
+		return false;
+	book.insert(book.end(), b.entries, b.entries+b.count);
+	return true;
+}
+
+} // namespace hearts
@@ -0,0 +1,90 @@
+/*
+ *  HeartsBook.h
+ *  Hearts
+ *
+ *  Opening book for the first decisions of a hand: the pass and every
+ *  play of the first trick. The book is built offline by
+ *  hearts_book_builder and memory-mapped read-only at run time.
+ *
+ */
+
+#include "Hearts.h"
+#include <vector>
+
+#ifndef HEARTSBOOK_H
+#define HEARTSBOOK_H
+
+namespace hearts {
+
+const int kBookMoves = 4;
+
+enum tBookEntry {
+	kBookPass = 0,
+	kBookPlay = 1
+};
+
+/**
+ * One book move. A pass uses all three cards, a play only the first;
+ * unused cards are 0xFF. For a pass the weight is the mean playout
+ * utility of the set, for a play the fraction of searches choosing it.
+ */
+class bookMove {
+public:
+	uint8_t c[3];
+	uint8_t pad;
+	float weight;
+};
+
+/**
+ * Fixed-size 64 byte record, stored in key order so the mapped file can be
+ * binary searched in place. All cards are in canonical suits (see
+ * suitPermutation) and the file uses the byte order of
+ * the machine that built it.
+ */
+class bookEntry {
+public:
+	uint64_t hand;      // cards held when the decision is made
+	uint64_t passed;    // cards passed away this hand (plays only)
+	uint32_t rules;     // rules without kDoPassCards
+	int8_t passDir;     // kHold when kDoPassCards is not set
+	uint8_t kind;       // tBookEntry
+	uint8_t trick[3];   // first-trick cards already played, 0xFF when empty
+	uint8_t numMoves;
+	uint8_t pad[4];
+	bookMove moves[kBookMoves];
+
+	bool operator<(const bookEntry &e) const;
+	bool sameKey(const bookEntry &e) const;
+};
+
+class HeartsOpeningBook {
+public:
+	HeartsOpeningBook();
+	~HeartsOpeningBook();
+	bool load(const char *file);
+	void close();
+	int size() const { return count; }
+
+	// the best book pass for a full hand, in ascending card order
+	bool getPass(uint64_t hand, int passDir, int rules, card *pass) const;
+	// the best book play for who on the first trick
+	bool getPlay(HeartsGameState *hgs, int who, card &c) const;
+	const bookEntry *find(const bookEntry &key) const;
+
+	// keys are filled in canonical suits; suits maps real cards to them
+	static void getPassKey(uint64_t hand, int passDir, int rules, bookEntry &key, suitPermutation &suits);
+	static bool getPlayKey(HeartsGameState *hgs, int who, bookEntry &key, suitPermutation &suits);
+
+	// write sorted entries; duplicate keys keep the last entry given
+	static bool write(const char *file, std::vector<bookEntry> &entries);
+	static bool read(const char *file, std::vector<bookEntry> &entries);
+private:
+	const bookEntry *entries;
+	int count;
+	void *mapping;
+	size_t mappingSize;
+};
+
+} // namespace hearts
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ *  HeartsDifficulty.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsDifficulty.h"
+#include "HeartsEval.h"
+#include "HeartsFast.h"
+#include "iiMonteCarlo.h"
+#include <cstring>
+
+namespace hearts {
+
+static const HeartsDifficultyPreset presets[kNumDifficulties] = {
+	{"easy", 0, 0, -1, 0},
+	{"medium", 10, 100, 4, 0.1},
+	{"hard", 30, 333, -1, 0.1}
+};
+
+const HeartsDifficultyPreset &getDifficultyPreset(tHeartsDifficulty d)
+{
+	return presets[d];
+}
+
+bool getDifficulty(const char *name, tHeartsDifficulty &d)
+{
+	for (int x = 0; x < kNumDifficulties; x++)
+	{
+		if (strcmp(name, presets[x].name) == 0)
+		{
+			d = (tHeartsDifficulty)x;
+			return true;
+		}
+	}
+	return false;
+}
+
+Player *newDifficultyPlayer(tHeartsDifficulty d, int rules)
+{
+	const HeartsDifficultyPreset &p = presets[d];
+	if (p.worlds == 0)
+		return new HeartsDucker();
+
+	UCT *uct = new UCT(p.simsPerWorld, 0.4);
+	if (p.evalCutoff >= 0)
+		uct->setPlayoutModule(new HeartsLinearEval(p.evalCutoff));
+	else
+		uct->setPlayoutModule(newHeartsPlayout(rules));
+	uct->setEpsilonPlayout(p.epsilon);
+	SimpleHeartsPlayer *player = new SafeSimpleHeartsPlayer(new iiMonteCarlo(uct, p.worlds));
+	player->setModelLevel(2);
+	return player;
+}
+
+} // namespace hearts
@@ -0,0 +1,45 @@
+/*
+ *  HeartsDifficulty.h
+ *  Hearts
+ *
+ *  Named playing strengths for bots, cheapest first. Each is a fixed
+ *  player configuration; hearts_calibrate measures how well each plays
+ *  and what a decision costs.
+ *
+ */
+
+#include "Hearts.h"
+
+#ifndef HEARTSDIFFICULTY_H
+#define HEARTSDIFFICULTY_H
+
+namespace hearts {
+
+enum tHeartsDifficulty {
+	kDifficultyEasy = 0,   // HeartsDucker, no search
+	kDifficultyMedium = 1, // a few worlds, short playouts scored by HeartsLinearEval
+	kDifficultyHard = 2,   // the full search
+	kNumDifficulties = 3
+};
+
+class HeartsDifficultyPreset {
+public:
+	const char *name;
+	int worlds;       // 0 when the player doesn't search
+	int simsPerWorld;
+	int evalCutoff;   // plies before HeartsLinearEval scores a playout; -1 plays it out
+	double epsilon;
+};
+
+const HeartsDifficultyPreset &getDifficultyPreset(tHeartsDifficulty d);
+// false if name isn't "easy", "medium" or "hard"
+bool getDifficulty(const char *name, tHeartsDifficulty &d);
+
+// A player of the given strength for the rules. A searching player's
+// algorithm is its iiMonteCarlo, single threaded until the caller says
+// otherwise; its UCT and playout module aren't freed with it.
+Player *newDifficultyPlayer(tHeartsDifficulty d, int rules);
+
+} // namespace hearts
+
+#endif
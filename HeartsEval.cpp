@@ -0,0 +1,402 @@
+/*
+ *  HeartsEval.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsEval.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+namespace hearts {
+
+// Fit by hearts_eval_trainer on 20000 self-play hands (HeartsPlayout
+// policy, epsilon 0.1, standard rules). Re-run the trainer and load()
+// the result if the rules or playout policy change.
+static const float defaultWeights[kNumEvalFeatures] = {
+	1.925423f,  // bias
+	0.907045f,  // points taken
+	0.709568f,  // trick points
+	0.166586f,  // unplayed points
+	3.843502f,  // has queen
+	2.823077f,  // bare spade honor
+	-0.162503f, 0.024370f, -0.144745f, -0.248142f, // suit length
+	-0.316403f, -0.090613f, -0.352678f, -0.644371f, // void
+	0.718984f,  // sure winners
+	-0.270276f  // sure losers
+};
+
+static const float defaultPriorWeights[kNumPriorFeatures] = {
+	1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f
+};
+
+static inline int bitCount(uint64_t v)
+{
+	int c = 0;
+	for (; v; c++)
+		v &= v-1;
+	return c;
+}
+
+HeartsLinearEval::HeartsLinearEval(int cutoff)
+{
+	cutoffDepth = cutoff;
+	history = 0;
+	setWeights(defaultWeights);
+}
+
+void HeartsLinearEval::setWeights(const float *w)
+{
+	memcpy(weights, w, sizeof(weights));
+}
+
+void HeartsLinearEval::getFeatures(const HeartsGameState *hgs, int who, float *f)
+{
+	const int rules = hgs->rules;
+	const int heartValue = (rules&kHeartsArentPoints)?0:1;
+	const int queenValue = (rules&kQueenPenalty)?13:0;
+	const card qs = Deck::getcard(SPADES, QUEEN);
+
+	uint64_t others = 0;
+	uint64_t inHands = 0;
+	for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+	{
+		inHands |= hgs->cards[x].getHand();
+		if ((int)x != who)
+			others |= hgs->cards[x].getHand();
+	}
+	const Deck &mine = hgs->cards[who];
+	Deck held;
+	held.setHand(inHands);
+
+	memset(f, 0, sizeof(float)*kNumEvalFeatures);
+	f[kEvalBias] = 1;
+	f[kEvalPointsTaken] = heartValue*hgs->taken[who].suitCount(HEARTS)+queenValue*hgs->taken[who].has(qs);
+
+	const Trick *t = hgs->getCurrTrick();
+	if ((t->curr > 0) && (t->Winner() == who))
+		f[kEvalTrickPoints] = hgs->score(t);
+
+	f[kEvalUnplayedPoints] = heartValue*held.suitCount(HEARTS)+queenValue*held.has(qs);
+	f[kEvalHasQueen] = mine.has(qs);
+	if (queenValue && ((others>>qs)&1) &&
+		(mine.has(SPADES, ACE) || mine.has(SPADES, KING)))
+		f[kEvalBareSpadeHonor] = 1;
+
+	for (int s = 0; s < 4; s++)
+	{
+		uint16_t m = mine.getSuit(s);
+		uint16_t o = (uint16_t)((others>>(16*s))&0xFFFF);
+		f[kEvalSuitLength+s] = mine.suitCount(s);
+		f[kEvalVoid+s] = (m == 0);
+		// lower bit index is a higher rank, so everything below the
+		// opponents' best card in this suit is a sure winner and
+		// everything above their worst card can always duck
+		if (o == 0)
+		{
+			f[kEvalSureWinners] += bitCount(m);
+			continue;
+		}
+		f[kEvalSureWinners] += bitCount(m&((o&(~o+1))-1));
+		int low = 15;
+		while (!((o>>low)&1))
+			low--;
+		f[kEvalSureLosers] += bitCount(m>>(low+1));
+	}
+}
+
+double HeartsLinearEval::predictScore(const HeartsGameState *hgs, int who) const
+{
+	float f[kNumEvalFeatures];
+	getFeatures(hgs, who, f);
+	float sum = 0;
+	for (int x = 0; x < kNumEvalFeatures; x++)
+		sum += weights[x]*f[x];
+	return sum;
+}
+
+maxnval *HeartsLinearEval::getValue(CardGameState *cgs)
+{
+	HeartsGameState *hgs = (HeartsGameState *)cgs;
+	maxnval *v = new maxnval();
+	double pred[MAXPLAYERS];
+	double sum = 0;
+	for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
+	{
+		if (cgs->Done())
+			pred[x] = cgs->score(x);
+		else {
+			pred[x] = predictScore(hgs, x);
+			if (pred[x] > 26) pred[x] = 26;
+			if (pred[x] < -10) pred[x] = -10;
+		}
+		sum += 26-pred[x];
+	}
+	for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
+		v->eval[x] = (26-pred[x])/sum;
+	return v;
+}
+
+maxnval *HeartsLinearEval::DoRandomPlayout(GameState *gs, Player *p, double epsilon)
+{
+	CardGameState *cgs = (CardGameState *)gs;
+	std::vector<Move *> moves;
+	int havePoints = 0;
+	for (unsigned int x = 0; x < cgs->getNumPlayers(); x++)
+		if (cgs->taken[x].getSuit(HEARTS) || cgs->taken[x].has(SPADES, QUEEN))
+			havePoints++;
+	while (!cgs->Done() && ((cutoffDepth < 0) || ((int)moves.size() < cutoffDepth)))
+	{
+		moves.push_back(rollout.DoMinPlay((HeartsGameState *)cgs, (havePoints > 1), epsilon));
+		if (history)
+			history->Played(moves.back()->player, ((CardMove*)moves.back())->c&(kMoveSlots-1));
+		gs->ApplyMove(moves.back());
+	}
+	maxnval *v = getValue(cgs);
+	while (moves.size() > 0)
+	{
+		gs->UndoMove(moves.back());
+		gs->freeMove(moves.back());
+		moves.pop_back();
+	}
+	return v;
+}
+
+bool HeartsLinearEval::load(const char *file)
+{
+	FILE *f = fopen(file, "r");
+	if (!f) return false;
+	float w[kNumEvalFeatures];
+	for (int x = 0; x < kNumEvalFeatures; x++)
+	{
+		if (fscanf(f, "%f", &w[x]) != 1)
+		{
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	setWeights(w);
+	return true;
+}
+
+bool HeartsLinearEval::save(const char *file) const
+{
+	FILE *f = fopen(file, "w+");
+	if (!f) return false;
+	for (int x = 0; x < kNumEvalFeatures; x++)
+		fprintf(f, "%f\n", weights[x]);
+	fclose(f);
+	return true;
+}
+
+void HeartsLinearEval::fit(const std::vector<float> &features, const std::vector<float> &scores,
+						   float *w, double lambda)
+{
+	const int n = kNumEvalFeatures;
+	double a[kNumEvalFeatures][kNumEvalFeatures+1];
+	memset(a, 0, sizeof(a));
+	// normal equations: (X'X + lambda*N*I) w = X'y
+	for (unsigned int s = 0; s < scores.size(); s++)
+	{
+		const float *f = &features[s*n];
+		for (int x = 0; x < n; x++)
+		{
+			for (int y = 0; y < n; y++)
+				a[x][y] += f[x]*f[y];
+			a[x][n] += f[x]*scores[s];
+		}
+	}
+	for (int x = 1; x < n; x++)
+		a[x][x] += lambda*scores.size();
+	// a feature that never fires would make the system singular
+	for (int x = 0; x < n; x++)
+		if (a[x][x] == 0)
+			a[x][x] = 1;
+
+	// gaussian elimination with partial pivoting
+	for (int c = 0; c < n; c++)
+	{
+		int pivot = c;
+		for (int r = c+1; r < n; r++)
+			if (fabs(a[r][c]) > fabs(a[pivot][c]))
+				pivot = r;
+		for (int y = 0; y <= n; y++)
+		{
+			double tmp = a[c][y]; a[c][y] = a[pivot][y]; a[pivot][y] = tmp;
+		}
+		for (int r = c+1; r < n; r++)
+		{
+			double factor = a[r][c]/a[c][c];
+			for (int y = c; y <= n; y++)
+				a[r][y] -= factor*a[c][y];
+		}
+	}
+	for (int c = n-1; c >= 0; c--)
+	{
+		double val = a[c][n];
+		for (int y = c+1; y < n; y++)
+			val -= a[c][y]*w[y];
+		w[c] = (float)(val/a[c][c]);
+	}
+}
+
+HeartsMovePrior::HeartsMovePrior()
+:ranker(0)
+{
+	setWeights(defaultPriorWeights);
+}
+
+void HeartsMovePrior::setWeights(const float *w)
+{
+	memcpy(weights, w, sizeof(weights));
+}
+
+void HeartsMovePrior::getFeatures(HeartsGameState *hgs, Move *m, float *f)
+{
+	const Trick *t = hgs->getCurrTrick();
+	const card c = ((CardMove *)m)->c;
+	const card qs = Deck::getcard(SPADES, QUEEN);
+
+	memset(f, 0, sizeof(float)*kNumPriorFeatures);
+	f[kPriorRankMove] = ranker.rankMove(m, hgs)/10.0f;
+	f[kPriorQueen] = (c == qs);
+	f[kPriorHeart] = (Deck::getsuit(c) == HEARTS);
+	f[kPriorHighCard] = (TWO-Deck::getrank(c))/(float)TWO;
+
+	if (t->curr == 0)
+	{
+		f[kPriorWinsTrick] = 1;
+	}
+	else if (Deck::getsuit(c) != Deck::getsuit(t->play[0]))
+	{
+		f[kPriorSloughHigh] = f[kPriorHighCard];
+	}
+	else if (Deck::higher(c, t->WinningCard()))
+	{
+		f[kPriorWinsTrick] = 1;
+	}
+	if ((t->curr > 0) && (f[kPriorWinsTrick] > 0))
+	{
+		f[kPriorTakesPoints] = hgs->score(t);
+		if ((Deck::getsuit(c) == HEARTS) && !(hgs->rules&kHeartsArentPoints))
+			f[kPriorTakesPoints] += 1;
+		if ((c == qs) && (hgs->rules&kQueenPenalty))
+			f[kPriorTakesPoints] += 13;
+	}
+
+	if ((c == Deck::getcard(SPADES, ACE)) || (c == Deck::getcard(SPADES, KING)))
+	{
+		for (unsigned int x = 0; x < hgs->getNumPlayers(); x++)
+			if ((int)x != m->player && hgs->cards[x].has(qs))
+				f[kPriorSpadeHonor] = 1;
+	}
+}
+
+void HeartsMovePrior::GetPriors(GameState *g, const std::vector<Move *> &moves, double *priors)
+{
+	HeartsGameState *hgs = (HeartsGameState *)g;
+	float f[kNumPriorFeatures];
+	double best = -1e30;
+	for (unsigned int y = 0; y < moves.size(); y++)
+	{
+		getFeatures(hgs, moves[y], f);
+		double v = 0;
+		for (int x = 0; x < kNumPriorFeatures; x++)
+			v += weights[x]*f[x];
+		priors[y] = v;
+		if (v > best)
+			best = v;
+	}
+	double sum = 0;
+	for (unsigned int y = 0; y < moves.size(); y++)
+		sum += (priors[y] = exp(priors[y]-best));
+	for (unsigned int y = 0; y < moves.size(); y++)
+		priors[y] /= sum;
+}
+
+bool HeartsMovePrior::load(const char *file)
+{
+	FILE *f = fopen(file, "r");
+	if (!f) return false;
+	float w[kNumPriorFeatures];
+	for (int x = 0; x < kNumPriorFeatures; x++)
+	{
+		if (fscanf(f, "%f", &w[x]) != 1)
+		{
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	setWeights(w);
+	return true;
+}
+
+bool HeartsMovePrior::save(const char *file) const
+{
+	FILE *f = fopen(file, "w+");
+	if (!f) return false;
+	for (int x = 0; x < kNumPriorFeatures; x++)
+		fprintf(f, "%f\n", weights[x]);
+	fclose(f);
+	return true;
+}
+
+double HeartsMovePrior::fit(const std::vector<float> &features, const std::vector<float> &targets,
+							const std::vector<int> &groupSize, float *w, int iterations)
+{
+	const int n = kNumPriorFeatures;
+	double weight[kNumPriorFeatures], grad[kNumPriorFeatures], hist[kNumPriorFeatures];
+	std::vector<double> p;
+	for (int x = 0; x < n; x++)
+	{
+		weight[x] = w[x];
+		hist[x] = 0;
+	}
+	double loss = 0;
+	// adagrad on the mean cross-entropy; the problem is convex
+	for (int iter = 0; iter < iterations; iter++)
+	{
+		loss = 0;
+		memset(grad, 0, sizeof(grad));
+		unsigned int start = 0;
+		for (unsigned int g = 0; g < groupSize.size(); g++)
+		{
+			p.resize(groupSize[g]);
+			double best = -1e30, sum = 0;
+			for (int y = 0; y < groupSize[g]; y++)
+			{
+				p[y] = 0;
+				for (int x = 0; x < n; x++)
+					p[y] += weight[x]*features[(start+y)*n+x];
+				if (p[y] > best)
+					best = p[y];
+			}
+			for (int y = 0; y < groupSize[g]; y++)
+				sum += (p[y] = exp(p[y]-best));
+			for (int y = 0; y < groupSize[g]; y++)
+			{
+				p[y] /= sum;
+				if (targets[start+y] > 0)
+					loss -= targets[start+y]*log(p[y]+1e-12);
+				for (int x = 0; x < n; x++)
+					grad[x] += (p[y]-targets[start+y])*features[(start+y)*n+x];
+			}
+			start += groupSize[g];
+		}
+		for (int x = 0; x < n; x++)
+		{
+			grad[x] /= groupSize.size();
+			hist[x] += grad[x]*grad[x];
+			weight[x] -= 0.5*grad[x]/(sqrt(hist[x])+1e-8);
+		}
+		loss /= groupSize.size();
+	}
+	for (int x = 0; x < n; x++)
+		w[x] = (float)weight[x];
+	return loss;
+}
+
+} // namespace hearts
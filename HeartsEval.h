@@ -0,0 +1,114 @@
+/*
+ *  HeartsEval.h
+ *  Hearts
+ *
+ *  Learned leaf evaluation for UCT. Instead of rolling a hand out to
+ *  the end, the state is reduced to a handful of bitboard features per
+ *  player and a linear model predicts each player's final hand score.
+ *
+ */
+
+#include "Hearts.h"
+#include <vector>
+
+#ifndef HEARTSEVAL_H
+#define HEARTSEVAL_H
+
+namespace hearts {
+
+enum tEvalFeature {
+	kEvalBias = 0,
+	kEvalPointsTaken,       // points already in the player's taken pile
+	kEvalTrickPoints,       // points in the current trick if the player is winning it
+	kEvalUnplayedPoints,    // points still in someone's hand
+	kEvalHasQueen,
+	kEvalBareSpadeHonor,    // holds AS/KS while the QS is in another hand
+	kEvalSuitLength,        // 4 entries, one per suit
+	kEvalVoid = kEvalSuitLength+4,  // 4 entries, one per suit
+	kEvalSureWinners = kEvalVoid+4, // cards above everything the opponents hold
+	kEvalSureLosers,        // cards below everything the opponents hold
+	kNumEvalFeatures
+};
+
+/**
+ * Linear value function over per-player features. The features are
+ * computed from the Deck bitboards of a fully determinized world, so
+ * this is only meaningful inside a UCT search of an iiMonteCarlo world.
+ *
+ * The cutoff depth is the number of plies played with the HeartsPlayout
+ * policy before the model is consulted. 0 evaluates the leaf directly,
+ * -1 plays to the end of the hand (equivalent to HeartsPlayout).
+ */
+class HeartsLinearEval : public UCTModule {
+public:
+	HeartsLinearEval(int cutoff = 0);
+	maxnval *DoRandomPlayout(GameState *g, Player *p, double epsilon);
+	const char *GetModuleName() { return "LinearEval"; }
+	void setSeed(uint32_t seed) { rollout.setSeed(seed); }
+	UCTModule *cloneModule() const { return new HeartsLinearEval(*this); }
+	void setHistory(UCTHistory *h) { history = h; rollout.setHistory(h); }
+
+	void setCutoffDepth(int plies) { cutoffDepth = plies; }
+	int getCutoffDepth() const { return cutoffDepth; }
+
+	double predictScore(const HeartsGameState *hgs, int who) const;
+	static void getFeatures(const HeartsGameState *hgs, int who, float *features);
+
+	void setWeights(const float *w);
+	const float *getWeights() const { return weights; }
+	bool load(const char *file);
+	bool save(const char *file) const;
+
+	// ridge regression of final hand score onto the features
+	static void fit(const std::vector<float> &features, const std::vector<float> &scores,
+					float *w, double lambda = 1e-3);
+private:
+	maxnval *getValue(CardGameState *cgs);
+	float weights[kNumEvalFeatures];
+	int cutoffDepth;
+	HeartsPlayout rollout;
+	UCTHistory *history;
+};
+
+enum tPriorFeature {
+	kPriorRankMove = 0,     // HeartsCardPlayer::rankMove, scaled by 1/10
+	kPriorQueen,            // the card is the QS
+	kPriorHeart,
+	kPriorHighCard,         // rank, 1 for an ace down to 0 for a two
+	kPriorWinsTrick,        // would be winning the trick after this play
+	kPriorTakesPoints,      // points in the trick (with this card) if winning it
+	kPriorSloughHigh,       // high card, when not following suit
+	kPriorSpadeHonor,       // AS/KS while another player holds the QS
+	kNumPriorFeatures
+};
+
+/**
+ * Softmax move prior for PUCT over simple per-move features. With the
+ * default weights this is exp(rankMove/10); hearts_eval_trainer can fit
+ * the weights to the root visit counts of full UCT searches.
+ */
+class HeartsMovePrior : public UCTPrior {
+public:
+	HeartsMovePrior();
+	void GetPriors(GameState *g, const std::vector<Move *> &moves, double *priors);
+	const char *GetPriorName() { return "HPrior"; }
+
+	void getFeatures(HeartsGameState *hgs, Move *m, float *features);
+
+	void setWeights(const float *w);
+	const float *getWeights() const { return weights; }
+	bool load(const char *file);
+	bool save(const char *file) const;
+
+	// cross-entropy fit of the softmax to target distributions. Moves are
+	// grouped by position; groupSize[i] moves belong to position i.
+	static double fit(const std::vector<float> &features, const std::vector<float> &targets,
+					  const std::vector<int> &groupSize, float *w, int iterations = 500);
+private:
+	float weights[kNumPriorFeatures];
+	HeartsCardPlayer ranker;
+};
+
+} // namespace hearts
+
+#endif
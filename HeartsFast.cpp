@@ -0,0 +1,39 @@
+/*
+ *  HeartsFast.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsFast.h"
+
+namespace hearts {
+
+bool hasFastPlayout(int rules, int numPlayers)
+{
+	if (numPlayers != 4)
+		return false;
+	switch (rules&~kDoPassCards)
+	{
+		case kStandardRules:
+		case kStandard2ClubsRules:
+		case kOmnibusRules:
+			return true;
+	}
+	return false;
+}
+
+UCTModule *newHeartsPlayout(int rules, int numPlayers)
+{
+	if (numPlayers == 4)
+	{
+		switch (rules&~kDoPassCards)
+		{
+			case kStandardRules: return new HeartsFastPlayout<kStandardRules, 4>();
+			case kStandard2ClubsRules: return new HeartsFastPlayout<kStandard2ClubsRules, 4>();
+			case kOmnibusRules: return new HeartsFastPlayout<kOmnibusRules, 4>();
+		}
+	}
+	return new HeartsPlayout();
+}
+
+} // namespace hearts
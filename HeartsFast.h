@@ -0,0 +1,345 @@
+/*
+ *  HeartsFast.h
+ *  Hearts
+ *
+ *  Playouts specialized at compile time for one rule set and player count.
+ *  HeartsGameState tests the rules bitmask on every getMoves/ApplyMove/score
+ *  and sizes its arrays for MAXPLAYERS; here the rules are a template
+ *  argument, so the tests fold away and the state is a few flat bitboards.
+ *
+ */
+
+#include "Hearts.h"
+
+#ifndef HEARTSFAST_H
+#define HEARTSFAST_H
+
+namespace hearts {
+
+inline int bitCount(uint64_t bits)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(bits);
+#else
+	int count = 0;
+	for (; bits; bits &= bits-1)
+		count++;
+	return count;
+#endif
+}
+
+/**
+ * The play phase of a hand of Hearts, after passing. Moves are generated
+ * exactly as HeartsGameState::getMoves does, including skipping cards that
+ * are equivalent to one already generated, and allplayed follows the same
+ * convention (the card currently winning the trick is not yet in it).
+ */
+template <int Rules, int NumPlayers>
+class fastHeartsState {
+public:
+	enum {
+		kQS = (SPADES<<4)+QUEEN,
+		kJD = (DIAMONDS<<4)+JACK,
+		k2C = (CLUBS<<4)+TWO,
+		k3C = (CLUBS<<4)+THREE
+	};
+
+	void load(HeartsGameState *hgs)
+	{
+		for (int x = 0; x < NumPlayers; x++)
+		{
+			cards[x] = hgs->cards[x].getHand();
+			taken[x] = hgs->taken[x].getHand();
+		}
+		allplayed = hgs->allplayed.getHand();
+		const Trick *t = hgs->getCurrTrick();
+		curr = t->curr;
+		winner = 0;
+		for (int x = 0; x < curr; x++)
+		{
+			play[x] = t->play[x];
+			if ((Deck::getsuit(play[x]) == Deck::getsuit(play[0])) &&
+				(Deck::getrank(play[x]) < Deck::getrank(play[winner])))
+				winner = x;
+		}
+		currPlr = hgs->getNextPlayerNum();
+		leader = (curr == 0)?currPlr:t->player[0];
+		currTrick = hgs->getCurrTrickNum();
+		numTricks = hgs->numCards;
+	}
+
+	bool done() const { return currTrick == numTricks; }
+	card winningCard() const { return (curr == 0)?-1:play[winner]; }
+
+	int getMoves(card *moves) const
+	{
+		const int me = currPlr;
+		int n = 0;
+
+		if ((Rules&kLead2Clubs) && (currTrick == 0) && (curr == 0))
+		{
+			moves[0] = ((cards[me]>>k2C)&1)?(card)k2C:(card)k3C;
+			return 1;
+		}
+
+		// following in suit
+		if (((curr != 0) && (suitOf(cards[me], Deck::getsuit(play[0])))) ||
+			((Rules&kLeadClubs) && (currTrick == 0) && (curr == 0)))
+		{
+			int ledSuit = (curr == 0)?(int)CLUBS:Deck::getsuit(play[0]);
+			n = addSuit(ledSuit, specialCard(me, ledSuit), false, moves, n);
+			if (n)
+				return n;
+		}
+
+		// any card except hearts, unless broken
+		for (int y = 0; y < 4; y++)
+		{
+			if ((curr != 0) || (y != HEARTS) || (!(Rules&kMustBreakHearts)) ||
+				suitOf(allplayed, HEARTS) || ((Rules&kQueenBreaksHearts) && ((allplayed>>kQS)&1)))
+			{
+				if ((Rules&kNoHeartsFirstTrick) && (currTrick == 0) && (y == HEARTS))
+					continue;
+				n = addSuit(y, specialCard(me, y), (Rules&kNoQueenFirstTrick) && (currTrick == 0), moves, n);
+			}
+		}
+		if (n)
+			return n;
+		return addSuit(HEARTS, -1, false, moves, n);
+	}
+
+	void apply(card c)
+	{
+		card last = winningCard();
+		play[curr] = c;
+		if ((curr != 0) && (Deck::getsuit(c) == Deck::getsuit(play[0])) &&
+			(Deck::getrank(c) < Deck::getrank(play[winner])))
+			winner = curr;
+		if (play[winner] != c)
+			allplayed |= bit(c);
+		else if (last != -1)
+			allplayed |= bit(last);
+		cards[currPlr] &= ~bit(c);
+		curr++;
+
+		if (curr == NumPlayers)
+		{
+			currPlr = (leader+winner)%NumPlayers;
+			allplayed |= bit(play[winner]);
+			for (int x = 0; x < NumPlayers; x++)
+				taken[currPlr] |= bit(play[x]);
+			currTrick++;
+			curr = 0;
+			winner = 0;
+			leader = currPlr;
+		}
+		else
+			currPlr = (currPlr+1)%NumPlayers;
+	}
+
+	// Plays the hand out at once if nothing left can change a score
+	// (settleHand). False if the hand goes on.
+	bool settle()
+	{
+		if (done())
+			return false;
+		uint64_t trick = 0;
+		for (int x = 0; x < curr; x++)
+			trick |= bit(play[x]);
+		if (!settleHand(Rules, NumPlayers, cards, trick, (curr == 0)?currPlr:-1, taken, allplayed))
+			return false;
+		for (int x = 0; x < NumPlayers; x++)
+			cards[x] = 0;
+		curr = 0;
+		currTrick = numTricks;
+		return true;
+	}
+
+	// HeartsGameState::score(int)
+	double score(int who) const
+	{
+		if (!(Rules&kNoShooting) && !(Rules&kHeartsArentPoints))
+		{
+			int hearts = bitCount(suitOf(allplayed, HEARTS));
+			for (int x = 0; x < NumPlayers; x++)
+			{
+				if ((bitCount(suitOf(taken[x], HEARTS)) == hearts) &&
+					(!(Rules&kQueenPenalty) || ((taken[x]>>kQS)&1)) &&
+					(!(Rules&kShootingNeedsJack) || ((taken[who]>>kJD)&1)))
+				{
+					int jack = ((Rules&kJackBonus) && ((taken[x]>>kJD)&1))?10:0;
+					if (x == who)
+						return -jack;
+					return 13+hearts-jack;
+				}
+			}
+		}
+		int scores = 0;
+		if (!(Rules&kHeartsArentPoints))
+			scores += bitCount(suitOf(taken[who], HEARTS));
+		if (Rules&kQueenPenalty)
+			scores += 13*((taken[who]>>kQS)&1);
+		if (Rules&kJackBonus)
+			scores -= 10*((taken[who]>>kJD)&1);
+		if ((Rules&kNoTrickBonus) && (bitCount(allplayed) == 52))
+			scores -= 5*(taken[who] == 0);
+		return scores;
+	}
+
+	uint64_t cards[NumPlayers];
+	uint64_t taken[NumPlayers];
+	uint64_t allplayed;
+	card play[NumPlayers];
+	int curr, winner, leader;
+	int currPlr, currTrick, numTricks;
+private:
+	static inline uint64_t bit(card c) { return ((uint64_t)1)<<c; }
+	static inline uint32_t suitOf(uint64_t bits, int s) { return (bits>>(16*s))&0xFFFF; }
+
+	// we can't skip generation of special cards (QS/JD)
+	int specialCard(int me, int s) const
+	{
+		if ((Rules&kQueenPenalty) && (s == SPADES) && ((cards[me]>>kQS)&1))
+			return kQS;
+		if ((Rules&kJackBonus) && (s == DIAMONDS) && ((cards[me]>>kJD)&1))
+			return kJD;
+		return -1;
+	}
+
+	int addSuit(int s, int special, bool noQueen, card *moves, int n) const
+	{
+		uint32_t theSuit = suitOf(cards[currPlr], s);
+		uint32_t allSuit = suitOf(allplayed, s);
+		int c = Deck::getcard(s, 0);
+		while (theSuit)
+		{
+			if (theSuit&1)
+			{
+				if (!noQueen || (c != kQS))
+					moves[n++] = c;
+				while (((theSuit&1) || (allSuit&1)) && (c != special) && (c != special-1))
+				{ theSuit>>=1; allSuit>>=1; c++; }
+			}
+			c++;
+			theSuit>>=1;
+			allSuit>>=1;
+		}
+		return n;
+	}
+};
+
+/**
+ * HeartsPlayout on a fastHeartsState. The game state passed in is only
+ * read; states that are still passing, or whose rules don't match the
+ * template, are handed to the generic HeartsPlayout.
+ */
+template <int Rules, int NumPlayers>
+class HeartsFastPlayout : public UCTModule {
+public:
+	HeartsFastPlayout() :history(0), settleCounts(std::make_shared<playoutSettleCounts>()) {}
+	maxnval *DoRandomPlayout(GameState *gs, Player *p, double epsilon)
+	{
+		HeartsGameState *hgs = (HeartsGameState *)gs;
+		if (((hgs->getRules()&~kDoPassCards) != Rules) || ((int)hgs->getNumPlayers() != NumPlayers) ||
+			!hgs->donePassing())
+			return generic.DoRandomPlayout(gs, p, epsilon);
+
+		fastHeartsState<Rules, NumPlayers> s;
+		card moves[16];
+		s.load(hgs);
+		while (!s.done())
+		{
+			if (s.curr == 0)
+			{
+				int left = (s.numTricks-s.currTrick)*NumPlayers;
+				if (s.settle())
+				{
+					settleCounts->add(left);
+					break;
+				}
+			}
+			int n = s.getMoves(moves);
+			card c = moves[DoMinPlay(s, moves, n, epsilon)];
+			if (history)
+				history->Played(s.currPlr, c&(kMoveSlots-1));
+			s.apply(c);
+		}
+		maxnval *v = new maxnval();
+		double sum = 0;
+		for (int x = 0; x < NumPlayers; x++)
+			sum += (26-s.score(x));
+		for (int x = 0; x < NumPlayers; x++)
+			v->eval[x] = (26-s.score(x))/sum;
+		return v;
+	}
+	const char *GetModuleName() { return "HFastPlayout"; }
+	void setSeed(uint32_t seed) { rand.srand(seed); generic.setSeed(seed); }
+	UCTModule *cloneModule() const { return new HeartsFastPlayout(*this); }
+	void setHistory(UCTHistory *h) { history = h; generic.setHistory(h); }
+	// as HeartsPlayoutEngine, including the playouts handed to HeartsPlayout
+	uint64_t getSettledPlayouts() const { return settleCounts->getPlayouts()+generic.getSettledPlayouts(); }
+	uint64_t getPliesSaved() const { return settleCounts->getPlies()+generic.getPliesSaved(); }
+private:
+	// the HeartsPlayout policy; moves are visited in the order of the move
+	// list HeartsGameState::getMoves returns, which is the reverse of moves[]
+	int DoMinPlay(const fastHeartsState<Rules, NumPlayers> &s, const card *moves, int n, double epsilon)
+	{
+		if (rand.rand_double() < epsilon)
+			return rand.ranged_long(0, n-1);
+
+		card winningCard = s.winningCard();
+		int best = n-1;
+		if ((winningCard == -1) || (Deck::getsuit(winningCard) == Deck::getsuit(moves[best])))
+		{
+			if (history && history->mast)
+				return SampleMove(s.currPlr, moves, n);
+			double count = 0;
+			for (int x = n-2; x >= 0; x--)
+			{
+				count += 1;
+				if (rand.rand_double() <= 1/count)
+					best = x;
+			}
+			return best;
+		}
+		// sloughing -- high to low
+		double count = 0;
+		for (int x = n-2; x >= 0; x--)
+		{
+			count += 1;
+			if (moves[x] == fastHeartsState<Rules, NumPlayers>::kQS)
+				return x;
+			if ((rand.rand_double() <= 1/count) || (Deck::getsuit(moves[x]) == HEARTS))
+				best = x;
+		}
+		return best;
+	}
+
+	// HeartsPlayoutEngine::SampleMove over the same move order
+	int SampleMove(int who, const card *moves, int n)
+	{
+		int slots[16];
+		for (int x = 0; x < n; x++)
+			slots[x] = moves[n-1-x]&(kMoveSlots-1);
+		return n-1-history->Sample(who, slots, n, rand);
+	}
+
+	mt_random rand;
+	UCTHistory *history;
+	HeartsPlayout generic;
+	std::shared_ptr<playoutSettleCounts> settleCounts;
+};
+
+// the rule sets with a specialized playout
+const int kStandardRules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|
+	kNoHeartsFirstTrick|kNoQueenFirstTrick|kLeadClubs;
+const int kStandard2ClubsRules = (kStandardRules&~kLeadClubs)|kLead2Clubs;
+const int kOmnibusRules = kStandardRules|kJackBonus;
+
+// a specialized playout when one exists for the rules, else HeartsPlayout
+UCTModule *newHeartsPlayout(int rules, int numPlayers = 4);
+bool hasFastPlayout(int rules, int numPlayers = 4);
+
+} // namespace hearts
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ *  HeartsPass.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsPass.h"
+#include "HeartsStrength.h"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+namespace hearts {
+
+static const uint64_t one = 1;
+
+static bool morePromising(const passSet &a, const passSet &b)
+{
+	return a.value*b.samples > b.value*a.samples;
+}
+
+static bool higherHeuristic(const passSet &a, const passSet &b)
+{
+	return a.heuristic > b.heuristic;
+}
+
+HeartsPassEvaluator::HeartsPassEvaluator(int playouts, int candidates)
+{
+	numPlayouts = playouts;
+	numCandidates = candidates;
+	epsilon = 0.1;
+	useThreads = true;
+	cacheHits = cacheMisses = 0;
+}
+
+void HeartsPassEvaluator::clearCache()
+{
+	std::lock_guard<std::mutex> lock(cacheLock);
+	cache.clear();
+	cacheHits = cacheMisses = 0;
+}
+
+void HeartsPassEvaluator::selectPassCards(HeartsGameState *hgs, int who, card *pass, const CancelToken *cancel)
+{
+	selectPassCards(hgs->cards[who].getHand(), hgs->getPassDir(), hgs->getRules(), pass, cancel);
+}
+
+void HeartsPassEvaluator::selectPassCards(uint64_t hand, int passDir, int rules, card *pass, const CancelToken *cancel)
+{
+	suitPermutation suits;
+	rules &= ~kDoPassCards;
+	uint64_t canon = canonicalHand(hand, rules, suits);
+	passKey key(canon, std::make_pair(passDir, rules));
+
+	uint64_t result = 0;
+	{
+		std::lock_guard<std::mutex> lock(cacheLock);
+		std::map<passKey, uint64_t>::iterator i = cache.find(key);
+		if (i != cache.end())
+		{
+			result = i->second;
+			cacheHits++;
+		}
+		else
+			cacheMisses++;
+	}
+	if (result == 0)
+	{
+		std::vector<passSet> sets;
+		bool complete = evaluate(canon, passDir, rules, sets, cancel);
+		result = (one<<sets[0].c[0])|(one<<sets[0].c[1])|(one<<sets[0].c[2]);
+		if (complete)
+		{
+			std::lock_guard<std::mutex> lock(cacheLock);
+			if (cache.size() >= 65536)
+				cache.clear();
+			cache[key] = result;
+		}
+	}
+
+	// map the canonical cards back to the real suits
+	int next = 0;
+	for (int x = 0; x < 64; x++)
+		if ((result>>x)&1)
+			pass[next++] = suits.unmap((card)x);
+	std::sort(pass, pass+3);
+}
+
+uint64_t HeartsPassEvaluator::canonicalHand(uint64_t hand, int rules, suitPermutation &suits)
+{
+	suits.canonicalize(HeartsGameState::interchangeableSuits(rules), &hand, 1);
+	return suits.map(hand);
+}
+
+double HeartsPassEvaluator::cardDanger(const Deck &hand, card c, int rules)
+{
+	int suit = Deck::getsuit(c);
+	int rank = Deck::getrank(c);
+	int len = hand.suitCount(suit);
+	double high = (double)(TWO-rank)/TWO; // 1 for an ace down to 0 for a two
+
+	if ((rules&kQueenPenalty) && (suit == SPADES))
+	{
+		// spades below the queen are what keep the AS/KS/QS safe
+		int guards = getSpadeAnalysis(hand.getSuit(SPADES)).escapeCards;
+		if (rank == QUEEN)
+			return (guards < 3)?10:-2;
+		if (rank < QUEEN)
+			return (guards < 3)?8:1;
+		return -2;
+	}
+	double value = 3*high;
+	if ((suit == HEARTS) && !(rules&kHeartsArentPoints))
+		value = 4*high;
+	// short side suits are worth voiding
+	if ((suit != HEARTS) && (len <= 3))
+		value += 4-len;
+	return value;
+}
+
+void HeartsPassEvaluator::rankPassSets(uint64_t hand, int rules, std::vector<passSet> &sets)
+{
+	Deck d;
+	d.setHand(hand);
+	card cards[13];
+	double danger[13];
+	int n = 0;
+	for (int x = 0; (x < 64) && (n < 13); x++)
+	{
+		if (d.has(x))
+		{
+			cards[n] = x;
+			danger[n] = cardDanger(d, x, rules);
+			n++;
+		}
+	}
+	sets.resize(0);
+	for (int x = 0; x < n; x++)
+	{
+		for (int y = x+1; y < n; y++)
+		{
+			for (int z = y+1; z < n; z++)
+			{
+				passSet s;
+				s.c[0] = cards[x];
+				s.c[1] = cards[y];
+				s.c[2] = cards[z];
+				s.heuristic = danger[x]+danger[y]+danger[z];
+				s.value = 0;
+				s.samples = 0;
+				// bonus for passing a whole side suit
+				int inSet[4] = {0, 0, 0, 0};
+				for (int c = 0; c < 3; c++)
+					inSet[Deck::getsuit(s.c[c])]++;
+				for (int suit = 0; suit < 4; suit++)
+					if ((suit != HEARTS) && (inSet[suit] > 0) && (inSet[suit] == (int)d.suitCount(suit)))
+						s.heuristic += 2;
+				sets.push_back(s);
+			}
+		}
+	}
+	std::stable_sort(sets.begin(), sets.end(), higherHeuristic);
+}
+
+void HeartsPassEvaluator::heuristicPass(const Deck &hand, int rules, card *pass)
+{
+	double danger[3] = {-1000, -1000, -1000};
+	pass[0] = pass[1] = pass[2] = -1;
+	for (int x = 0; x < 64; x++)
+	{
+		if (!hand.has(x))
+			continue;
+		double d = cardDanger(hand, x, rules);
+		for (int y = 0; y < 3; y++)
+		{
+			if (d > danger[y])
+			{
+				for (int z = 2; z > y; z--)
+				{
+					danger[z] = danger[z-1];
+					pass[z] = pass[z-1];
+				}
+				danger[y] = d;
+				pass[y] = x;
+				break;
+			}
+		}
+	}
+}
+
+void HeartsPassEvaluator::getWorlds(uint64_t hand, int rules, mt_random &r, int count,
+									std::vector<passWorld> &worlds)
+{
+	card unknown[39];
+	int n = 0;
+	uint64_t deck = getFullDeck();
+	for (int x = 0; x < 64; x++)
+		if (((deck>>x)&1) && !((hand>>x)&1))
+			unknown[n++] = x;
+	assert(n == 39);
+
+	worlds.resize(count);
+	Deck opp;
+	for (int w = 0; w < count; w++)
+	{
+		passWorld &world = worlds[w];
+		for (int x = n-1; x > 0; x--)
+			std::swap(unknown[x], unknown[r.ranged_long(0, x)]);
+		world.hand[0] = hand;
+		world.hand[1] = world.hand[2] = world.hand[3] = 0;
+		for (int x = 0; x < n; x++)
+			world.hand[1+x/13] |= one<<unknown[x];
+		for (int x = 1; x < 4; x++)
+		{
+			opp.setHand(world.hand[x]);
+			heuristicPass(opp, rules, world.pass[x]);
+		}
+		world.first = r.ranged_long(0, 3);
+		world.seed = r.rand_long();
+	}
+}
+
+void HeartsPassEvaluator::playWorlds(const std::vector<passWorld> &worlds, std::vector<passSet> &sets,
+									 unsigned int count, int first, int stride, int passDir, int rules, double epsilon,
+									 const CancelToken *cancel)
+{
+	// placeholder deal; SetInitialCards replaces it for every world
+	std::vector<std::vector<card> > theCards(4);
+	for (int x = 0; x < 4; x++)
+		for (int y = 0; y < 13; y++)
+			theCards[x].push_back(Deck::getcard(x, y));
+	HeartsGameState hgs(theCards);
+	hgs.setRules(rules);
+	HeartsPlayout playout;
+
+	for (unsigned int s = first; s < count; s += stride)
+	{
+		if (cancel && cancel->isCancelled())
+			return;
+		for (unsigned int w = 0; w < worlds.size(); w++)
+		{
+			const passWorld &world = worlds[w];
+			const card *pass[4];
+			uint64_t hands[4];
+			pass[0] = sets[s].c;
+			for (int x = 1; x < 4; x++)
+				pass[x] = world.pass[x];
+			for (int x = 0; x < 4; x++)
+			{
+				hands[x] = world.hand[x];
+				for (int y = 0; y < 3; y++)
+					hands[x] &= ~(one<<pass[x][y]);
+			}
+			for (int x = 0; x < 4; x++)
+				for (int y = 0; y < 3; y++)
+					hands[(x+4+passDir)%4] |= one<<pass[x][y];
+			for (int x = 0; x < 4; x++)
+			{
+				theCards[x].resize(0);
+				for (int c = 0; c < 64; c++)
+					if ((hands[x]>>c)&1)
+						theCards[x].push_back(c);
+			}
+			hgs.SetInitialCards(theCards);
+			hgs.numCardsPassed = 0;
+			hgs.setFirstPlayer(world.first);
+			playout.setSeed(world.seed);
+			maxnval *v = playout.DoRandomPlayout(&hgs, 0, epsilon);
+			sets[s].value += v->eval[0];
+			sets[s].samples++;
+			delete v;
+		}
+	}
+}
+
+void HeartsPassEvaluator::rankPassCandidates(uint64_t hand, int passDir, int rules, std::vector<passSet> &sets)
+{
+	evaluate(hand, passDir, rules&~kDoPassCards, sets);
+}
+
+// returns false if cancelled; sets[0] is then the leader of the last full round
+bool HeartsPassEvaluator::evaluate(uint64_t hand, int passDir, int rules, std::vector<passSet> &sets,
+								   const CancelToken *cancel)
+{
+	rankPassSets(hand, rules, sets);
+	if ((numCandidates > 0) && ((int)sets.size() > numCandidates))
+		sets.resize(numCandidates);
+
+	int rounds = 0;
+	for (int n = sets.size(); n > 1; n = (n+1)/2)
+		rounds++;
+
+	// the same hand always sees the same worlds
+	mt_random r((uint32_t)(hand^(hand>>32))^((uint32_t)passDir*0x9E3779B9)^(uint32_t)rules);
+	std::vector<passWorld> worlds;
+	unsigned int alive = sets.size();
+	while (alive > 1)
+	{
+		int count = numPlayouts/(rounds*(int)alive);
+		if (count < 1)
+			count = 1;
+		getWorlds(hand, rules, r, count, worlds);
+
+		unsigned int numThreads = 1;
+		if (useThreads)
+			numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0)
+			numThreads = 1;
+		if (numThreads > alive)
+			numThreads = alive;
+
+		if (numThreads == 1)
+		{
+			playWorlds(worlds, sets, alive, 0, 1, passDir, rules, epsilon, cancel);
+		}
+		else {
+			std::vector<std::thread> threads;
+			for (unsigned int t = 0; t < numThreads; t++)
+				threads.push_back(std::thread(playWorlds, std::cref(worlds), std::ref(sets),
+											  alive, t, numThreads, passDir, rules, epsilon, cancel));
+			for (unsigned int t = 0; t < numThreads; t++)
+				threads[t].join();
+		}
+
+		// a partly played round isn't a fair comparison
+		if (cancel && cancel->isCancelled())
+			return false;
+
+		// successive halving: the better half stays at the front
+		std::stable_sort(sets.begin(), sets.begin()+alive, morePromising);
+		alive = (alive+1)/2;
+	}
+	return true;
+}
+
+} // namespace hearts
@@ -0,0 +1,97 @@
+/*
+ *  HeartsPass.h
+ *  Hearts
+ *
+ *  Monte Carlo selection of the three cards to pass. Candidate pass sets
+ *  are pruned with a per-card heuristic and the survivors are compared by
+ *  playing whole hands out in random worlds, halving the field each round.
+ *
+ */
+
+#include "Hearts.h"
+#include <vector>
+#include <map>
+#include <mutex>
+
+#ifndef HEARTSPASS_H
+#define HEARTSPASS_H
+
+namespace hearts {
+
+class passSet {
+public:
+	card c[3];
+	double heuristic;
+	double value;   // summed playout utility
+	int samples;
+};
+
+/**
+ * Chooses a pass set for a full 13-card hand in a four player game.
+ *
+ * All surviving candidates in a round are played against the same worlds
+ * (same deal, opponent passes, first player and playout seed), so the
+ * comparison between sets is not swamped by the variance of the deal.
+ * Opponents pass their three most dangerous cards by the same heuristic.
+ *
+ * Results are cached by the hand with interchangeable suits sorted into a
+ * canonical order (see HeartsGameState::interchangeableSuits). The evaluator may be
+ * shared between threads; the cache is protected by a mutex.
+ */
+class HeartsPassEvaluator {
+public:
+	HeartsPassEvaluator(int playouts = 4000, int candidates = 24);
+
+	// pass is returned in ascending card order, the order passes are played in.
+	// If cancel is set mid-search the leader so far is returned (and not cached).
+	void selectPassCards(uint64_t hand, int passDir, int rules, card *pass, const CancelToken *cancel = 0);
+	void selectPassCards(HeartsGameState *hgs, int who, card *pass, const CancelToken *cancel = 0);
+
+	void setNumPlayouts(int n) { numPlayouts = n; }
+	int getNumPlayouts() const { return numPlayouts; }
+	void setNumCandidates(int n) { numCandidates = n; }
+	int getNumCandidates() const { return numCandidates; }
+	void setEpsilon(double e) { epsilon = e; }
+	void setUseThreads(bool use) { useThreads = use; }
+
+	void clearCache();
+	int getCacheHits() const { return cacheHits; }
+	int getCacheMisses() const { return cacheMisses; }
+
+	// the candidates ordered by the search, best first; later entries were
+	// dropped in earlier rounds. Not cached and not canonicalized.
+	void rankPassCandidates(uint64_t hand, int passDir, int rules, std::vector<passSet> &sets);
+
+	// all C(13,3) sets sorted by the heuristic, best first
+	static void rankPassSets(uint64_t hand, int rules, std::vector<passSet> &sets);
+	// the hand in canonical suits; suits maps real cards to canonical ones
+	static uint64_t canonicalHand(uint64_t hand, int rules, suitPermutation &suits);
+private:
+	class passWorld {
+	public:
+		uint64_t hand[4];
+		card pass[4][3];
+		int first;
+		uint32_t seed;
+	};
+	bool evaluate(uint64_t hand, int passDir, int rules, std::vector<passSet> &sets, const CancelToken *cancel = 0);
+	void getWorlds(uint64_t hand, int rules, mt_random &r, int count, std::vector<passWorld> &worlds);
+	static void playWorlds(const std::vector<passWorld> &worlds, std::vector<passSet> &sets,
+						   unsigned int count, int first, int stride, int passDir, int rules, double epsilon,
+						   const CancelToken *cancel);
+	static double cardDanger(const Deck &hand, card c, int rules);
+	static void heuristicPass(const Deck &hand, int rules, card *pass);
+
+	int numPlayouts, numCandidates;
+	double epsilon;
+	bool useThreads;
+
+	typedef std::pair<uint64_t, std::pair<int, int> > passKey;
+	std::map<passKey, uint64_t> cache;
+	std::mutex cacheLock;
+	int cacheHits, cacheMisses;
+};
+
+} // namespace hearts
+
+#endif
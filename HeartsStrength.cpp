@@ -0,0 +1,295 @@
+/*
+ *  HeartsStrength.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsStrength.h"
+#include "HeartsFast.h"
+
+namespace hearts {
+
+enum {
+	kSuitMasks = 1<<13,
+	kQueenPlayed = 3 // spades queen position when the queen is gone
+};
+
+enum tSuitKind {
+	kPlainSuit,
+	kHeartsSuit,
+	kSpadesSuit
+};
+
+enum {
+	kControlled = 0x1,
+	kHasQueen = 0x2,
+	kProtected = 0x4,
+	kCanFlush = 0x8
+};
+
+// everything known about one suit mask, packed to keep the tables small
+class suitEntry {
+public:
+	uint8_t length;
+	uint8_t danger;
+	uint8_t control;
+	uint8_t voidPotential;
+	int8_t overall;
+	uint8_t rankSum;
+	int8_t viability;    // this suit's share of the moon viability score
+	uint8_t missingHigh;
+	uint8_t escape;
+	uint8_t flags;
+};
+
+static int clampScore(int value)
+{
+	return (value < 0)?0:((value > 100)?100:value);
+}
+
+// mask holds ranks relative to the unplayed cards of the suit: bit 0 is the
+// highest. queen is the bit of the spades queen, kQueenPlayed if it is gone.
+static void computeEntry(tSuitKind kind, int mask, int queen, suitEntry &e)
+{
+	static const int honorDanger[5] = {20, 18, 15, 10, 5};
+	static const int honorControl[3] = {25, 20, 15};
+	static const int voidPotential[7] = {100, 90, 70, 50, 25, 10, 0};
+
+	int length = bitCount(mask);
+	int aboveQueen = (queen == kQueenPlayed)?0:(mask&((1<<queen)-1));
+	bool hasQueen = (kind == kSpadesSuit) && (queen != kQueenPlayed) && ((mask>>queen)&1);
+
+	int danger = 0;
+	for (int x = 0; x < 5; x++)
+		if ((mask>>x)&1)
+			danger += honorDanger[x];
+	if (hasQueen)
+		danger += 30;
+	else if ((kind == kSpadesSuit) && aboveQueen)
+		danger -= 10;
+	if (kind == kHeartsSuit)
+		danger += 3*length;
+	if (length <= 2)
+		danger -= 15;
+	if (length >= 5)
+		danger += 10;
+
+	int control = 0;
+	if (length > 0)
+	{
+		for (int x = 0; x < 3; x++)
+			if ((mask>>x)&1)
+				control += honorControl[x];
+		control += 5*length;
+		control += 5*bitCount(mask&(mask>>1)); // adjacent ranks held
+		if (length == 1)
+			control -= 20;
+	}
+
+	int viability = 0;
+	if ((mask>>ACE)&1)
+		viability += 15;
+	if ((mask>>KING)&1)
+		viability += 10;
+	if ((mask>>QUEEN)&1)
+		viability += 5;
+	if (kind == kHeartsSuit)
+	{
+		if ((mask>>ACE)&1)
+			viability += 15;
+		if ((mask>>KING)&1)
+			viability += 10;
+		if (length >= 5)
+			viability += 15;
+		if (length >= 7)
+			viability += 10;
+	}
+	if (kind == kSpadesSuit)
+	{
+		if (hasQueen)
+			viability += 10;
+		else if (aboveQueen)
+			viability += 5;
+		if ((mask&0x7) == 0)
+			viability -= 20;
+	}
+	if (length == 0)
+		viability -= 15;
+
+	e.length = length;
+	e.danger = clampScore(danger);
+	e.control = clampScore(control);
+	e.voidPotential = voidPotential[(length < 6)?length:6];
+	e.overall = e.control-e.danger/2+e.voidPotential/4;
+	e.rankSum = 0;
+	for (int x = 0; x < 13; x++)
+		if ((mask>>x)&1)
+			e.rankSum += x;
+	e.viability = viability;
+	e.missingHigh = (length == 0)?0:(2-bitCount(mask&0x3));
+	e.escape = (kind == kSpadesSuit && queen != kQueenPlayed)?bitCount(mask>>(queen+1)):0;
+	e.flags = 0;
+	if ((mask>>ACE)&1)
+		e.flags |= kControlled;
+	if (hasQueen)
+		e.flags |= kHasQueen;
+	if (hasQueen && (length >= 4))
+		e.flags |= kProtected;
+	if (!hasQueen && aboveQueen && (length >= 3))
+		e.flags |= kCanFlush;
+}
+
+class strengthTables {
+public:
+	strengthTables();
+	suitEntry plain[kSuitMasks];
+	suitEntry hearts[kSuitMasks];
+	suitEntry spades[4][kSuitMasks]; // by the position of the queen among the unplayed spades
+	// the bits of a 7-bit mask at the set bits of a 7-bit unplayed mask, packed
+	uint8_t compress[1<<14];
+};
+
+strengthTables::strengthTables()
+{
+	for (int mask = 0; mask < kSuitMasks; mask++)
+	{
+		computeEntry(kPlainSuit, mask, kQueenPlayed, plain[mask]);
+		computeEntry(kHeartsSuit, mask, kQueenPlayed, hearts[mask]);
+		for (int queen = 0; queen < 4; queen++)
+			computeEntry(kSpadesSuit, mask, queen, spades[queen][mask]);
+	}
+	for (int unplayed = 0; unplayed < (1<<7); unplayed++)
+	{
+		for (int mask = 0; mask < (1<<7); mask++)
+		{
+			int packed = 0, next = 0;
+			for (int x = 0; x < 7; x++)
+			{
+				if ((unplayed>>x)&1)
+				{
+					packed |= ((mask>>x)&1)<<next;
+					next++;
+				}
+			}
+			compress[(unplayed<<7)|mask] = packed;
+		}
+	}
+}
+
+static const strengthTables &tables()
+{
+	static const strengthTables t;
+	return t;
+}
+
+static const suitEntry &lookup(const strengthTables &t, int suit, uint16_t mask, uint16_t played)
+{
+	mask &= 0x1FFF;
+	if (played != 0)
+	{
+		int unplayed = (~played)&0x1FFF;
+		mask &= unplayed;
+		mask = t.compress[((unplayed&0x7F)<<7)|(mask&0x7F)]|
+		       (t.compress[((unplayed>>7)<<7)|(mask>>7)]<<bitCount(unplayed&0x7F));
+		if (suit == SPADES)
+			return t.spades[((unplayed>>QUEEN)&1)?bitCount(unplayed&0x3):kQueenPlayed][mask];
+	}
+	else if (suit == SPADES)
+		return t.spades[QUEEN][mask];
+	return (suit == HEARTS)?t.hearts[mask]:t.plain[mask];
+}
+
+static void fillSuit(int suit, const suitEntry &e, SuitStrength &s)
+{
+	s.suit = suit;
+	s.length = e.length;
+	s.danger = e.danger;
+	s.control = e.control;
+	s.voidPotential = e.voidPotential;
+	s.overall = e.overall;
+	s.isProtected = (e.flags&kProtected) != 0;
+	s.canFlush = (e.flags&kCanFlush) != 0;
+}
+
+static void fillSpades(const suitEntry &e, SpadeAnalysis &s)
+{
+	s.hasQueen = (e.flags&kHasQueen) != 0;
+	s.isProtected = (e.flags&kProtected) != 0;
+	s.canSafelyFlush = (e.flags&kCanFlush) != 0;
+	s.escapeCards = e.escape;
+}
+
+HandStrength evaluateHand(const Deck &hand)
+{
+	return evaluateHand(hand, Deck());
+}
+
+HandStrength evaluateHand(const Deck &hand, const Deck &played)
+{
+	const strengthTables &t = tables();
+	const suitEntry *e[4];
+	for (int x = 0; x < 4; x++)
+		e[x] = &lookup(t, x, hand.getSuit(x), played.getSuit(x));
+
+	HandStrength h;
+	int danger = 0, control = 0, viability = 0;
+	h.voidOpportunities = 0;
+	h.moon.controlledSuits = 0;
+	h.moon.missingHighCards = 0;
+	h.bestSuitToVoid = h.bestSuitToKeep = -1;
+	for (int x = 0; x < 4; x++)
+	{
+		fillSuit(x, *e[x], h.suits[x]);
+		danger += e[x]->danger;
+		control += e[x]->control;
+		viability += e[x]->viability;
+		h.moon.controlledSuits += (e[x]->flags&kControlled)?1:0;
+		h.moon.missingHighCards += e[x]->missingHigh;
+		if (e[x]->length == 0)
+			continue;
+		if (e[x]->voidPotential > 50)
+			h.voidOpportunities++;
+		// the easiest suit to void, the more dangerous one on a tie
+		if ((h.bestSuitToVoid == -1) ||
+			(e[x]->voidPotential > e[h.bestSuitToVoid]->voidPotential) ||
+			((e[x]->voidPotential == e[h.bestSuitToVoid]->voidPotential) &&
+			 (e[x]->danger > e[h.bestSuitToVoid]->danger)))
+			h.bestSuitToVoid = x;
+		// the suit with the most control, the longer one on a tie
+		if ((h.bestSuitToKeep == -1) ||
+			(e[x]->control > e[h.bestSuitToKeep]->control) ||
+			((e[x]->control == e[h.bestSuitToKeep]->control) &&
+			 (e[x]->length > e[h.bestSuitToKeep]->length)))
+			h.bestSuitToKeep = x;
+	}
+	h.overallDanger = danger/4;
+	h.overallControl = control/4;
+	fillSpades(*e[SPADES], h.spades);
+	h.moon.viabilityScore = clampScore(viability);
+	h.moon.heartsControl = e[HEARTS]->control;
+	h.moon.shouldAttempt = (h.moon.viabilityScore >= 70) && (h.moon.controlledSuits >= 2) &&
+	                       (h.moon.heartsControl >= 50);
+	h.recommendMoonAttempt = h.moon.shouldAttempt;
+	return h;
+}
+
+SuitStrength getSuitStrength(int suit, uint16_t mask, uint16_t played)
+{
+	SuitStrength s;
+	fillSuit(suit, lookup(tables(), suit, mask, played), s);
+	return s;
+}
+
+SpadeAnalysis getSpadeAnalysis(uint16_t spades, uint16_t played)
+{
+	SpadeAnalysis s;
+	fillSpades(lookup(tables(), SPADES, spades, played), s);
+	return s;
+}
+
+int getRankSum(uint16_t mask)
+{
+	return tables().plain[mask&0x1FFF].rankSum;
+}
+
+} // namespace hearts
@@ -0,0 +1,80 @@
+/*
+ *  HeartsStrength.h
+ *  Hearts
+ *
+ *  Suit and hand strength as described in doc/SUIT_STRENGTH.md: danger,
+ *  control and void potential of each suit, queen of spades protection
+ *  and moon viability. Everything about a suit depends only on which of
+ *  its 13 ranks are held, so it is precomputed for every suit mask and a
+ *  hand is evaluated with one table load per suit.
+ *
+ */
+
+#include "Hearts.h"
+
+#ifndef HEARTSSTRENGTH_H
+#define HEARTSSTRENGTH_H
+
+namespace hearts {
+
+class SuitStrength {
+public:
+	int suit;
+	int length;        // 0-13
+	int danger;        // 0-100, how likely the suit is to take points
+	int control;       // 0-100, ability to win tricks in it when needed
+	int voidPotential; // 0-100, how easily it can be voided
+	int overall;       // control - danger/2 + voidPotential/4
+	bool isProtected;  // spades: holds the queen with 4+ spades
+	bool canFlush;     // spades: holds a spade above the queen but not the queen, 3+ spades
+};
+
+class SpadeAnalysis {
+public:
+	bool hasQueen;
+	bool isProtected;    // 4+ spades with the queen
+	bool canSafelyFlush; // a spade above the queen without it, 3+ spades
+	int escapeCards;     // spades below the queen that can duck under it
+};
+
+class MoonShootViability {
+public:
+	int viabilityScore;   // 0-100
+	bool shouldAttempt;   // viability >= 70, 2+ controlled suits, hearts control >= 50
+	int controlledSuits;  // suits headed by their highest unplayed card
+	int heartsControl;    // control of hearts, 0-100
+	int missingHighCards; // the two highest unplayed cards of held suits not held
+};
+
+class HandStrength {
+public:
+	SuitStrength suits[4];
+	int overallDanger;     // 0-100, the average over the suits
+	int overallControl;    // 0-100, the average over the suits
+	int voidOpportunities; // non-void suits with void potential over 50
+	SpadeAnalysis spades;
+	MoonShootViability moon;
+
+	int bestSuitToVoid;    // -1 for an empty hand
+	int bestSuitToKeep;    // -1 for an empty hand
+	bool recommendMoonAttempt;
+};
+
+/**
+ * With a played deck, ranks are relative to the cards still out: a suit
+ * held as the highest two unplayed cards scores as the ace and king, and
+ * spades are scored around the queen only while it is unplayed. Cards in
+ * played are assumed not to be in hand.
+ */
+HandStrength evaluateHand(const Deck &hand);
+HandStrength evaluateHand(const Deck &hand, const Deck &played);
+
+// one suit of a hand; mask is Deck::getSuit(suit) of the hand and played
+SuitStrength getSuitStrength(int suit, uint16_t mask, uint16_t played = 0);
+SpadeAnalysis getSpadeAnalysis(uint16_t spades, uint16_t played = 0);
+// sum of the rank indices of the cards in mask: 0 for the ace ... 12 for the two
+int getRankSum(uint16_t mask);
+
+} // namespace hearts
+
+#endif
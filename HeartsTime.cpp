@@ -0,0 +1,144 @@
+/*
+ *  HeartsTime.cpp
+ *  Hearts
+ *
+ */
+
+#include "HeartsTime.h"
+#include <algorithm>
+#include <cmath>
+
+namespace hearts {
+
+static const int kMinWorlds = 3;           // the least a searched decision gets
+static const double kAverageWeight = 1.0;  // assumed for the decisions still to come
+static const double kSearchedShare = 0.65; // of the plays still to come; the rest are forced
+static const double kVolatilityDecay = 0.3;
+static const double kLeaderPointsPerHand = 8.0;
+
+HeartsTimeManager::HeartsTimeManager(int handSimulations, int simulationsPerWorld)
+{
+	handSims = handSimulations;
+	simsPerWorld = std::max(1, simulationsPerWorld);
+	gameSims = gameRemaining = 0;
+	maxPoints = 100;
+	remaining = 0;
+	lastTricksLeft = 0;
+	spent = 0;
+	volatility = 0.5;
+}
+
+void HeartsTimeManager::setGameBudget(int gameSimulations, int maxp)
+{
+	gameSims = gameRemaining = gameSimulations;
+	maxPoints = maxp;
+	lastTricksLeft = 0;
+}
+
+int HeartsTimeManager::Budget(HeartsGameState *g, int who)
+{
+	int tricksLeft = g->cards[who].count();
+	if ((lastTricksLeft == 0) || (tricksLeft > lastTricksLeft))
+		StartHand(g, tricksLeft);
+	lastTricksLeft = tricksLeft;
+
+	int moves = 0;
+	Move *m = g->getMoves();
+	for (Move *t = m; t; t = t->next)
+		moves++;
+	g->freeMove(m);
+	if (moves <= 1)
+		return 0;
+
+	// the last play is always forced, so it needs nothing
+	double w = Weight(g, moves);
+	double future = kAverageWeight*kSearchedShare*std::max(0, tricksLeft-2);
+	int budget = (int)(std::max(0, remaining)*w/(w+future));
+	return std::max(budget, kMinWorlds*simsPerWorld);
+}
+
+int HeartsTimeManager::Worlds(int budget) const
+{
+	return std::max(1, budget/simsPerWorld);
+}
+
+void HeartsTimeManager::Spent(int simulations, double confidence)
+{
+	remaining -= simulations;
+	gameRemaining -= simulations;
+	spent += simulations;
+	if (confidence >= 0)
+		volatility = (1-kVolatilityDecay)*volatility + kVolatilityDecay*(1-confidence);
+}
+
+void HeartsTimeManager::StartHand(HeartsGameState *g, int tricksLeft)
+{
+	int allowance = handSims;
+	if (gameSims == 0)
+	{
+		// forced plays late in the last hand leave some over
+		if (lastTricksLeft != 0)
+			allowance += std::min(std::max(0, remaining), handSims);
+	}
+	else
+	{
+		double high = 0;
+		bool newGame = true;
+		for (unsigned int x = 0; x < g->getNumPlayers(); x++)
+		{
+			high = std::max(high, g->gameScore[x]);
+			if (g->gameScore[x] != 0)
+				newGame = false;
+		}
+		if (newGame && (tricksLeft == g->numCards))
+			gameRemaining = gameSims;
+		double handsLeft = std::max(1.0, std::ceil((maxPoints-high)/kLeaderPointsPerHand));
+		allowance = (int)(std::max(0LL, gameRemaining)/handsLeft);
+	}
+	// joined part way through: the tricks that are left get their share
+	if ((tricksLeft < g->numCards) && (g->numCards > 1))
+		allowance = (int)((long long)allowance*(tricksLeft-1)/(g->numCards-1));
+	remaining = allowance;
+}
+
+double HeartsTimeManager::Weight(HeartsGameState *g, int moves) const
+{
+	int rules = g->getRules();
+	Deck taken, gone;
+	for (unsigned int x = 0; x < g->getNumPlayers(); x++)
+	{
+		taken.addHand(&g->taken[x]);
+		gone.addHand(&g->played[x]);
+	}
+	card queen = Deck::getcard(SPADES, QUEEN);
+	card jack = Deck::getcard(DIAMONDS, JACK);
+
+	int total = 0, out = 0;
+	if (!(rules&kHeartsArentPoints))
+	{
+		total += 13;
+		out += 13-taken.suitCount(HEARTS);
+	}
+	if (rules&kQueenPenalty)
+	{
+		total += 13;
+		if (!taken.has(queen))
+			out += 13;
+	}
+	if (rules&kJackBonus)
+	{
+		total += 10;
+		if (!taken.has(jack))
+			out += 10;
+	}
+	double stakes = 0.5+((total > 0)?(double)out/total:0);
+	// hearts can't be led yet, so fewer points change hands each trick
+	bool broken = (gone.suitCount(HEARTS) > 0) || ((rules&kQueenBreaksHearts) && gone.has(queen));
+	if ((rules&kMustBreakHearts) && !broken)
+		stakes *= 0.8;
+
+	double choice = sqrt((moves-1)/2.0);
+	return choice*stakes*(0.5+volatility);
+}
+
+} // namespace hearts
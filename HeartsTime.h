@@ -0,0 +1,92 @@
+/*
+ *  HeartsTime.h
+ *  Hearts
+ *
+ *  Spreads a hand's (or a game's) simulations over its decisions instead
+ *  of searching every decision with the same number.
+ *
+ */
+
+#include "Hearts.h"
+#include "iiMonteCarlo.h"
+
+#ifndef HEARTSTIME_H
+#define HEARTSTIME_H
+
+namespace hearts {
+
+/**
+ * Sets the simulations for each play from a total for the hand or the
+ * game. Forced plays get none. Otherwise a decision is weighted by
+ *
+ *   - the number of legal moves (equivalent cards count once),
+ *   - the points still at stake: hearts, Q♠ and J♦ not yet taken, with
+ *     less at stake while hearts can't be led,
+ *   - the volatility of recent searches, one minus the share of worlds
+ *     that agreed with the combined best move,
+ *
+ * and gets its weight's share of what is left, assuming the rest of the
+ * hand's decisions are of average weight. What a hand leaves unspent, up to
+ * another hand's total, carries over to the next.
+ *
+ * A hand is noticed starting when the hand in front of the player grows;
+ * one first seen part way through gets the share of its tricks left. Not
+ * thread safe: a manager belongs to one player.
+ */
+class HeartsTimeManager {
+public:
+	HeartsTimeManager(int handSimulations, int simulationsPerWorld);
+	// takes effect from the next hand
+	void setHandBudget(int handSimulations) { handSims = handSimulations; }
+
+	// Use a total for the game instead of for each hand. Each hand gets what
+	// is left over the hands the leader's score says are still to play.
+	void setGameBudget(int gameSimulations, int maxPoints = 100);
+
+	// simulations for who's play in g, 0 when the move is forced
+	int Budget(HeartsGameState *g, int who);
+	// iiMonteCarlo worlds to spend a budget on
+	int Worlds(int budget) const;
+	// record a finished search; confidence < 0 if it wasn't observed
+	void Spent(int simulations, double confidence);
+
+	int getSimulationsPerWorld() const { return simsPerWorld; }
+	int getRemaining() const { return remaining; }
+	long long getSpent() const { return spent; }
+	double getVolatility() const { return volatility; }
+private:
+	void StartHand(HeartsGameState *g, int tricksLeft);
+	double Weight(HeartsGameState *g, int moves) const;
+
+	int handSims, simsPerWorld;
+	long long gameSims, gameRemaining;
+	int maxPoints;
+	int remaining; // for this hand
+	int lastTricksLeft;
+	long long spent;
+	double volatility;
+};
+
+/**
+ * Remembers the confidence of the last world an iiMonteCarlo search
+ * reported, passing each report on to next.
+ */
+class HeartsConfidence : public iiMonteCarloObserver {
+public:
+	HeartsConfidence(iiMonteCarloObserver *n = 0) :next(n), confidence(-1) {}
+	void WorldsDone(const Move *best, double c, int worldsDone, int numWorlds)
+	{
+		confidence = c;
+		if (next)
+			next->WorldsDone(best, c, worldsDone, numWorlds);
+	}
+	iiMonteCarloObserver *getNext() const { return next; }
+	double getConfidence() const { return confidence; }
+private:
+	iiMonteCarloObserver *next;
+	double confidence;
+};
+
+} // namespace hearts
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ *  SearchAffinity.cpp
+ *  Hearts
+ *
+ */
+
+#include "SearchAffinity.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace hearts {
+
+static std::atomic<int> affinityPolicy(kAffinityNone);
+// kAffinityCore: the core the next search starts on, modulo the node's cores
+static std::atomic<unsigned> nextCore(0);
+
+static const char *policyNames[kNumAffinities] = {"none", "node", "core"};
+
+class cpuTopology {
+public:
+	cpuTopology();
+	std::vector<std::vector<int> > nodes; // the usable cores of each node
+	std::vector<int> nodeOf;              // by core
+};
+
+#ifdef __linux__
+// "0-3,8,10-11"
+static void parseCpuList(const char *list, std::vector<int> &cpus)
+{
+	while (*list)
+	{
+		char *end;
+		long first = strtol(list, &end, 10);
+		if (end == list)
+			break;
+		long last = first;
+		if (*end == '-')
+			last = strtol(end+1, &end, 10);
+		for (long c = first; c <= last; c++)
+			cpus.push_back((int)c);
+		list = (*end == ',')?end+1:end;
+	}
+}
+#endif
+
+cpuTopology::cpuTopology()
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool haveAllowed = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+	for (int n = 0; ; n++)
+	{
+		char file[64];
+		snprintf(file, sizeof(file), "/sys/devices/system/node/node%d/cpulist", n);
+		FILE *f = fopen(file, "r");
+		if (!f)
+			break;
+		char list[1024] = "";
+		if (fgets(list, sizeof(list), f) == 0)
+			list[0] = 0;
+		fclose(f);
+
+		std::vector<int> cpus, usable;
+		parseCpuList(list, cpus);
+		for (unsigned x = 0; x < cpus.size(); x++)
+			if (cpus[x] < CPU_SETSIZE && (!haveAllowed || CPU_ISSET(cpus[x], &allowed)))
+				usable.push_back(cpus[x]);
+		if (usable.size() > 0)
+			nodes.push_back(usable);
+	}
+	if (nodes.size() == 0 && haveAllowed)
+	{
+		std::vector<int> usable;
+		for (int c = 0; c < CPU_SETSIZE; c++)
+			if (CPU_ISSET(c, &allowed))
+				usable.push_back(c);
+		if (usable.size() > 0)
+			nodes.push_back(usable);
+	}
+#endif
+	if (nodes.size() == 0)
+	{
+		std::vector<int> all;
+		unsigned cores = std::thread::hardware_concurrency();
+		for (unsigned c = 0; c < ((cores > 0)?cores:1); c++)
+			all.push_back(c);
+		nodes.push_back(all);
+	}
+	for (unsigned n = 0; n < nodes.size(); n++)
+	{
+		for (unsigned x = 0; x < nodes[n].size(); x++)
+		{
+			if (nodes[n][x] >= (int)nodeOf.size())
+				nodeOf.resize(nodes[n][x]+1, 0);
+			nodeOf[nodes[n][x]] = n;
+		}
+	}
+}
+
+static const cpuTopology &topology()
+{
+	static const cpuTopology t;
+	return t;
+}
+
+SearchAffinity::SearchAffinity(int worlds)
+{
+	policy = getPolicy();
+	node = 0;
+	firstCore = 0;
+	if (policy == kAffinityNone)
+	{
+		unsigned cores = std::thread::hardware_concurrency();
+		threads = (cores > 0)?cores:1;
+		return;
+	}
+	const cpuTopology &t = topology();
+#ifdef __linux__
+	int cpu = sched_getcpu();
+	if (cpu >= 0 && cpu < (int)t.nodeOf.size())
+		node = t.nodeOf[cpu];
+#endif
+	threads = (int)t.nodes[node].size();
+	if ((worlds > 0) && (worlds < threads))
+		threads = worlds;
+	if (policy == kAffinityCore)
+		firstCore = nextCore.fetch_add(threads)%t.nodes[node].size();
+}
+
+void SearchAffinity::Pin(int slot) const
+{
+#ifdef __linux__
+	if (policy == kAffinityNone)
+		return;
+	const std::vector<int> &cpus = topology().nodes[node];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (policy == kAffinityCore)
+		CPU_SET(cpus[(firstCore+slot)%cpus.size()], &set);
+	else
+		for (unsigned x = 0; x < cpus.size(); x++)
+			CPU_SET(cpus[x], &set);
+	// the calling thread only
+	sched_setaffinity(0, sizeof(set), &set);
+#else
+	(void)slot;
+#endif
+}
+
+void SearchAffinity::setPolicy(tSearchAffinity a)
+{
+	affinityPolicy.store(a);
+}
+
+tSearchAffinity SearchAffinity::getPolicy()
+{
+	return (tSearchAffinity)affinityPolicy.load();
+}
+
+const char *SearchAffinity::getPolicyName(tSearchAffinity a)
+{
+	return policyNames[a];
+}
+
+bool SearchAffinity::getPolicy(const char *name, tSearchAffinity &a)
+{
+	for (int x = 0; x < kNumAffinities; x++)
+	{
+		if (strcmp(name, policyNames[x]) == 0)
+		{
+			a = (tSearchAffinity)x;
+			return true;
+		}
+	}
+	return false;
+}
+
+int SearchAffinity::getNumNodes()
+{
+	return (int)topology().nodes.size();
+}
+
+int SearchAffinity::getNumCores(int node)
+{
+	return (int)topology().nodes[node].size();
+}
+
+} // namespace hearts
@@ -0,0 +1,61 @@
+/*
+ *  SearchAffinity.h
+ *  Hearts
+ *
+ *  Where the world threads of a threaded iiMonteCarlo search run. By
+ *  default they float over every core. On a machine with several NUMA
+ *  nodes a search can instead keep its worlds on the node it started on,
+ *  so the trees and playout states they allocate (on first touch, by the
+ *  thread using them) stay in that node's memory.
+ *
+ */
+
+#ifndef SEARCHAFFINITY_H
+#define SEARCHAFFINITY_H
+
+namespace hearts {
+
+enum tSearchAffinity {
+	kAffinityNone = 0, // world threads run on any core
+	kAffinityNode = 1, // a search's world threads run on the cores of one node
+	kAffinityCore = 2, // and each is pinned to one core of that node
+	kNumAffinities = 3
+};
+
+/**
+ * The placement of one search's world threads, fixed when the search
+ * starts: the node is the one the starting thread is running on. Nodes
+ * and cores come from /sys/devices/system/node, limited to the cores the
+ * process may use; elsewhere, or with one node, the whole machine is one
+ * node and only kAffinityCore changes anything.
+ */
+class SearchAffinity {
+public:
+	// for a search of the given number of worlds, 0 if not known
+	SearchAffinity(int worlds = 0);
+	// worlds to search at once: the cores of the node, or of the machine
+	int getThreads() const { return threads; }
+	int getNode() const { return node; }
+	// Called on a world thread: binds it to the node, or to a core of the
+	// node for slot < getThreads(). Slots of threads running at once should
+	// differ; searches running at once start on different cores.
+	void Pin(int slot) const;
+
+	// the policy for searches started from now on; kAffinityNone by default
+	static void setPolicy(tSearchAffinity a);
+	static tSearchAffinity getPolicy();
+	static const char *getPolicyName(tSearchAffinity a);
+	// false if name isn't "none", "node" or "core"
+	static bool getPolicy(const char *name, tSearchAffinity &a);
+	static int getNumNodes();
+	static int getNumCores(int node);
+private:
+	tSearchAffinity policy;
+	int node;
+	int threads;
+	int firstCore; // kAffinityCore: where slot 0 runs
+};
+
+} // namespace hearts
+
+#endif
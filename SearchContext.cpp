@@ -0,0 +1,32 @@
+/*
+ *  SearchContext.cpp
+ *  Hearts
+ *
+ */
+
+#include "SearchContext.h"
+
+namespace hearts {
+
+static thread_local SearchContext *installed = 0;
+
+SearchContext &SearchContext::current()
+{
+	static thread_local SearchContext threadDefault;
+	if (installed)
+		return *installed;
+	return threadDefault;
+}
+
+SearchContext::Scope::Scope(SearchContext &context)
+{
+	previous = installed;
+	installed = &context;
+}
+
+SearchContext::Scope::~Scope()
+{
+	installed = previous;
+}
+
+} // namespace hearts
@@ -0,0 +1,63 @@
+/*
+ *  SearchContext.h
+ *  Hearts
+ *
+ *  Mutable bookkeeping that used to live in globals shared by every search.
+ *  Each search (a server request, a test, a worker thread) installs its own
+ *  context with SearchContext::Scope; code that runs without one gets a
+ *  private context for its thread, so two searches never share one.
+ *
+ */
+
+#include <atomic>
+
+#ifndef SEARCHCONTEXT_H
+#define SEARCHCONTEXT_H
+
+namespace hearts {
+
+/*
+ * Set by another thread to stop a search early; searches poll it (see
+ * Algorithm::setCancelToken) and return the best answer they have so far.
+ */
+class CancelToken {
+public:
+	// also cancelled when parent is, so part of a search can be stopped alone
+	CancelToken(const CancelToken *parent = 0) :cancelled(false), parent(parent) {}
+	void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+	bool isCancelled() const
+	{ return cancelled.load(std::memory_order_relaxed) || (parent && parent->isCancelled()); }
+private:
+	CancelToken(const CancelToken &);
+	CancelToken &operator=(const CancelToken &);
+	std::atomic<bool> cancelled;
+	const CancelToken *parent;
+};
+
+class SearchContext {
+public:
+	SearchContext() :nodesCreated(0) {}
+	// debugging id for each State built during the search
+	int newNodeNum() { return nodesCreated++; }
+	int getNodesCreated() const { return nodesCreated; }
+
+	// the context installed on this thread
+	static SearchContext &current();
+
+	// installs a context on this thread for the lifetime of the scope
+	class Scope {
+	public:
+		Scope(SearchContext &context);
+		~Scope();
+	private:
+		Scope(const Scope &);
+		Scope &operator=(const Scope &);
+		SearchContext *previous;
+	};
+private:
+	int nodesCreated;
+};
+
+} // namespace hearts
+
+#endif
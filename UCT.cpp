@@ -28,8 +28,12 @@ UCT::UCT(int numRuns, double cval1, double cval2)
 	C2 = cval2;
 	epsilon = 0;
 	pm = 0;
-//	RAVE = 0;
+	ownModule = false;
+	prior = 0;
+	cPUCT = 1.0;
+	RAVE = 0;
 	HH = false;
+	ResetHistory();
 	rand.srand(time(0));
 	verboseMoves = false;
 }
@@ -44,8 +48,12 @@ UCT::UCT(int numRuns, int crossOver, double cval1, double cval2)
 	C2 = cval2;
 	epsilon = 0;
 	pm = 0;
-//	RAVE = 0;
+	ownModule = false;
+	prior = 0;
+	cPUCT = 1.0;
+	RAVE = 0;
 	HH = false;
+	ResetHistory();
 	rand.srand(time(0));
 	verboseMoves = false;
 }
@@ -60,8 +68,12 @@ UCT::UCT(int numRuns, double cval)
 	switchLimit = -1;
 	epsilon = 0;
 	pm = 0;
-//	RAVE = 0;
+	ownModule = false;
+	prior = 0;
+	cPUCT = 1.0;
+	RAVE = 0;
 	HH = false;
+	ResetHistory();
 	rand.srand(time(0));
 	verboseMoves = false;
 	//printf("%s\n", getName());
@@ -77,12 +89,33 @@ UCT::UCT(char *n, int numRuns, double cval)
 	switchLimit = -1;
 	epsilon = 0;
 	pm = 0;
-//	RAVE = 0;
+	ownModule = false;
+	prior = 0;
+	cPUCT = 1.0;
+	RAVE = 0;
 	HH = false;
+	ResetHistory();
 	rand.srand(time(0));
 	verboseMoves = false;
 }
 
+UCT::~UCT()
+{
+	if (ownModule)
+		delete pm;
+}
+
+Algorithm *UCT::clone() const
+{
+	UCT *u = new UCT(*this);
+	// modules that can't be copied are shared
+	u->pm = pm?pm->cloneModule():0;
+	u->ownModule = (u->pm != 0);
+	if (!u->pm)
+		u->pm = pm;
+	return u;
+}
+
 const char *UCT::getName()
 {
 	std::stringstream out;
@@ -99,11 +132,13 @@ const char *UCT::getName()
 		out << "_S-" << switchLimit << "_C1-" << C1 << "_C2-" << C2;
 	if (pm)
 		out << "_PM-" << pm->GetModuleName();
+	if (prior)
+		out << "_P-" << prior->GetPriorName() << "-" << cPUCT;
 	out << "_e-" << epsilon;
-//	if (RAVE > 0)
-//		out << "_RAVE-" << RAVE;
-//	if (HH)
-//		out << "_HH";
+	if (RAVE > 0)
+		out << "_RAVE-" << RAVE;
+	if (HH)
+		out << "_HH";
 
 	name = out.str();
 	return name.c_str();
@@ -152,13 +187,131 @@ double UCT::GetUCTVal(GameState *g, int parent, int child)
 			return 100+100*GetC(g, parent, child);
 		}
 	}
-	double UCTValue = tree[child].reward + GetC(g, parent, child)*sqrt(log((double)tree[parent].count)/((double)tree[child].count));
+	double value = tree[child].reward;
+	if (RAVE > 0)
+		value = GetAMAFVal(g, parent, child);
+	double UCTValue = value + GetC(g, parent, child)*sqrt(log((double)tree[parent].count)/((double)tree[child].count));
 	return UCTValue;
 }
 
+// RAVE: blend the child's value with the AMAF value of its move at the
+// parent, trusting AMAF less as the child gets real samples.
+double UCT::GetAMAFVal(GameState *g, int parent, int child)
+{
+	if (tree[parent].amaf == -1)
+		return tree[child].reward;
+	int slot = tree[parent].amaf*kMoveSlots+(g->getMoveHash(tree[child].m)&(kMoveSlots-1));
+	if (amafCount[slot] == 0)
+		return tree[child].reward;
+	double beta = sqrt(RAVE/(3.0*tree[child].count+RAVE));
+	return (1-beta)*tree[child].reward + beta*amafReward[slot];
+}
+
+void UCTHistory::Reset()
+{
+	for (unsigned int x = 0; x < MAXPLAYERS; x++)
+	{
+		for (int y = 0; y < kMoveSlots; y++)
+		{
+			value[x][y] = 0;
+			count[x][y] = 0;
+		}
+	}
+	moves.resize(0);
+}
+
+void UCTHistory::Update(int who, int slot, double v)
+{
+	if ((who < 0) || (who >= (int)MAXPLAYERS))
+		return;
+	count[who][slot]++;
+	value[who][slot] += (v-value[who][slot])/count[who][slot];
+}
+
+double UCTHistory::Value(int who, int slot) const
+{
+	if ((who < 0) || (who >= (int)MAXPLAYERS) || (count[who][slot] == 0))
+		return unseen;
+	return (value[who][slot] < 0)?0:value[who][slot];
+}
+
+int UCTHistory::Sample(int who, const int *slots, int n, mt_random &r) const
+{
+	double sum = 0;
+	for (int x = 0; x < n; x++)
+		sum += exp(Value(who, slots[x])/temperature);
+	double selection = r.rand_double()*sum;
+	for (int x = 0; x < n; x++)
+	{
+		selection -= exp(Value(who, slots[x])/temperature);
+		if (fless(selection, 0))
+			return x;
+	}
+	return n-1;
+}
+
+void UCT::ResetHistory()
+{
+	history.Reset();
+	amafReward.resize(0);
+	amafCount.resize(0);
+}
+
+// point the playout module at this search's history; each copy from
+// clone() does this with its own history when it starts searching
+void UCT::ShareHistory(GameState *g)
+{
+	history.mast = HH;
+	history.temperature = fequal(epsilon, 0)?0.1:epsilon;
+	history.unseen = 1.0/g->getNumPlayers();
+	if (pm)
+		pm->setHistory((HH || (RAVE > 0))?&history:0);
+}
+
+void UCT::UpdateHistory(GameState *g, Move *m, maxnval *result)
+{
+	history.Update(m->player, g->getMoveHash(m)&(kMoveSlots-1), result->getValue(m->player));
+}
+
+// credit every move `who` made from history.moves[from] onward to the
+// AMAF entries of node `location`
+void UCT::UpdateAMAF(int location, int who, unsigned int from, maxnval *result)
+{
+	if (tree[location].amaf == -1)
+		return;
+	double value = result->getValue(who);
+	int base = tree[location].amaf*kMoveSlots;
+	for (unsigned int x = from; x < history.moves.size(); x++)
+	{
+		if ((history.moves[x]>>8) != who)
+			continue;
+		int slot = base+(history.moves[x]&0xFF);
+		amafCount[slot]++;
+		amafReward[slot] += (value-amafReward[slot])/amafCount[slot];
+	}
+}
+
+// PUCT: the prior replaces the "try every child once" rule, so search
+// can revisit a likely move before all of its siblings are sampled.
+// Unvisited children use the mean of their visited siblings (fpu).
+double UCT::GetPUCTVal(int parent, int child, double fpu)
+{
+	double q = (tree[child].count == 0)?fpu:tree[child].reward;
+	return q + cPUCT*tree[child].prior*sqrt((double)tree[parent].count+1)/(1.0+tree[child].count);
+}
+
 void UCT::setPlayoutModule(UCTModule *m)
 {
+	if (ownModule)
+		delete pm;
 	pm = m;
+	ownModule = false;
+}
+
+void UCT::setPriorModule(UCTPrior *p, double cpuct)
+{
+	prior = p;
+	cPUCT = cpuct;
 }
 
 void UCT::setEpsilonPlayout(double v)
@@ -218,6 +371,8 @@ void UCT::Played(int p, Move *m)
 returnValue *UCT::Play(GameState *g, Player *p) // choose next move
 {
 	resetCounters(g);
+	ResetHistory();
+	ShareHistory(g);
 	who = p;
 	if (currTreeLoc == debugState)
 	{
@@ -242,6 +397,8 @@ returnValue *UCT::Play(GameState *g, Player *p) // choose next move
 			printf("%lld elapsed\n", (long long)(time(0)-start));
 			break;
 		}
+		if (searchCancelled())
+			break;
 		if (((numSamples != -1) && (loopCount >= numSamples)) ||
 			((numSamples == -1) && (getNodesExpanded() >= getSearchNodeLimit())))
 		{
@@ -253,9 +410,13 @@ returnValue *UCT::Play(GameState *g, Player *p) // choose next move
 		currentSample = loopCount++;
 		if (((loopCount%5000) == 0) && (verbose))
 			printf("Sample %d\n", loopCount);
+		history.moves.resize(0);
 		delete PlayUCTTree(g, currTreeLoc);
 		tree[currTreeLoc].count++;
 	}
+	// cancelled before the first sample expanded the root
+	if (tree[currTreeLoc].children.size() == 0)
+		ExpandChildren(g, currTreeLoc);
 	int best = 0;
 	
 	for (unsigned int y = 1; y < tree[currTreeLoc].children.size(); y++)
@@ -273,6 +434,13 @@ returnValue *UCT::Play(GameState *g, Player *p) // choose next move
 	}
 	minimaxval *rv =  new minimaxval(tree[tree[currTreeLoc].children[best]].reward,
 									 tree[tree[currTreeLoc].children[best]].m->clone(g));
+	rootHashes.resize(0);
+	rootCounts.resize(0);
+	for (unsigned int y = 0; y < tree[currTreeLoc].children.size(); y++)
+	{
+		rootHashes.push_back(g->getMoveHash(tree[tree[currTreeLoc].children[y]].m));
+		rootCounts.push_back(tree[tree[currTreeLoc].children[y]].count);
+	}
 	////PrintTreeStats();
 	FreeTree(g);
 	assert(rv->m != 0);
@@ -321,13 +489,31 @@ maxnval *UCT::PlayUCTTree(GameState *g, int location)
 		sample = true;
 	}
 
+	double fpu = 0;
+	if (prior)
+	{
+		int visited = 0;
+		for (unsigned int y = 0; y < tree[location].children.size(); y++)
+		{
+			if (tree[tree[location].children[y]].count > 0)
+			{
+				fpu += tree[tree[location].children[y]].reward;
+				visited++;
+			}
+		}
+		if (visited)
+			fpu /= visited;
+	}
+
 	int best = 0;
-	double val = GetUCTVal(g, location, tree[location].children[0]);
+	double val = prior?GetPUCTVal(location, tree[location].children[0], fpu):
+		GetUCTVal(g, location, tree[location].children[0]);
 	if ((location == debugState) && (verbose))
 		printf("At node %d value for move %d is %f\n", location, best, val);
 	for (unsigned int y = 1; y < tree[location].children.size(); y++)
 	{
-		double childVal = GetUCTVal(g, location, tree[location].children[y]);
+		double childVal = prior?GetPUCTVal(location, tree[location].children[y], fpu):
+			GetUCTVal(g, location, tree[location].children[y]);
 		if ((location == debugState) && (verbose))
 			printf("At node %d value for move %d is %f\n", location, y, childVal);
 		if (fgreater(childVal, val))
@@ -340,14 +526,27 @@ maxnval *UCT::PlayUCTTree(GameState *g, int location)
 
 	maxnval *result = 0;
 
+	unsigned int simIndex = history.moves.size();
+	if ((RAVE > 0) || (HH))
+		history.Played(tree[index].m->player, g->getMoveHash(tree[index].m)&(kMoveSlots-1));
 	ApplyMove(g, tree[index].m);
 	if (!sample)
 	{
 		result = PlayUCTTree(g, index);
 	}
 	else {
+		unsigned int playoutIndex = history.moves.size();
 		if (pm)
 			result = pm->DoRandomPlayout(g, who, epsilon);
+		if ((result != 0) && (HH))
+		{
+			// the module only recorded its moves; MAST learns from them here
+			for (unsigned int x = playoutIndex; x < history.moves.size(); x++)
+			{
+				int mover = history.moves[x]>>8;
+				history.Update(mover, history.moves[x]&0xFF, result->getValue(mover));
+			}
+		}
 		if (result == 0)
 			result = DoRandomPlayout(g);
 	}
@@ -376,15 +575,10 @@ maxnval *UCT::PlayUCTTree(GameState *g, int location)
 				   best, tree[index].count, tree[index].reward);
 	}
 
-//	if ((RAVE > 0) || (HH))
-//	{
-//		uint32_t hashv = g->getMoveHash(tree[index].m);
-//		RAVEMap[hashv].count++;
-//		RAVEMap[hashv].value += (result->getValue(g->getNextPlayerNum()) - RAVEMap[hashv].value)/RAVEMap[hashv].count;
-//
-////		tree[index].m->Print(0);
-////		printf(" STORING %f for %d\n", RAVEMap[hashv].value, g->getNextPlayerNum());
-//	}
+	if (HH)
+		UpdateHistory(g, tree[index].m, result);
+	if (RAVE > 0)
+		UpdateAMAF(location, g->getNextPlayerNum(), simIndex, result);
 	
 	return result;
 }
@@ -403,6 +597,22 @@ void UCT::ExpandChildren(GameState *g, int location)
 //			   location);
 		tree.push_back(n);
 	}
+	if (RAVE > 0)
+	{
+		tree[location].amaf = amafCount.size()/kMoveSlots;
+		amafReward.resize(amafReward.size()+kMoveSlots);
+		amafCount.resize(amafCount.size()+kMoveSlots);
+	}
+	if (prior)
+	{
+		std::vector<Move *> moves;
+		std::vector<double> p(tree[location].children.size());
+		for (unsigned int y = 0; y < tree[location].children.size(); y++)
+			moves.push_back(tree[tree[location].children[y]].m);
+		prior->GetPriors(g, moves, &p[0]);
+		for (unsigned int y = 0; y < tree[location].children.size(); y++)
+			tree[tree[location].children[y]].prior = p[y];
+	}
 }
 
 returnValue *UCT::Analyze(GameState *g, Player *p) // return eval of all moves
@@ -410,17 +620,23 @@ returnValue *UCT::Analyze(GameState *g, Player *p) // return eval of all moves
 	who = p;
 	currTreeLoc = 0;
 	FreeTree(g);
+	ResetHistory();
+	ShareHistory(g);
 	UCTNode n;
 	tree.push_back(n);
 	
-	for (int x = 0; x < numSamples; x++)
+	for (int x = 0; (x < numSamples) && !searchCancelled(); x++)
 	{
 		currentSample = x;
 		if (((x%5000) == 0) && (verbose))
 			printf("Sample %d\n", x);
+		history.moves.resize(0);
 		delete PlayUCTTree(g, currTreeLoc);
 		tree[currTreeLoc].count++;
 	}
+	// cancelled before the first sample expanded the root
+	if (tree[currTreeLoc].children.size() == 0)
+		ExpandChildren(g, currTreeLoc);
 	//int best = 0;
 	
 	minimaxval *rv=0;
@@ -439,22 +655,24 @@ returnValue *UCT::Analyze(GameState *g, Player *p) // return eval of all moves
 
 maxnval *UCT::DoRandomPlayout(GameState *g)
 {
-	static std::vector<int> distribution;
-
 	if (!g->Done())
 	{
 		if (HH)
 		{
 			Move *best = GibbsSample(g);
+			history.Played(best->player, g->getMoveHash(best)&(kMoveSlots-1));
 			ApplyMove(g, best);
 			maxnval *v = DoRandomPlayout(g);
 			UndoMove(g, best);
+			UpdateHistory(g, best, v);
 			g->freeMove(best);
 			return v;
 		}
 		else if (fequal(epsilon, 0) || (rand.rand_double() < epsilon))
 		{
 			Move *m = g->getRandomMove();
+			if (RAVE > 0)
+				history.Played(m->player, g->getMoveHash(m)&(kMoveSlots-1));
 			ApplyMove(g, m);
 			maxnval *v = DoRandomPlayout(g);
 			UndoMove(g, m);
@@ -475,6 +693,8 @@ maxnval *UCT::DoRandomPlayout(GameState *g)
 //			}
 			
 			//Move *m = getMoves(g, who); // this causes the randomization to take effect!
+			if (RAVE > 0)
+				history.Played(m->player, g->getMoveHash(m)&(kMoveSlots-1));
 			ApplyMove(g, m);
 			maxnval *v = DoRandomPlayout(g);
 			UndoMove(g, m);
@@ -487,39 +707,15 @@ maxnval *UCT::DoRandomPlayout(GameState *g)
 
 Move *UCT::GibbsSample(GameState *g)
 {
-	double T = epsilon;
 	Move *m = g->getMoves();
-	std::vector<double> values;
 	std::vector<Move *> moves;
-	double sum = 0;
+	std::vector<int> slots;
 	for (Move *t = m; t; t = t->next)
 	{
-		double val = 0;
-		uint32_t hashv = g->getMoveHash(t);
-//		if (RAVEMap.find(hashv) != RAVEMap.end())
-//			val = RAVEMap[hashv].value;
-		if (val < 0)
-			val = 0;
-
 		moves.push_back(t);
-		values.push_back(exp(val/T));
-		sum += values.back();
-	}
-	for (unsigned int x = 0; x < values.size(); x++)
-		values[x]/=sum;
-	double selection = rand.rand_double();
-	
-	for (unsigned int x = 0; x < values.size(); x++)
-	{
-		selection -= values[x];
-		if (fless(selection, 0))
-		{
-			Move *tmp = moves[x]->clone(g);
-			g->freeMove(m);
-			return tmp;
-		}
+		slots.push_back(g->getMoveHash(t)&(kMoveSlots-1));
 	}
-	Move *tmp = moves.back()->clone(g);
+	Move *tmp = moves[history.Sample(m->player, &slots[0], moves.size(), rand)]->clone(g);
 	g->freeMove(m);
 	return tmp;
 }
@@ -19,18 +19,20 @@ namespace hearts {
 class UCTNode {
 public:
 	UCTNode()
-	:m(0), reward(0), count(0), parent(-1), depth(0), children()
+	:m(0), reward(0), prior(0), count(0), parent(-1), depth(0), amaf(-1), children()
 	{}
 	UCTNode(Move *move, int par)
-	:m(move), reward(0), count(0), parent(par), depth(0), children()
+	:m(move), reward(0), prior(0), count(0), parent(par), depth(0), amaf(-1), children()
 	{}
 	~UCTNode() { children.resize(0); }
 	//UCTNode &operator=(const UCTNode&);
 	Move *m;
 	double reward;
+	double prior;
 	int count;
 	int parent;
 	int depth;
+	int amaf; // block of kMoveSlots entries in UCT::amafReward/amafCount
 	std::vector<int> children;	
 };
 
@@ -45,6 +47,35 @@ public:
 //	return *this;
 //}
 
+// moves are indexed by getMoveHash()&(kMoveSlots-1) for MAST and AMAF
+const int kMoveSlots = 64;
+
+/**
+ * The moves of the simulation in progress and the MAST value of every
+ * move for every player in this search. UCT keeps one and hands it to its
+ * playout module, which records the moves it plays and, with mast set,
+ * picks them with Sample.
+ */
+class UCTHistory {
+public:
+	UCTHistory() :mast(false), temperature(0.1), unseen(0.25) { Reset(); }
+	void Reset();
+	void Played(int who, int slot) { moves.push_back((who<<8)|slot); }
+	// fold the value a simulation ended with into who's average for slot
+	void Update(int who, int slot, double value);
+	double Value(int who, int slot) const;
+	// Gibbs sample over the values of slots[0..n-1]; returns the index
+	int Sample(int who, const int *slots, int n, mt_random &r) const;
+
+	bool mast;
+	double temperature;
+	double unseen; // value of moves without a sample yet
+	double value[MAXPLAYERS][kMoveSlots];
+	int count[MAXPLAYERS][kMoveSlots];
+	// (player<<8)|slot of every move in the current simulation
+	std::vector<uint16_t> moves;
+};
+
 class UCTModule {
 public:
 	virtual ~UCTModule() {}
@@ -53,6 +84,25 @@ public:
 	virtual void GetPreInformation(GameState *g, unsigned int who,
 								   int &experience, double &value)
 	{ experience = 0; }
+	// restart the module's random choices, for playouts that must repeat
+	// the same ones (FlatMC); modules without a generator of their own ignore it
+	virtual void setSeed(uint32_t) {}
+	// a copy for another thread, 0 if the module can't be copied
+	virtual UCTModule *cloneModule() const { return 0; }
+	// record playout moves in h and, if h->mast, choose them from it; 0 stops
+	virtual void setHistory(UCTHistory *) {}
+};
+
+/**
+ * Move priors for PUCT selection. GetPriors fills priors[i] for
+ * moves[i] (the children of the current node, in the order returned by
+ * getMoves); the values should sum to 1.
+ */
+class UCTPrior {
+public:
+	virtual ~UCTPrior() {}
+	virtual void GetPriors(GameState *g, const std::vector<Move *> &moves, double *priors) = 0;
+	virtual const char *GetPriorName() = 0;
 };
 
 class UCT : public Algorithm {
@@ -61,12 +111,17 @@ public:
 	UCT(int numRuns, int crossOver, double cval1, double cval2);
 	UCT(int numRuns = 10000, double cval = -1);
 	UCT(char *n, int numRuns = 10000, double cval = 2);
-	Algorithm *clone() const { return new UCT(*this); }
+	~UCT();
+	// the copy plays out with its own cloneModule() of the playout module,
+	// so copies can search on different threads
+	Algorithm *clone() const;
 	virtual const char *getName();// { return name; }
 	
 	void setPlayoutModule(UCTModule *m);
+	void setPriorModule(UCTPrior *p, double cpuct = 1.0);
 	void setEpsilonPlayout(double v);
 	void setUseHH(bool use) { HH = use; }
+	void setUseRAVE(int k) { RAVE = k; }
 	
 	void resetGameState() {  }
 
@@ -78,16 +133,28 @@ public:
 	maxnval *DoRandomPlayout(GameState *g);
 	maxnval *GetValue(GameState *g);
 	double GetUCTVal(GameState *g, int parent, int child);
+	double GetPUCTVal(int parent, int child, double fpu);
 	double GetC(GameState *g, int parent, int child);
 	void ExpandChildren(GameState *g, int location);
 	void FreeTree(GameState *g);
 	void PrintTreeStats();
 	void SetShowMoveStats(bool verboseMove) { verboseMoves = verboseMove; }
+	// root visit counts of the last Play(), keyed by getMoveHash
+	void GetLastRootVisits(std::vector<uint32_t> &hashes, std::vector<int> &counts) const
+	{ hashes = rootHashes; counts = rootCounts; }
 protected:
 	void PrintTreeNode(int location, int indent = 0);
 	Move *GibbsSample(GameState *g);
+	void ResetHistory();
+	void ShareHistory(GameState *g);
+	void UpdateHistory(GameState *g, Move *m, maxnval *result);
+	void UpdateAMAF(int location, int who, unsigned int from, maxnval *result);
+	double GetAMAFVal(GameState *g, int parent, int child);
 
 	UCTModule *pm;
+	bool ownModule; // pm was cloned for this copy
+	UCTPrior *prior;
+	double cPUCT;
 	mt_random rand;
 	//char name[64];
 	std::string name;
@@ -96,7 +163,15 @@ protected:
 	double C1, C2;
 	bool verboseMoves;
 	bool HH;
+	int RAVE;
+	// MAST values and the moves of the current simulation, per search
+	UCTHistory history;
+	// AMAF: per-node move statistics for RAVE
+	std::vector<double> amafReward;
+	std::vector<int> amafCount;
 	std::vector<UCTNode> tree;
+	std::vector<uint32_t> rootHashes;
+	std::vector<int> rootCounts;
 	double epsilon;
 };
 
@@ -1,15 +1,34 @@
 /**
- * Performance Benchmark: Single-threaded vs Multi-threaded iiMonteCarlo
+ * Performance Benchmarks
+ *
+ *   hearts_benchmark [threads]  Single-threaded vs multi-threaded iiMonteCarlo
+ *   hearts_benchmark eval       Full playouts vs the learned leaf evaluator
+ *   hearts_benchmark pass       UCT pass search vs the Monte Carlo pass evaluator
+ *   hearts_benchmark playout    Generic HeartsPlayout vs the rule-specialized playouts
+ *   hearts_benchmark budget     Fixed simulations per play vs HeartsTimeManager, equal compute
+ *   hearts_benchmark affinity   Concurrent threaded searches with each SearchAffinity policy
+ *   hearts_benchmark flat       UCT vs flat Monte Carlo with and without common random numbers
  */
 
 #include <iostream>
 #include <chrono>
 #include <vector>
 #include <iomanip>
+#include <cstring>
+#include <algorithm>
+#include <thread>
 
 #include "Hearts.h"
 #include "UCT.h"
+#include "FlatMC.h"
 #include "iiMonteCarlo.h"
+#include "HeartsEval.h"
+#include "HeartsFast.h"
+#include "HeartsPass.h"
+#include "HeartsTime.h"
+#include "SearchAffinity.h"
+#include <atomic>
+#include <cmath>
 
 using namespace hearts;
 
@@ -102,8 +121,611 @@ BenchmarkResult runBenchmark(int numWorlds, int simsPerWorld, int numRuns = 5)
     return result;
 }
 
+struct EvalBenchmarkResult {
+    std::string module;
+    double ms;
+    double samplesPerSec;
+};
+
+EvalBenchmarkResult runEvalBenchmark(const char *label, UCTModule *module,
+                                     int numWorlds, int simsPerWorld, int numRuns = 5)
+{
+    EvalBenchmarkResult result;
+    result.module = label;
+
+    double total = 0;
+    for (int run = 0; run < numRuns; run++)
+    {
+        int seed = 12345 + run;
+        srand(seed);
+        HeartsGameState *g = new HeartsGameState(seed);
+        HeartsCardGame game(g);
+
+        UCT *uct = new UCT(simsPerWorld, 0.4);
+        uct->setPlayoutModule(module);
+        uct->setEpsilonPlayout(0.1);
+
+        iiMonteCarlo *iimc = new iiMonteCarlo(uct, numWorlds);
+        iimc->setUseThreads(false);
+
+        SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+        player->setModelLevel(1);
+
+        game.addPlayer(player);
+        game.addPlayer(new HeartsDucker());
+        game.addPlayer(new HeartsDucker());
+        game.addPlayer(new HeartsDucker());
+
+        g->Reset();
+        g->setPassDir(kHold);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        player->Play();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        total += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    result.ms = total / numRuns;
+    result.samplesPerSec = (double)numWorlds * simsPerWorld / (result.ms / 1000.0);
+    return result;
+}
+
+int runEvalBenchmarks()
+{
+    std::cout << "========================================" << std::endl;
+    std::cout << "Leaf Evaluation Benchmark" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "10 worlds x 1000 sims, single-threaded, first move of the hand" << std::endl;
+    std::cout << std::endl;
+
+    HeartsPlayout playout;
+    HeartsLinearEval eval0(0);
+    HeartsLinearEval eval4(4);
+
+    std::vector<EvalBenchmarkResult> results;
+    results.push_back(runEvalBenchmark("HeartsPlayout", &playout, 10, 1000));
+    results.push_back(runEvalBenchmark("LinearEval (cutoff 0)", &eval0, 10, 1000));
+    results.push_back(runEvalBenchmark("LinearEval (cutoff 4)", &eval4, 10, 1000));
+
+    std::cout << std::left << std::setw(24) << "Leaf module"
+              << std::right << std::setw(12) << "Time (ms)"
+              << std::setw(16) << "Samples/sec"
+              << std::setw(12) << "Speedup" << std::endl;
+    std::cout << std::string(64, '-') << std::endl;
+    for (const auto& r : results)
+    {
+        std::cout << std::left << std::setw(24) << r.module
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.ms
+                  << std::setw(16) << r.samplesPerSec
+                  << std::setw(11) << results[0].ms / r.ms << "x" << std::endl;
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+int runPassBenchmarks(int numRuns = 3)
+{
+    std::cout << "========================================" << std::endl;
+    std::cout << "Pass Selection Benchmark" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "Three cards passed left, averaged over " << numRuns << " hands" << std::endl;
+    std::cout << std::endl;
+
+    const int rules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kNoQueenFirstTrick|
+        kNoHeartsFirstTrick|kLeadClubs|kDoPassCards;
+    HeartsPassEvaluator evaluator;
+    double searchMs = 0, coldMs = 0, cachedMs = 0;
+
+    for (int run = 0; run < numRuns; run++)
+    {
+        int seed = 12345 + run;
+        srand(seed);
+        HeartsGameState *g = new HeartsGameState(seed);
+        HeartsCardGame game(g);
+
+        // the production server configuration: 30 worlds, ~10000 simulations
+        UCT *uct = new UCT(333, 0.4);
+        uct->setPlayoutModule(new HeartsPlayout());
+        uct->setEpsilonPlayout(0.1);
+        iiMonteCarlo *iimc = new iiMonteCarlo(uct, 30);
+
+        SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+        player->setModelLevel(1);
+
+        game.addPlayer(player);
+        game.addPlayer(new HeartsDucker());
+        game.addPlayer(new HeartsDucker());
+        game.addPlayer(new HeartsDucker());
+
+        g->setRules(rules);
+        g->Reset();
+        g->setPassDir(kLeftDir);
+        g->setFirstPlayer(0);
+        uint64_t hand = g->cards[0].getHand();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int x = 0; x < 3; x++)
+        {
+            Move *m = player->Play();
+            g->ApplyMove(m);
+            g->freeMove(m);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        searchMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+        card pass[3];
+        evaluator.clearCache();
+        start = std::chrono::high_resolution_clock::now();
+        evaluator.selectPassCards(hand, kLeftDir, rules, pass);
+        end = std::chrono::high_resolution_clock::now();
+        coldMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        evaluator.selectPassCards(hand, kLeftDir, rules, pass);
+        end = std::chrono::high_resolution_clock::now();
+        cachedMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    std::cout << std::left << std::setw(28) << "Pass selection"
+              << std::right << std::setw(12) << "Time (ms)"
+              << std::setw(12) << "Speedup" << std::endl;
+    std::cout << std::string(52, '-') << std::endl;
+    const char *labels[3] = {"UCT (30 worlds x 333)", "HeartsPassEvaluator", "HeartsPassEvaluator (cached)"};
+    double ms[3] = {searchMs / numRuns, coldMs / numRuns, cachedMs / numRuns};
+    for (int x = 0; x < 3; x++)
+    {
+        std::cout << std::left << std::setw(28) << labels[x]
+                  << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << ms[x]
+                  << std::setprecision(1)
+                  << std::setw(11) << ms[0] / ms[x] << "x" << std::endl;
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+int runPlayoutBenchmarks(int numDeals = 20, int playoutsPerDeal = 2000)
+{
+    std::cout << "========================================" << std::endl;
+    std::cout << "Playout Benchmark" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << playoutsPerDeal << " playouts from the first lead of " << numDeals
+              << " deals, epsilon 0.1" << std::endl;
+    std::cout << std::endl;
+
+    const char *labels[3] = {"Standard", "Standard, 2C leads", "Omnibus (jack bonus)"};
+    int ruleSets[3] = {kStandardRules|kDoPassCards, kStandard2ClubsRules, kOmnibusRules};
+
+    std::cout << std::left << std::setw(24) << "Rules"
+              << std::right << std::setw(16) << "Generic (us)"
+              << std::setw(16) << "Fast (us)"
+              << std::setw(12) << "Speedup" << std::endl;
+    std::cout << std::string(68, '-') << std::endl;
+    for (int rs = 0; rs < 3; rs++)
+    {
+        HeartsPlayout generic;
+        UCTModule *fast = newHeartsPlayout(ruleSets[rs]);
+        UCTModule *modules[2] = {&generic, fast};
+        double us[2] = {0, 0};
+        double checksum[2] = {0, 0};
+        for (int deal = 0; deal < numDeals; deal++)
+        {
+            HeartsGameState *g = new HeartsGameState(12345 + deal);
+            HeartsCardGame game(g);
+            for (int x = 0; x < 4; x++)
+                game.addPlayer(new HeartsDucker());
+            g->setRules(ruleSets[rs]);
+            g->Reset();
+            g->setPassDir(kHold);
+            g->setFirstPlayer(0);
+
+            for (int m = 0; m < 2; m++)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int x = 0; x < playoutsPerDeal; x++)
+                {
+                    maxnval *v = modules[m]->DoRandomPlayout(g, 0, 0.1);
+                    checksum[m] += v->eval[0];
+                    delete v;
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                us[m] += std::chrono::duration<double, std::micro>(end - start).count();
+            }
+            g->deletePlayers();
+        }
+        int total = numDeals*playoutsPerDeal;
+        std::cout << std::left << std::setw(24) << labels[rs]
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(16) << us[0] / total
+                  << std::setw(16) << us[1] / total
+                  << std::setprecision(1)
+                  << std::setw(11) << us[0] / us[1] << "x" << std::endl;
+        // the two policies are the same; their mean utility should agree
+        std::cout << std::left << std::setw(24) << "  mean utility (seat 0)"
+                  << std::right << std::setprecision(4)
+                  << std::setw(16) << checksum[0] / total
+                  << std::setw(16) << checksum[1] / total << std::endl;
+        // playouts stop once the rest of the hand can't change a score
+        std::cout << std::left << std::setw(24) << "  plies saved/playout"
+                  << std::right << std::setprecision(2)
+                  << std::setw(16) << (double)generic.getPliesSaved() / total
+                  << "  (" << 100.0 * generic.getSettledPlayouts() / total << "% of playouts settled)" << std::endl;
+        delete fast;
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+SimpleHeartsPlayer *newBudgetPlayer(int worlds, int simsPerWorld)
+{
+    UCT *uct = new UCT(simsPerWorld, 0.4);
+    uct->setPlayoutModule(new HeartsPlayout());
+    uct->setEpsilonPlayout(0.1);
+    iiMonteCarlo *iimc = new iiMonteCarlo(uct, worlds);
+    iimc->setUseThreads(false);
+    SimpleHeartsPlayer *player = new SafeSimpleHeartsPlayer(iimc);
+    player->setModelLevel(2);
+    return player;
+}
+
+int runBudgetBenchmarks(int numDeals = 50, int worlds = 10, int simsPerWorld = 100)
+{
+    std::cout << "========================================" << std::endl;
+    std::cout << "Search Budget Benchmark" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << numDeals << " deals, each played twice with the seats swapped. Fixed players search" << std::endl;
+    std::cout << "every play that isn't forced with " << worlds << " worlds x " << simsPerWorld
+              << "; time managed players get" << std::endl;
+    std::cout << "the same total for the hand, averaged over the hands so far." << std::endl;
+    std::cout << std::endl;
+
+    const int rules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kNoQueenFirstTrick|
+        kNoHeartsFirstTrick|kLeadClubs;
+    const int perSearch = worlds*simsPerWorld;
+    double points[2] = {0, 0};    // fixed, managed
+    long long sims[2] = {0, 0};
+    double diffSum = 0, diffSq = 0; // managed - fixed points, per deal
+    int searches = 0, seatHands = 0;
+    // kept from hand to hand, so what one hand leaves over goes to the next
+    HeartsTimeManager *managers[2];
+    for (int x = 0; x < 2; x++)
+        managers[x] = new HeartsTimeManager(perSearch*9, simsPerWorld);
+
+    for (int deal = 0; deal < numDeals; deal++)
+    {
+        double diff = 0;
+        for (int swap = 0; swap < 2; swap++)
+        {
+            HeartsGameState *g = new HeartsGameState(12345 + deal);
+            HeartsCardGame game(g);
+            SimpleHeartsPlayer *players[4];
+            HeartsTimeManager *timers[4];
+            // searches per seat and hand by the fixed players so far, 9 to start
+            int handTotal = perSearch*((seatHands > 0)?(searches + seatHands/2)/seatHands:9);
+            for (int x = 0; x < 4; x++)
+            {
+                players[x] = newBudgetPlayer(worlds, simsPerWorld);
+                timers[x] = 0;
+                if ((x+swap)%2 == 1)
+                {
+                    timers[x] = managers[x/2];
+                    timers[x]->setHandBudget(handTotal);
+                    players[x]->setTimeManager(timers[x]);
+                }
+                game.addPlayer(players[x]);
+            }
+            g->setRules(rules);
+            g->Reset(12345 + deal);
+            g->setPassDir(kHold);
+            g->setFirstPlayer(0);
+
+            while (!g->Done())
+            {
+                int who = g->getNextPlayerNum();
+                Move *m;
+                Move *moves = g->getMoves();
+                if ((timers[who] == 0) && (moves->next == 0))
+                    m = moves->clone(g);
+                else {
+                    m = players[who]->Play();
+                    if (timers[who] == 0)
+                    {
+                        sims[0] += perSearch;
+                        searches++;
+                    }
+                }
+                g->freeMove(moves);
+                g->ApplyMove(m);
+                g->freeMove(m);
+            }
+            seatHands += 2;
+
+            for (int x = 0; x < 4; x++)
+            {
+                int side = timers[x]?1:0;
+                points[side] += g->score(x);
+                diff += side?g->score(x):-g->score(x);
+                delete players[x]->getAlgorithm();
+            }
+            g->deletePlayers();
+            delete g;
+        }
+        diffSum += diff;
+        diffSq += diff*diff;
+        std::cout << "." << std::flush;
+    }
+    std::cout << std::endl << std::endl;
+    for (int x = 0; x < 2; x++)
+    {
+        sims[1] += managers[x]->getSpent();
+        delete managers[x];
+    }
+
+    int hands = 2*numDeals*2; // per side
+    std::cout << std::left << std::setw(28) << "Player"
+              << std::right << std::setw(16) << "Points/hand"
+              << std::setw(16) << "Sims/hand" << std::endl;
+    std::cout << std::string(60, '-') << std::endl;
+    char label[64];
+    snprintf(label, sizeof(label), "Fixed (%d worlds x %d)", worlds, simsPerWorld);
+    const char *labels[2] = {label, "HeartsTimeManager"};
+    for (int side = 0; side < 2; side++)
+    {
+        std::cout << std::left << std::setw(28) << labels[side]
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(16) << points[side] / hands
+                  << std::setprecision(0)
+                  << std::setw(16) << (double)sims[side] / hands << std::endl;
+    }
+    // the difference per deal pairs the two seatings of the same cards
+    double mean = diffSum / numDeals;
+    double sd = (numDeals > 1)?sqrt(std::max(0.0, (diffSq - numDeals*mean*mean)/(numDeals-1))):0;
+    std::cout << std::endl << std::setprecision(2)
+              << "Managed - fixed, points per deal: " << mean
+              << " +/- " << sd / sqrt((double)numDeals) << " (lower is better)" << std::endl;
+    std::cout << std::endl;
+    return 0;
+}
+
+// Threaded searches from requestThreads threads at once, like concurrent
+// server requests, for the given time; returns searches per second.
+double runAffinityBenchmark(tSearchAffinity policy, int requestThreads, int worlds, int simsPerWorld,
+                            double seconds)
+{
+    SearchAffinity::setPolicy(policy);
+    std::atomic<int> done(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> requests;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < requestThreads; r++)
+    {
+        requests.emplace_back([&, r]() {
+            for (int search = 0; !stop.load(); search++)
+            {
+                int seed = 1000*r + search;
+                HeartsGameState *g = new HeartsGameState(seed);
+                HeartsCardGame game(g);
+                UCT *uct = new UCT(simsPerWorld, 0.4);
+                uct->setPlayoutModule(new HeartsPlayout());
+                iiMonteCarlo *iimc = new iiMonteCarlo(uct, worlds);
+                iimc->setUseThreads(true);
+                SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+                player->setModelLevel(1);
+                game.addPlayer(player);
+                game.addPlayer(new HeartsDucker());
+                game.addPlayer(new HeartsDucker());
+                game.addPlayer(new HeartsDucker());
+                g->Reset(seed);
+                g->setPassDir(kHold);
+
+                Move *m = player->Play();
+                g->freeMove(m);
+                done++;
+                if (std::chrono::steady_clock::now()-start > std::chrono::duration<double>(seconds))
+                    stop = true;
+            }
+        });
+    }
+    for (std::thread &t : requests)
+        t.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    SearchAffinity::setPolicy(kAffinityNone);
+    return done.load() / elapsed;
+}
+
+int runAffinityBenchmarks(double seconds = 10, int worlds = 20, int simsPerWorld = 200)
+{
+    int nodes = SearchAffinity::getNumNodes();
+    int requestThreads = std::max(2, nodes);
+    std::cout << "========================================" << std::endl;
+    std::cout << "Search Affinity Benchmark" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "Cores per node:";
+    for (int n = 0; n < nodes; n++)
+        std::cout << " " << SearchAffinity::getNumCores(n);
+    std::cout << ". " << requestThreads << " searches at a time of " << worlds << " worlds x "
+              << simsPerWorld << " sims," << std::endl;
+    std::cout << "each policy for " << seconds << " s." << std::endl;
+    std::cout << std::endl;
+
+    std::cout << std::left << std::setw(12) << "Affinity"
+              << std::right << std::setw(16) << "Searches/s"
+              << std::setw(16) << "Sims/s" << std::setw(12) << "vs none" << std::endl;
+    std::cout << std::string(56, '-') << std::endl;
+    double none = 0;
+    for (int a = 0; a < kNumAffinities; a++)
+    {
+        double rate = runAffinityBenchmark((tSearchAffinity)a, requestThreads, worlds, simsPerWorld, seconds);
+        if (a == kAffinityNone)
+            none = rate;
+        std::cout << std::left << std::setw(12) << SearchAffinity::getPolicyName((tSearchAffinity)a)
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(16) << rate
+                  << std::setprecision(0) << std::setw(16) << rate*worlds*simsPerWorld
+                  << std::setprecision(3) << std::setw(11) << ((none > 0)?rate/none:0) << "x" << std::endl;
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+int runFlatBenchmarks(int numDeals = 10, int playoutsPerMove = 40, int trials = 10)
+{
+    std::cout << "========================================" << std::endl;
+    std::cout << "Flat Monte Carlo Benchmark" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << numDeals << " deals, positions after 0, 8, 16 and 24 plies; " << trials
+              << " searches of each with " << playoutsPerMove << " playouts per legal move." << std::endl;
+    std::cout << "Regret is against a flat search with 50x the playouts, in seat utility." << std::endl;
+    std::cout << std::endl;
+
+    const char *labels[3] = {"UCT", "FlatMC", "FlatMC, CRN"};
+    double regret[3] = {0, 0, 0}, agree[3] = {0, 0, 0}, ms[3] = {0, 0, 0};
+    double spread[2] = {0, 0}; // variance of the reference best move's lead over another, flat modes
+    int searches = 0, positions = 0;
+    for (int deal = 0; deal < numDeals; deal++)
+    {
+        for (int plies = 0; plies < 32; plies += 8)
+        {
+            HeartsGameState *g = new HeartsGameState(12345 + deal);
+            HeartsCardGame game(g);
+            for (int x = 0; x < 4; x++)
+                game.addPlayer(new HeartsDucker());
+            g->setRules(kStandardRules);
+            g->Reset();
+            g->setPassDir(kHold);
+            g->setFirstPlayer(0);
+            mt_random r(deal*32+plies);
+            for (int x = 0; x < plies; x++)
+            {
+                Move *m = g->getMoves();
+                int n = 0;
+                for (Move *t = m; t; t = t->next)
+                    n++;
+                Move *pick = m;
+                for (int which = r.ranged_long(0, n-1); which > 0; which--)
+                    pick = pick->next;
+                pick = pick->clone(g);
+                g->freeMove(m);
+                g->ApplyMove(pick);
+                g->freeMove(pick);
+            }
+            Player *p = g->getPlayer(g->getNextPlayerNum());
+            std::vector<card> cards;
+            std::vector<double> reference;
+            HeartsPlayout playout;
+            Move *legal = g->getMoves();
+            int numMoves = 0;
+            for (Move *t = legal; t; t = t->next)
+                numMoves++;
+            g->freeMove(legal);
+            if (numMoves < 2)
+            {
+                g->deletePlayers();
+                continue;
+            }
+            FlatMC big(50*playoutsPerMove*numMoves);
+            big.setPlayoutModule(&playout);
+            returnValue *rv = big.Analyze(g, p);
+            int best = 0;
+            for (returnValue *t = rv; t; t = t->next)
+            {
+                cards.push_back(((CardMove *)t->m)->c);
+                reference.push_back(t->getValue(0));
+                if (reference.back() > reference[best])
+                    best = (int)reference.size()-1;
+            }
+            delete rv;
+            positions++;
+
+            UCT uct(playoutsPerMove*numMoves, 0.4);
+            uct.setPlayoutModule(&playout);
+            uct.setEpsilonPlayout(0.1);
+            FlatMC flat(playoutsPerMove*numMoves), paired(playoutsPerMove*numMoves);
+            flat.setPlayoutModule(&playout);
+            flat.setCommonRandomNumbers(false);
+            paired.setPlayoutModule(&playout);
+            Algorithm *algs[3] = {&uct, &flat, &paired};
+            for (int a = 0; a < 3; a++)
+            {
+                double sum = 0, sumSq = 0;
+                for (int t = 0; t < trials; t++)
+                {
+                    auto start = std::chrono::high_resolution_clock::now();
+                    returnValue *v = (a == 0)?algs[a]->Play(g, p):algs[a]->Analyze(g, p);
+                    auto end = std::chrono::high_resolution_clock::now();
+                    ms[a] += std::chrono::duration<double, std::milli>(end - start).count();
+                    card chosen = ((CardMove *)v->m)->c;
+                    if (a > 0)
+                    {
+                        double bestValue = v->getValue(0);
+                        double values[2] = {0, 0};
+                        for (returnValue *t = v; t; t = t->next)
+                        {
+                            if (t->getValue(0) > bestValue)
+                            {
+                                bestValue = t->getValue(0);
+                                chosen = ((CardMove *)t->m)->c;
+                            }
+                            for (int x = 0; x < 2; x++)
+                                if (((CardMove *)t->m)->c == cards[(best+x)%numMoves])
+                                    values[x] = t->getValue(0);
+                        }
+                        sum += values[0]-values[1];
+                        sumSq += (values[0]-values[1])*(values[0]-values[1]);
+                    }
+                    delete v;
+                    for (int x = 0; x < numMoves; x++)
+                        if (cards[x] == chosen)
+                            regret[a] += reference[best]-reference[x];
+                    agree[a] += (chosen == cards[best])?1:0;
+                }
+                if (a > 0)
+                    spread[a-1] += (sumSq-sum*sum/trials)/(trials-1);
+            }
+            searches += trials;
+            g->deletePlayers();
+        }
+    }
+
+    std::cout << std::left << std::setw(16) << "Search"
+              << std::right << std::setw(14) << "ms/search"
+              << std::setw(14) << "agreement"
+              << std::setw(14) << "mean regret"
+              << std::setw(16) << "diff variance" << std::endl;
+    std::cout << std::string(74, '-') << std::endl;
+    for (int a = 0; a < 3; a++)
+    {
+        std::cout << std::left << std::setw(16) << labels[a]
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << ms[a] / searches
+                  << std::setprecision(1) << std::setw(13) << 100.0 * agree[a] / searches << "%"
+                  << std::setprecision(5) << std::setw(14) << regret[a] / searches;
+        if (a > 0)
+            std::cout << std::setprecision(3) << std::scientific << std::setw(16) << spread[a-1] / positions
+                      << std::fixed;
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    if ((argc > 1) && (strcmp(argv[1], "eval") == 0))
+        return runEvalBenchmarks();
+    if ((argc > 1) && (strcmp(argv[1], "pass") == 0))
+        return runPassBenchmarks();
+    if ((argc > 1) && (strcmp(argv[1], "playout") == 0))
+        return runPlayoutBenchmarks();
+    if ((argc > 1) && (strcmp(argv[1], "budget") == 0))
+        return runBudgetBenchmarks((argc > 2)?atoi(argv[2]):50);
+    if ((argc > 1) && (strcmp(argv[1], "affinity") == 0))
+        return runAffinityBenchmarks((argc > 2)?atof(argv[2]):10);
+    if ((argc > 1) && (strcmp(argv[1], "flat") == 0))
+        return runFlatBenchmarks();
+
     unsigned int numCPU = std::thread::hardware_concurrency();
 
     std::cout << "========================================" << std::endl;
@@ -0,0 +1,264 @@
+/*
+ *  book_builder.cpp
+ *  Hearts
+ *
+ *  Offline builder for HeartsOpeningBook.
+ *
+ *  hearts_book_builder build <book> <first-seed> <deals> [rules] [sims] [searches]
+ *      deal hands by seed (as HeartsGameState::Reset does) and, for every
+ *      pass direction, record the pass of each seat (HeartsPassEvaluator)
+ *      and every decision of the first trick. A play decision is searched
+ *      <searches> times with iiMonteCarlo/UCT (<sims> simulations per
+ *      world, 20 worlds) and the book keeps how often each card was
+ *      chosen. Entries are added to <book> if it already exists.
+ *  hearts_book_builder merge <book> <book> [book ...]
+ *      combine books built by separate jobs into the first one.
+ *  hearts_book_builder dump <book>
+ *      print the entries of a book.
+ *
+ */
+
+#include "Hearts.h"
+#include "HeartsBook.h"
+#include "HeartsPass.h"
+#include "iiMonteCarlo.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace hearts;
+
+static int standardRules()
+{
+	return kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|
+		kNoQueenFirstTrick|kNoHeartsFirstTrick|kLeadClubs|kDoPassCards;
+}
+
+static Move *findMove(HeartsGameState *g, card c)
+{
+	Move *moves = g->getMoves();
+	Move *result = 0;
+	for (Move *m = moves; m; m = m->next)
+		if (((CardMove*)m)->c == c)
+			result = m->clone(g);
+	g->freeMove(moves);
+	return result;
+}
+
+static void addPass(HeartsGameState *g, HeartsPassEvaluator &pe, int rules, std::vector<bookEntry> &book)
+{
+	int me = g->getNextPlayerNum();
+	bookEntry e;
+	suitPermutation suits;
+	HeartsOpeningBook::getPassKey(g->cards[me].getHand(), g->getPassDir(), rules, e, suits);
+
+	std::vector<passSet> sets;
+	pe.rankPassCandidates(e.hand, g->getPassDir(), rules, sets);
+	e.numMoves = 0;
+	for (unsigned int x = 0; (x < sets.size()) && (x < kBookMoves); x++)
+	{
+		bookMove &bm = e.moves[e.numMoves++];
+		for (int y = 0; y < 3; y++)
+			bm.c[y] = sets[x].c[y];
+		bm.pad = 0;
+		bm.weight = (sets[x].samples > 0)?sets[x].value/sets[x].samples:0;
+	}
+	book.push_back(e);
+
+	card pass[3];
+	for (int y = 0; y < 3; y++)
+		pass[y] = suits.unmap(sets[0].c[y]);
+	std::sort(pass, pass+3);
+	for (int y = 0; y < 3; y++)
+	{
+		Move *m = findMove(g, pass[y]);
+		g->ApplyMove(m);
+		g->freeMove(m);
+	}
+}
+
+static void addPlay(HeartsGameState *g, int searches, std::vector<bookEntry> &book)
+{
+	int me = g->getNextPlayerNum();
+	bookEntry e;
+	suitPermutation suits;
+	HeartsOpeningBook::getPlayKey(g, me, e, suits);
+
+	int counts[64];
+	memset(counts, 0, sizeof(counts));
+	for (int x = 0; x < searches; x++)
+	{
+		Move *m = g->getNextPlayer()->Play();
+		counts[((CardMove*)m)->c]++;
+		g->freeMove(m);
+	}
+
+	card best = -1;
+	e.numMoves = 0;
+	while (e.numMoves < kBookMoves)
+	{
+		card next = -1;
+		for (int c = 0; c < 64; c++)
+			if ((counts[c] > 0) && ((next == -1) || (counts[c] > counts[next])))
+				next = c;
+		if (next == -1)
+			break;
+		if (best == -1)
+			best = next;
+		bookMove &bm = e.moves[e.numMoves++];
+		bm.c[0] = suits.map(next);
+		bm.c[1] = bm.c[2] = 0xFF;
+		bm.pad = 0;
+		bm.weight = (float)counts[next]/searches;
+		counts[next] = 0;
+	}
+	book.push_back(e);
+
+	Move *m = findMove(g, best);
+	g->ApplyMove(m);
+	g->freeMove(m);
+}
+
+void Build(const char *bookFile, int firstSeed, int deals, int rules, int sims, int searches)
+{
+	std::vector<bookEntry> book;
+	if (HeartsOpeningBook::read(bookFile, book))
+		printf("%d entries loaded from %s\n", (int)book.size(), bookFile);
+
+	UCT *uct = new UCT(sims, 0.4);
+	uct->setPlayoutModule(new HeartsPlayout());
+	uct->setEpsilonPlayout(0.1);
+	iiMonteCarlo *iimc = new iiMonteCarlo(uct, 20);
+	HeartsPassEvaluator pe(20000, 32);
+
+	HeartsGameState *g = new HeartsGameState(firstSeed);
+	HeartsCardGame game(g);
+	for (int x = 0; x < 4; x++)
+	{
+		SimpleHeartsPlayer *p = new SimpleHeartsPlayer(iimc);
+		p->setModelLevel(2);
+		game.addPlayer(p);
+	}
+	g->setRules(rules);
+
+	int dirs[4] = {kLeftDir, kRightDir, kAcrossDir, kHold};
+	for (int d = 0; d < deals; d++)
+	{
+		for (int x = 0; x < 4; x++)
+		{
+			if ((dirs[x] != kHold) && !(rules&kDoPassCards))
+				continue;
+			g->Reset(firstSeed+d);
+			g->setPassDir(dirs[x]);
+			g->setFirstPlayer(0);
+			while (!g->donePassing())
+				addPass(g, pe, rules, book);
+			while (g->getCurrTrickNum() == 0)
+			{
+				Move *legal = g->getMoves();
+				if (legal->next)
+				{
+					g->freeMove(legal);
+					addPlay(g, searches, book);
+				}
+				else {
+					Move *m = legal->clone(g);
+					g->freeMove(legal);
+					g->ApplyMove(m);
+					g->freeMove(m);
+				}
+			}
+		}
+		printf("%d deals done, %d entries\n", d+1, (int)book.size());
+		fflush(stdout);
+	}
+	if (!HeartsOpeningBook::write(bookFile, book))
+	{
+		printf("Unable to write %s\n", bookFile);
+		exit(1);
+	}
+	g->deletePlayers();
+	delete iimc;
+}
+
+void Merge(const char *bookFile, int numBooks, char **books)
+{
+	std::vector<bookEntry> book;
+	HeartsOpeningBook::read(bookFile, book);
+	for (int x = 0; x < numBooks; x++)
+	{
+		if (!HeartsOpeningBook::read(books[x], book))
+		{
+			printf("Error reading %s\n", books[x]);
+			exit(1);
+		}
+	}
+	if (!HeartsOpeningBook::write(bookFile, book))
+	{
+		printf("Unable to write %s\n", bookFile);
+		exit(1);
+	}
+	printf("%d entries written to %s\n", (int)book.size(), bookFile);
+}
+
+void Dump(const char *bookFile)
+{
+	std::vector<bookEntry> book;
+	if (!HeartsOpeningBook::read(bookFile, book))
+	{
+		printf("Error reading %s\n", bookFile);
+		exit(1);
+	}
+	for (unsigned int x = 0; x < book.size(); x++)
+	{
+		const bookEntry &e = book[x];
+		printf("%s dir %d rules 0x%X hand:", (e.kind == kBookPass)?"pass":"play", e.passDir, e.rules);
+		for (int c = 0; c < 64; c++)
+			if ((e.hand>>c)&1)
+			{ printf(" "); PrintCard(c); }
+		if (e.kind == kBookPlay)
+		{
+			printf(" trick:");
+			for (int y = 0; (y < 3) && (e.trick[y] != 0xFF); y++)
+			{ printf(" "); PrintCard(e.trick[y]); }
+		}
+		printf("\n");
+		for (int y = 0; y < e.numMoves; y++)
+		{
+			printf("    %f", e.moves[y].weight);
+			for (int z = 0; (z < 3) && (e.moves[y].c[z] != 0xFF); z++)
+			{ printf(" "); PrintCard(e.moves[y].c[z]); }
+			printf("\n");
+		}
+	}
+	printf("%d entries\n", (int)book.size());
+}
+
+int main(int argc, char **argv)
+{
+	if ((argc >= 5) && (strcmp(argv[1], "build") == 0))
+	{
+		Build(argv[2], atoi(argv[3]), atoi(argv[4]),
+			  (argc > 5)?atoi(argv[5]):standardRules(),
+			  (argc > 6)?atoi(argv[6]):250,
+			  (argc > 7)?atoi(argv[7]):8);
+		return 0;
+	}
+	if ((argc >= 4) && (strcmp(argv[1], "merge") == 0))
+	{
+		Merge(argv[2], argc-3, &argv[3]);
+		return 0;
+	}
+	if ((argc == 3) && (strcmp(argv[1], "dump") == 0))
+	{
+		Dump(argv[2]);
+		return 0;
+	}
+	printf("Usage: %s build <book> <first-seed> <deals> [rules] [sims] [searches]\n", argv[0]);
+	printf("       %s merge <book> <book> [book ...]\n", argv[0]);
+	printf("       %s dump <book>\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,157 @@
+/*
+ *  calibrate.cpp
+ *  Hearts
+ *
+ *  Measures the difficulty presets of HeartsDifficulty.h.
+ *
+ *  hearts_calibrate [deals] [reference]
+ *      plays each difficulty at two seats against the <reference>
+ *      difficulty (default hard) at the other two. Each of <deals> deals
+ *      (default 10) is played twice with the seats swapped, without
+ *      passing. Reports the points per hand of both sides and the CPU time
+ *      of the difficulty's decisions that aren't forced (forced plays are
+ *      made without asking the player, as hearts_server does). Searches
+ *      run single threaded, so the CPU time is the time on one core.
+ *
+ */
+
+#include "Hearts.h"
+#include "HeartsDifficulty.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+using namespace hearts;
+
+class tierResult {
+public:
+	double points[2];  // tier, reference: per hand and seat
+	double margin, error; // tier - reference, per deal
+	double cpuMs;      // per decision of the tier
+	int decisions;
+};
+
+static void deletePlayer(Player *p)
+{
+	delete p->getAlgorithm();
+}
+
+tierResult Calibrate(tHeartsDifficulty tier, tHeartsDifficulty reference, int deals)
+{
+	const int rules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kNoQueenFirstTrick|
+		kNoHeartsFirstTrick|kLeadClubs;
+	tierResult r;
+	double points[2] = {0, 0};
+	double diffSum = 0, diffSq = 0;
+	clock_t cpu = 0;
+	r.decisions = 0;
+
+	for (int deal = 0; deal < deals; deal++)
+	{
+		double diff = 0;
+		for (int swap = 0; swap < 2; swap++)
+		{
+			HeartsGameState *g = new HeartsGameState(1000 + deal);
+			HeartsCardGame game(g);
+			bool isTier[4];
+			for (int x = 0; x < 4; x++)
+			{
+				isTier[x] = ((x+swap)%2 == 0);
+				game.addPlayer(newDifficultyPlayer(isTier[x]?tier:reference, rules));
+			}
+			g->setRules(rules);
+			g->Reset(1000 + deal);
+			g->setPassDir(kHold);
+			g->setFirstPlayer(0);
+
+			while (!g->Done())
+			{
+				int who = g->getNextPlayerNum();
+				Move *moves = g->getMoves();
+				Move *m;
+				if (moves->next == 0)
+					m = moves->clone(g);
+				else {
+					clock_t start = clock();
+					m = g->getPlayer(who)->Play();
+					if (isTier[who])
+					{
+						cpu += clock()-start;
+						r.decisions++;
+					}
+				}
+				g->freeMove(moves);
+				g->ApplyMove(m);
+				g->freeMove(m);
+			}
+
+			for (int x = 0; x < 4; x++)
+			{
+				points[isTier[x]?0:1] += g->score(x);
+				diff += isTier[x]?g->score(x):-g->score(x);
+				deletePlayer(g->getPlayer(x));
+			}
+			g->deletePlayers();
+			delete g;
+		}
+		diffSum += diff;
+		diffSq += diff*diff;
+		printf(".");
+		fflush(stdout);
+	}
+	printf("\n");
+
+	int hands = 2*deals*2; // per side
+	r.points[0] = points[0]/hands;
+	r.points[1] = points[1]/hands;
+	r.margin = diffSum/deals;
+	r.error = (deals > 1)?sqrt(std::max(0.0, (diffSq-deals*r.margin*r.margin)/(deals-1))/deals):0;
+	r.cpuMs = (r.decisions > 0)?1000.0*cpu/CLOCKS_PER_SEC/r.decisions:0;
+	return r;
+}
+
+int main(int argc, char **argv)
+{
+	int deals = (argc > 1)?atoi(argv[1]):10;
+	tHeartsDifficulty reference = kDifficultyHard;
+	if ((argc > 2) && !getDifficulty(argv[2], reference))
+	{
+		printf("Usage: %s [deals] [easy|medium|hard]\n", argv[0]);
+		return 1;
+	}
+	if (deals < 1)
+		deals = 1;
+
+	printf("Calibrating against %s, %d deals played twice\n", getDifficultyPreset(reference).name, deals);
+	tierResult results[kNumDifficulties];
+	for (int x = 0; x < kNumDifficulties; x++)
+	{
+		printf("%-8s", getDifficultyPreset((tHeartsDifficulty)x).name);
+		results[x] = Calibrate((tHeartsDifficulty)x, reference, deals);
+	}
+
+	printf("\n%-8s %-18s %10s %10s %16s %12s %12s\n", "Tier", "Search", "Points", "Reference",
+		   "Margin/deal", "CPU ms", "Decisions/s");
+	for (int x = 0; x < kNumDifficulties; x++)
+	{
+		const HeartsDifficultyPreset &p = getDifficultyPreset((tHeartsDifficulty)x);
+		const tierResult &r = results[x];
+		char search[32];
+		if (p.worlds == 0)
+			snprintf(search, sizeof(search), "none");
+		else if (p.evalCutoff >= 0)
+			snprintf(search, sizeof(search), "%dx%d eval %d", p.worlds, p.simsPerWorld, p.evalCutoff);
+		else
+			snprintf(search, sizeof(search), "%dx%d", p.worlds, p.simsPerWorld);
+		printf("%-8s %-18s %10.2f %10.2f %9.2f +/-%4.1f %12.3f %12.0f\n", p.name, search,
+			   r.points[0], r.points[1], r.margin, r.error, r.cpuMs,
+			   (r.cpuMs > 0)?1000.0/r.cpuMs:0.0);
+	}
+	printf("\nPoints are per hand and seat (lower is better); the margin is the tier's\n");
+	printf("points less the reference's over both seatings of a deal. Decisions/s is\n");
+	printf("per core.\n");
+	return 0;
+}
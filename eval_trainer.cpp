@@ -0,0 +1,335 @@
+/*
+ *  eval_trainer.cpp
+ *  Hearts
+ *
+ *  Offline trainer for HeartsLinearEval and HeartsMovePrior.
+ *
+ *  hearts_eval_trainer selfplay <hands> <log> [seed]
+ *      play hands with the HeartsPlayout policy and append one line per
+ *      (position, player) to the log: the final hand score followed by
+ *      the feature vector at that position.
+ *  hearts_eval_trainer fit <weights> <log> [log ...]
+ *      fit the linear model to the logs and write the weights file that
+ *      HeartsLinearEval::load() reads.
+ *  hearts_eval_trainer prior-selfplay <hands> <log> [sims] [seed]
+ *      play hands where every decision is a UCT search (HeartsPlayout
+ *      leaves) and log the prior features and root visit count of
+ *      each legal move.
+ *  hearts_eval_trainer prior-fit <weights> <log> [log ...]
+ *      fit HeartsMovePrior to the visit distributions.
+ *
+ */
+
+#include "Hearts.h"
+#include "HeartsEval.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+using namespace hearts;
+
+static int standardRules()
+{
+	return kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|
+		kNoQueenFirstTrick|kNoHeartsFirstTrick|kLeadClubs;
+}
+
+void SelfPlay(int hands, const char *logFile, int seed)
+{
+	FILE *f = fopen(logFile, "a");
+	if (!f)
+	{
+		printf("Unable to open %s\n", logFile);
+		exit(1);
+	}
+	HeartsGameState *g = new HeartsGameState(seed);
+	HeartsCardGame game(g);
+	for (int x = 0; x < 4; x++)
+		game.addPlayer(new HeartsDucker());
+	g->setRules(standardRules());
+
+	HeartsPlayout policy;
+	std::vector<float> features;
+	std::vector<int> owner;
+	std::vector<Move *> moves;
+	float fv[kNumEvalFeatures];
+	for (int h = 0; h < hands; h++)
+	{
+		g->Reset(seed+h);
+		g->setPassDir(kHold);
+		g->setFirstPlayer(0);
+		features.resize(0);
+		owner.resize(0);
+		while (!g->Done())
+		{
+			for (unsigned int x = 0; x < g->getNumPlayers(); x++)
+			{
+				HeartsLinearEval::getFeatures(g, x, fv);
+				features.insert(features.end(), fv, fv+kNumEvalFeatures);
+				owner.push_back(x);
+			}
+			moves.push_back(policy.DoMinPlay(g, false, 0.1));
+			g->ApplyMove(moves.back());
+		}
+		for (unsigned int s = 0; s < owner.size(); s++)
+		{
+			fprintf(f, "%d", (int)g->score(owner[s]));
+			for (int x = 0; x < kNumEvalFeatures; x++)
+				fprintf(f, " %g", features[s*kNumEvalFeatures+x]);
+			fprintf(f, "\n");
+		}
+		while (moves.size() > 0)
+		{
+			g->freeMove(moves.back());
+			moves.pop_back();
+		}
+		if (((h+1)%1000) == 0)
+			printf("%d hands played\n", h+1);
+	}
+	fclose(f);
+	g->deletePlayers();
+}
+
+bool ReadLog(const char *logFile, std::vector<float> &features, std::vector<float> &scores)
+{
+	FILE *f = fopen(logFile, "r");
+	if (!f)
+		return false;
+	float score;
+	float fv[kNumEvalFeatures];
+	while (fscanf(f, "%f", &score) == 1)
+	{
+		for (int x = 0; x < kNumEvalFeatures; x++)
+		{
+			if (fscanf(f, "%f", &fv[x]) != 1)
+			{
+				fclose(f);
+				return false;
+			}
+		}
+		scores.push_back(score);
+		features.insert(features.end(), fv, fv+kNumEvalFeatures);
+	}
+	fclose(f);
+	return true;
+}
+
+void Fit(const char *weightFile, int numLogs, char **logs)
+{
+	std::vector<float> features, scores;
+	for (int x = 0; x < numLogs; x++)
+	{
+		if (!ReadLog(logs[x], features, scores))
+		{
+			printf("Error reading %s\n", logs[x]);
+			exit(1);
+		}
+	}
+	printf("%d samples loaded\n", (int)scores.size());
+	if (scores.size() == 0)
+		exit(1);
+
+	float w[kNumEvalFeatures];
+	HeartsLinearEval::fit(features, scores, w);
+
+	double sse = 0;
+	for (unsigned int s = 0; s < scores.size(); s++)
+	{
+		double pred = 0;
+		for (int x = 0; x < kNumEvalFeatures; x++)
+			pred += w[x]*features[s*kNumEvalFeatures+x];
+		sse += (pred-scores[s])*(pred-scores[s]);
+	}
+	printf("RMSE: %f\n", sqrt(sse/scores.size()));
+	for (int x = 0; x < kNumEvalFeatures; x++)
+		printf("w[%d] = %f\n", x, w[x]);
+
+	HeartsLinearEval eval;
+	eval.setWeights(w);
+	if (!eval.save(weightFile))
+	{
+		printf("Unable to write %s\n", weightFile);
+		exit(1);
+	}
+}
+
+void PriorSelfPlay(int hands, const char *logFile, int sims, int seed)
+{
+	FILE *f = fopen(logFile, "a");
+	if (!f)
+	{
+		printf("Unable to open %s\n", logFile);
+		exit(1);
+	}
+	UCT uct(sims, 0.4);
+	HeartsPlayout playout;
+	uct.setPlayoutModule(&playout);
+	uct.setEpsilonPlayout(0.1);
+	HeartsMovePrior prior;
+
+	// the players only supply cutoffEval for terminal nodes in the tree
+	HeartsGameState *g = new HeartsGameState(seed);
+	HeartsCardGame game(g);
+	for (int x = 0; x < 4; x++)
+		game.addPlayer(new SimpleHeartsPlayer(&uct));
+	g->setRules(standardRules());
+
+	std::vector<Move *> moves;
+	std::vector<uint32_t> hashes;
+	std::vector<int> counts;
+	float fv[kNumPriorFeatures];
+	int positions = 0;
+	for (int h = 0; h < hands; h++)
+	{
+		g->Reset(seed+h);
+		g->setPassDir(kHold);
+		g->setFirstPlayer(0);
+		while (!g->Done())
+		{
+			Move *legal = g->getMoves();
+			if (legal->next)
+			{
+				returnValue *rv = uct.Play(g, g->getNextPlayer());
+				uct.GetLastRootVisits(hashes, counts);
+				fprintf(f, "%d\n", (int)hashes.size());
+				for (Move *m = legal; m; m = m->next)
+				{
+					int visits = 0;
+					for (unsigned int y = 0; y < hashes.size(); y++)
+						if (hashes[y] == g->getMoveHash(m))
+							visits = counts[y];
+					prior.getFeatures(g, m, fv);
+					fprintf(f, "%d", visits);
+					for (int x = 0; x < kNumPriorFeatures; x++)
+						fprintf(f, " %g", fv[x]);
+					fprintf(f, "\n");
+				}
+				positions++;
+				moves.push_back(rv->m);
+				rv->m = 0;
+				delete rv;
+			}
+			else {
+				moves.push_back(legal->clone(g));
+			}
+			g->freeMove(legal);
+			g->ApplyMove(moves.back());
+		}
+		while (moves.size() > 0)
+		{
+			g->freeMove(moves.back());
+			moves.pop_back();
+		}
+		if (((h+1)%10) == 0)
+			printf("%d hands played, %d positions\n", h+1, positions);
+	}
+	fclose(f);
+	g->deletePlayers();
+}
+
+bool ReadPriorLog(const char *logFile, std::vector<float> &features,
+				  std::vector<float> &targets, std::vector<int> &groupSize)
+{
+	FILE *f = fopen(logFile, "r");
+	if (!f)
+		return false;
+	int n;
+	float fv[kNumPriorFeatures];
+	std::vector<float> visits;
+	while (fscanf(f, "%d", &n) == 1)
+	{
+		visits.resize(n);
+		float total = 0;
+		for (int y = 0; y < n; y++)
+		{
+			if (fscanf(f, "%f", &visits[y]) != 1)
+			{
+				fclose(f);
+				return false;
+			}
+			total += visits[y];
+			for (int x = 0; x < kNumPriorFeatures; x++)
+			{
+				if (fscanf(f, "%f", &fv[x]) != 1)
+				{
+					fclose(f);
+					return false;
+				}
+			}
+			features.insert(features.end(), fv, fv+kNumPriorFeatures);
+		}
+		for (int y = 0; y < n; y++)
+			targets.push_back((total > 0)?visits[y]/total:1.0f/n);
+		groupSize.push_back(n);
+	}
+	fclose(f);
+	return true;
+}
+
+void PriorFit(const char *weightFile, int numLogs, char **logs)
+{
+	std::vector<float> features, targets;
+	std::vector<int> groupSize;
+	for (int x = 0; x < numLogs; x++)
+	{
+		if (!ReadPriorLog(logs[x], features, targets, groupSize))
+		{
+			printf("Error reading %s\n", logs[x]);
+			exit(1);
+		}
+	}
+	printf("%d positions loaded\n", (int)groupSize.size());
+	if (groupSize.size() == 0)
+		exit(1);
+
+	HeartsMovePrior prior;
+	float w[kNumPriorFeatures];
+	for (int x = 0; x < kNumPriorFeatures; x++)
+		w[x] = prior.getWeights()[x];
+	printf("Initial cross-entropy: %f\n", HeartsMovePrior::fit(features, targets, groupSize, w, 1));
+	for (int x = 0; x < kNumPriorFeatures; x++)
+		w[x] = prior.getWeights()[x];
+	printf("Final cross-entropy: %f\n", HeartsMovePrior::fit(features, targets, groupSize, w, 1000));
+	for (int x = 0; x < kNumPriorFeatures; x++)
+		printf("w[%d] = %f\n", x, w[x]);
+
+	prior.setWeights(w);
+	if (!prior.save(weightFile))
+	{
+		printf("Unable to write %s\n", weightFile);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if ((argc >= 4) && (strcmp(argv[1], "selfplay") == 0))
+	{
+		SelfPlay(atoi(argv[2]), argv[3], (argc > 4)?atoi(argv[4]):1);
+		return 0;
+	}
+	if ((argc >= 4) && (strcmp(argv[1], "fit") == 0))
+	{
+		Fit(argv[2], argc-3, &argv[3]);
+		return 0;
+	}
+	if ((argc >= 4) && (strcmp(argv[1], "prior-selfplay") == 0))
+	{
+		PriorSelfPlay(atoi(argv[2]), argv[3], (argc > 4)?atoi(argv[4]):333,
+					  (argc > 5)?atoi(argv[5]):1);
+		return 0;
+	}
+	if ((argc >= 4) && (strcmp(argv[1], "prior-fit") == 0))
+	{
+		PriorFit(argv[2], argc-3, &argv[3]);
+		return 0;
+	}
+	printf("Usage: %s selfplay <hands> <log> [seed]\n", argv[0]);
+	printf("       %s fit <weights> <log> [log ...]\n", argv[0]);
+	printf("       %s prior-selfplay <hands> <log> [sims] [seed]\n", argv[0]);
+	printf("       %s prior-fit <weights> <log> [log ...]\n", argv[0]);
+	return 1;
+}
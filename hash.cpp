@@ -4,16 +4,15 @@
 #include <iostream>
 #include <math.h>
 #include "hash.h"
+#include "SearchContext.h"
 
 using namespace std;
 namespace hearts {
 
-int creationCounter;
-
 State::State()
 {
 	//ret = 0;
-	nodeNum = creationCounter++;
+	nodeNum = SearchContext::current().newNodeNum();
   /*printf("%d c\n", nodeNum);*/
 }
 
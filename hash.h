@@ -5,8 +5,6 @@
 
 namespace hearts {
 
-extern int creationCounter;
-
 class State {
  public:
 	State();
@@ -15,7 +13,7 @@ class State {
 	virtual bool equals(State *val) = 0;
 	virtual int type() { return 0; }
 	virtual void Print(int val = 0) const { }
-  // for debugging
+  // for debugging; numbered by the SearchContext that built it
   int nodeNum;
 };
 
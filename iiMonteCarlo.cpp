@@ -1,7 +1,8 @@
 #include "Player.h"
 #include "iiMonteCarlo.h"
 
-#include <deque>
+#include <algorithm>
+#include <cmath>
 #include <thread>
 #include <vector>
 #include <assert.h>
@@ -28,14 +29,25 @@ iiMonteCarlo::iiMonteCarlo(Algorithm *a, int _numModels, int _numChoices)
 		numChoices = _numChoices;
 	algorithm = a;
 	player = 0;
+	decidedRange = 0;
+	maxThreads = 0;
+	observer = 0;
+	worlds = 0;
+	totals = 0;
 }
 
 iiMonteCarlo::iiMonteCarlo(Player *_player, int _numModels)
 {
 	dr = kMaxWeighted;
 	this->numModels = _numModels;
+	numChoices = numModels;
 	algorithm = 0;
 	player = _player;
+	decidedRange = 0;
+	maxThreads = 0;
+	observer = 0;
+	worlds = 0;
+	totals = 0;
 }
 
 iiMonteCarlo::~iiMonteCarlo()
@@ -46,7 +58,6 @@ iiMonteCarlo::~iiMonteCarlo()
 
 const char *iiMonteCarlo::getName()
 {
-	static char name[1024];
 	if (algorithm)
 		sprintf(name, "MC_D-%s_M-%d__%s", getDecisionName(), numModels, algorithm->getName());
 	else
@@ -67,37 +78,82 @@ const char *iiMonteCarlo::getDecisionName()
 	return "?";
 }
 
+// worlds are drawn from numChoices candidates, so there must be enough of them
+void iiMonteCarlo::setNumModels(int val)
+{
+	if (numChoices == numModels)
+		numChoices = val;
+	else
+		numChoices = std::max(numChoices, val);
+	numModels = val;
+}
+
 returnValue *iiMonteCarlo::Play(GameState *g, Player *p)
 {
 	std::vector<returnValue *> v;
 	std::vector<double> probs;
-	Move *best;
-
-	// 1. procure and analyze each model
+	iiMonteCarloTotals combined;
+	int total = numModels;
 
-	if (usingThreads() && (algorithm) && (algorithm->getSearchTimeLimit() == kMaxTimeLimit))
-		doThreadedModels(g, p, v, probs);
-	else
-		doModels(g, p, v, probs);
+	// 1. kept worlds stand in for new ones, and are in the answer from the start
+	totals = &combined;
+	if (worlds)
+	{
+		numModels = std::max(total-worlds->size(), 0);
+		for (int x = 0; x < worlds->size(); x++)
+			combined.Add(worlds->results[x], g->getPlayerNum(p), worlds->weights[x]);
+	}
+	// 2. procure and analyze each model; each is combined into the answer
+	// as it finishes, so there is nothing left to do after the last one
+	if (numModels > 0)
+	{
+		if (usingThreads() && (algorithm) && (algorithm->getSearchTimeLimit() == kMaxTimeLimit))
+			doThreadedModels(g, p, v, probs);
+		else
+			doModels(g, p, v, probs);
+	}
+	numModels = total;
+	totals = 0;
 
-	// 2. combine the results - only the algorithm knows how to do this.
 	// 3. get the move with the highest expected results
+	const Move *best = combined.getBest(dr);
 #if _PRINT_
-	printf("Analyzing results\n");
-#endif
-	best = Combine(g, v, g->getPlayerNum(p), probs);
-#if _PRINT_
-	best->Print(1);
+	if (best)
+		best->Print(1);
 #endif
 	
-	// 4. clean up memory
-	for (int x = 0; x < numModels; x++)
-		delete v[x];
-	//delete [] v;
+	// 4. keep the worlds searched to the end, clean up memory
+	for (unsigned int x = 0; x < v.size(); x++)
+	{
+		if (worlds && v[x] && finished[x])
+		{
+			worlds->results.push_back(v[x]);
+			worlds->weights.push_back(probs[x]);
+		}
+		else
+			delete v[x];
+	}
 
-//	printf("Returning result\n");
 	// 5. return result
-	return new returnValue(best);
+	return new returnValue(best?best->clone(g):0);
+}
+
+// Scales the weights of the worlds just drawn to about 1 each, like a kept world's
+void iiMonteCarlo::WeighLikeKept(std::vector<double> &probs)
+{
+	double sum = 0;
+	for (unsigned int x = 0; x < probs.size(); x++)
+		sum += probs[x];
+	for (unsigned int x = 0; x < probs.size(); x++)
+		probs[x] *= probs.size()/sum;
+}
+
+void iiMonteCarloWorlds::Clear()
+{
+	for (unsigned int x = 0; x < results.size(); x++)
+		delete results[x];
+	results.resize(0);
+	weights.resize(0);
 }
 
 void iiMonteCarlo::doModels(GameState *g, Player *p, std::vector<returnValue *> &v, std::vector<double> &probs)
@@ -115,13 +171,22 @@ void iiMonteCarlo::doModels(GameState *g, Player *p, std::vector<returnValue *>
 	std::vector<GameState *> toAnalyze;
 	GetGameStates(g, p, toAnalyze, probs);
 	assert((int)toAnalyze.size() == numModels);
+	WeighLikeKept(probs);
+	finished.assign(numModels, false);
+	double remaining = 0;
+	for (int x = 0; x < numModels; x++)
+		remaining += probs[x];
+	bool decided = false;
 	
 	for (int x = 0; x < numModels; x++)
 	{
 		v[x] = 0;
-		if (!toAnalyze[x])
+		// once cancelled, one world is enough to return a legal move
+		if (!toAnalyze[x] || ((x > 0) && (searchCancelled() || decided)))
+		{
+			delete toAnalyze[x];
 			continue;
-		assert(toAnalyze[x] != 0);
+		}
 #if _PRINT_
 		printf("Getting model %d (prob: %f) for player %d\n", x, probs[x], g->getPlayerNum(p));
 		toAnalyze[x]->Print(1);
@@ -130,8 +195,13 @@ void iiMonteCarlo::doModels(GameState *g, Player *p, std::vector<returnValue *>
 		algorithm->resetCounters(toAnalyze[x]);
 		toAnalyze[x]->copyMoveList(g);
 		v[x] = algorithm->Analyze(toAnalyze[x], toAnalyze[x]->getNextPlayer());
+		finished[x] = !searchCancelled();
 		g->copyMoveList(toAnalyze[x]);
 		assert(v[x] != 0);
+		totals->Add(v[x], g->getPlayerNum(p), probs[x]);
+		remaining -= probs[x];
+		Report(x+1);
+		decided = Decided(remaining);
 #if _PRINT_
 		printf("Results:\n");
 		for (returnValue *tmp = v[x]; tmp; tmp = tmp->next)
@@ -151,7 +221,13 @@ void iiMonteCarlo::doModels(GameState *g, Player *p, std::vector<returnValue *>
 // Thread worker function - runs algorithm on a single world model
 void doThreadedModel(threadModel *m)
 {
+	m->affinity->Pin(m->slot);
 	m->result = m->alg->Analyze(m->gs, m->gs->getNextPlayer());
+	m->finished = !m->alg->searchCancelled();
+	// set first, so the search thread can't be woken by the merge and miss
+	// the world; joining the thread waits out the merge
+	m->done.store(true);
+	m->totals->Add(m->result, m->who, m->weight);
 }
 
 // Multi-threaded world model evaluation using std::thread
@@ -162,6 +238,9 @@ void iiMonteCarlo::doThreadedModels(GameState *g, Player *p, std::vector<returnV
 	threadModel **tm;
 	GameState **gameStates;
 	std::thread *threads;
+	SearchAffinity affinity(numModels);
+	// stops the running worlds once the answer is decided
+	CancelToken stop(getCancelToken());
 
 	threads = new std::thread[numModels];
 	v.resize(numModels);
@@ -171,6 +250,7 @@ void iiMonteCarlo::doThreadedModels(GameState *g, Player *p, std::vector<returnV
 	std::vector<int> modelQ;
 	for (int x = 0; x < numModels; x++)
 		modelQ.push_back(x);
+	finished.assign(numModels, false);
 
 	iiState = g->getiiGameState(true, g->getPlayerNum(p), player);
 
@@ -181,33 +261,53 @@ void iiMonteCarlo::doThreadedModels(GameState *g, Player *p, std::vector<returnV
 	}
 
 	// Setup work items for each world model
-	double probSum = 0;
 	for (int x = 0; x < numModels; x++)
 	{
 		v[x] = 0;
 		double prob;
 		gameStates[x] = iiState->getGameState(prob);
 		probs.push_back(prob);
-		probSum += prob;
 		algs[x] = algorithm->clone();
 		algs[x]->resetCounters(gameStates[x]);
+		algs[x]->setCancelToken(&stop);
 		tm[x] = new threadModel();
 		tm[x]->alg = algs[x];
 		tm[x]->gs = gameStates[x];
 		tm[x]->result = nullptr;
+		tm[x]->affinity = &affinity;
+		tm[x]->slot = 0;
+		tm[x]->totals = totals;
+		tm[x]->who = g->getPlayerNum(p);
+		tm[x]->finished = false;
+		tm[x]->done.store(false);
 	}
+	WeighLikeKept(probs);
+	double remaining = 0;
 	for (int x = 0; x < numModels; x++)
-		probs[x] /= probSum;
+	{
+		tm[x]->weight = probs[x];
+		remaining += probs[x];
+	}
 
-	// Get number of hardware threads available
-	unsigned int numCPU = std::thread::hardware_concurrency();
-	if (numCPU == 0) numCPU = 1;  // Fallback if detection fails
+	// as many worlds at once as the cores they may run on
+	unsigned int numCPU = affinity.getThreads();
+	if ((maxThreads > 0) && (maxThreads < (int)numCPU))
+		numCPU = maxThreads;
 
-	int numRunning = 0;
-	std::deque<int> running;
+	int numRunning = 0, worldsDone = 0, kept = totals->getWorlds();
+	bool decided = false;
+	std::vector<int> running;
+	std::vector<int> freeSlots;
+	for (int x = numCPU-1; x >= 0; x--)
+		freeSlots.push_back(x);
 
 	while ((modelQ.size() > 0) || (numRunning > 0))
 	{
+		// once cancelled, drop the worlds not yet started; the running
+		// ones see the token and stop at their next sample
+		if ((searchCancelled() && ((int)modelQ.size() < numModels)) || decided)
+			modelQ.clear();
+
 		// Launch threads up to CPU limit
 		while ((numRunning < (int)numCPU) && (modelQ.size() > 0))
 		{
@@ -215,27 +315,45 @@ void iiMonteCarlo::doThreadedModels(GameState *g, Player *p, std::vector<returnV
 			modelQ.pop_back();
 			running.push_back(next);
 			numRunning++;
+			tm[next]->slot = freeSlots.back();
+			freeSlots.pop_back();
 #if _PRINT_
 			printf("Starting up %d, %d now running\n", next, numRunning);
 #endif
 			threads[next] = std::thread(doThreadedModel, tm[next]);
 		}
+		if (numRunning == 0)
+			continue;
 
-		// Wait for first thread in queue to complete
-		int waitFor = running.front();
-		running.pop_front();
-
-		if (threads[waitFor].joinable())
+		// Wait for a world to finish, then collect every one that has
+		totals->waitForWorlds(kept+worldsDone+1);
+		for (unsigned int x = 0; x < running.size(); )
 		{
-			threads[waitFor].join();
-			v[waitFor] = tm[waitFor]->result;
-		}
+			int done = running[x];
+			if (!tm[done]->done.load())
+			{
+				x++;
+				continue;
+			}
+			threads[done].join();
+			running.erase(running.begin()+x);
+			freeSlots.push_back(tm[done]->slot);
+			numRunning--;
+			v[done] = tm[done]->result;
+			finished[done] = tm[done]->finished;
+			remaining -= probs[done];
+			Report(++worldsDone);
 #if _PRINT_
-		printf("Got result from %d\n", waitFor);
-		if (v[waitFor])
-			v[waitFor]->Print();
+			printf("Got result from %d\n", done);
+			if (v[done])
+				v[done]->Print();
 #endif
-		numRunning--;
+			if (!decided && Decided(remaining))
+			{
+				decided = true;
+				stop.cancel();
+			}
+		}
 	}
 
 	// Cleanup
@@ -262,14 +380,17 @@ returnValue *iiMonteCarlo::Analyze(GameState *g, Player *p)
 {
 	std::vector<returnValue *> v;
 	std::vector<double> probs;
+	iiMonteCarloTotals combined;
 	returnValue *best;
 
 	// 1. procure and analyze each model
 
+	totals = &combined;
 	if (usingThreads() && (algorithm->getSearchTimeLimit() == kMaxTimeLimit))
 		doThreadedModels(g, p, v, probs);
 	else
 		doModels(g, p, v, probs);
+	totals = 0;
 
 	// 2. combine the results - only the algorithm knows how to do this.
 	// 3. get the move with the highest expected results
@@ -398,158 +519,132 @@ returnValue *iiMonteCarlo::CombinedAnalyze(GameState *g, std::vector<returnValue
 	return answer;
 }
 
-Move *iiMonteCarlo::Combine(GameState *g, std::vector<returnValue *> &v, int whichPlayer, std::vector<double> &probs)
+void iiMonteCarlo::Report(int worldsDone)
 {
-	Move *val[MAXMOVES];
-	double valSum[MAXMOVES];
-	double valWeighted[MAXMOVES];
-	double valMin[MAXMOVES];
-	double S[MAXMOVES];
-	double mean[MAXMOVES];
-	int valCnt[MAXMOVES];
-	int maxIndex = 0;
+	if (!observer)
+		return;
+	const Move *best = totals->getBest(dr);
+	if (!best)
+		return;
+	int kept = worlds?worlds->size():0;
+	observer->WorldsDone(best, totals->getConfidence(dr), kept+worldsDone, kept+numModels);
+}
 
-	double sum = 0;
-	for (unsigned int x = 0; x < probs.size(); x++)
-		sum += probs[x];
-	if (!fequal(sum, 0))
-	{
-		for (unsigned int x = 0; x < probs.size(); x++)
-			probs[x]/=sum;
-#if _PRINT_
-		printf("Normalizing probabilities!\n");
-#endif
-	}
-	
-	for (int x = 0; x < MAXMOVES; x++)
-	{
-		mean[x] = 0;
-		S[x] = 0;
-		valWeighted[x] = 0;
-		valSum[x] = 0;
-		valMin[x] = 0;
-		valCnt[x] = 0;
-		val[x] = 0;
-	}
-	
-	for (int x = 0; x < numModels; x++)
-	{
-#if _PRINT_
-//		printf("Trying results from %d\n", x);
-#endif
-		returnValue *iter = v[x];
-		if (!iter)
-			break;
-		// each of these is a list of possible moves...
-		while (iter)
-		{
-			// find value in list so far, and add in current result...
-			for (int y = 0; y < MAXMOVES; y++)
-			{
-				if (val[y] == 0)
-				{
-#if _PRINT_
-//					printf("%d Putting in move loc %d (%1.2f)\n", whichPlayer, y, iter->getValue(whichPlayer));
-#endif
-					if (iter->m == 0)
-						printf("Hey; we didn't get a move with our return value!\n");
-					val[y] = iter->m->clone(g);
-					if (val[y] == 0)
-						printf("Hey; clone returned 0!\n");
-					valCnt[y] = 1;
-					valSum[y] = iter->getValue(whichPlayer);
-					valMin[y] = iter->getValue(whichPlayer);
-					valWeighted[y] = probs[x]*iter->getValue(whichPlayer);
-					
-					double delta = iter->getValue(whichPlayer) - mean[y];
-					mean[y] = mean[y] + delta/valCnt[y];
-					S[y] = S[y] + delta*(iter->getValue(whichPlayer) - mean[y]);
-						
-					if (isnan(iter->getValue(whichPlayer)))
-					{ printf("We got NAN!\n"); exit(1); }
-						
-					break;
-				}
-				if (val[y]->equals(iter->m))
-				{
-					valCnt[y]++;
-					valSum[y] += iter->getValue(whichPlayer);
-					valMin[y] = std::min(valMin[y], iter->getValue(whichPlayer));
-					valWeighted[y] += probs[x]*iter->getValue(whichPlayer);
-
-					double delta = iter->getValue(whichPlayer) - mean[y];
-					mean[y] = mean[y] + delta/valCnt[y];
-					S[y] = S[y] + delta*(iter->getValue(whichPlayer) - mean[y]);
-					
-					if (isnan(iter->getValue(whichPlayer)))
-					{ printf("We got NAN!\n"); iter->Print(0); exit(1); }
-					break;
-				}
-			}
-			iter = iter->next;
-		}
-	}
-	mt_random r;
-	//r.srand(time(0));
-	
-	// make best move
-	int ties = 1;
-	// now choose which move to make
-#if _PRINT_
-	if (dr == kMaxWeighted)
-		printf("Using kMaxWeighted\n");
-#endif
-	for (int x = 1; x < MAXMOVES; x++)
+bool iiMonteCarlo::Decided(double remaining)
+{
+	return (decidedRange > 0) && (dr == kMaxWeighted) && totals->isDecided(remaining, decidedRange);
+}
+
+iiMonteCarloTotals::iiMonteCarloTotals()
+{
+	for (int x = 0; x < kMaxTotalsMoves; x++)
+		totals[x].m = 0;
+	numMoves = 0;
+	worlds = 0;
+	weight = 0;
+}
+
+iiMonteCarloTotals::~iiMonteCarloTotals()
+{
+	for (int x = 0; x < numMoves; x++)
+		delete totals[order[x]].m;
+}
+
+void iiMonteCarloTotals::Add(const returnValue *world, int who, double w)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const returnValue *top = world;
+	for (const returnValue *iter = world; iter; iter = iter->next)
 	{
-		if (val[x])
+		double value = iter->getValue(who);
+		if (isnan(value))
+		{ printf("We got NAN!\n"); iter->Print(0); exit(1); }
+		if (value > top->getValue(who))
+			top = iter;
+
+		uint32_t slot = iter->m->getHash();
+		assert(slot < kMaxTotalsMoves);
+		moveTotal &t = totals[slot];
+		if (t.m == 0)
 		{
-			if (((dr == kMaxWeighted) && (valWeighted[x] > valWeighted[maxIndex])) ||
-				((dr == kMaxAverage) && (mean[x] > mean[maxIndex])) ||
-				((dr == kMaxAvgVar) && (mean[x]-sqrt(S[x]/(valCnt[x]-1)) > mean[maxIndex]-sqrt(S[maxIndex]/(valCnt[maxIndex]-1)))) ||
-				((dr == kMaxMinScore) && (valMin[x] > valMin[maxIndex])))
-			{
-				if (dr == kMaxWeighted)
-					assert(valWeighted[x] > valWeighted[maxIndex]);
-				ties = 1;
-				maxIndex = x;
-			}
-//			else if (valSum[x]/valCnt[x] == valSum[maxIndex]/valCnt[maxIndex])
-//				//else if (valMin[x] == valMin[maxIndex])
-//			{
-//				ties++;
-//				if (r.rand_double() < (double)1/ties)
-//					maxIndex = x;
-//			}
+			t.m = iter->m->clone();
+			t.count = 0;
+			t.mean = t.S = 0;
+			t.weighted = 0;
+			t.min = value;
+			t.top = 0;
+			order[numMoves++] = slot;
 		}
+		t.count++;
+		t.weighted += w*value;
+		t.min = std::min(t.min, value);
+		double delta = value-t.mean;
+		t.mean += delta/t.count;
+		t.S += delta*(value-t.mean);
 	}
-		
-#if _PRINT_
-	//ai_debug("-=-=->\tindex\tcount\tsum\tmove");
-	printf("index\tcount\tsum\tmin\tavg\tavg-s\tstd\twgt\n");
-	for (int x = 0; x < MAXMOVES; x++)
+	if (top)
 	{
-		if (val[x])
-		{
-			//char msg[255];
-			//sprintf(msg, "-=-=->\t%d\t%d\t%1.2f\t", x, valCnt[x], valSum[x]);
-			//ai_debug(msg);
-			printf("%d\t%d\t%1.3f\t%1.3f\t%1.3f\t%1.3f\t%1.3f\t%1.4f", x, valCnt[x], valSum[x], valMin[x],
-				   valSum[x]/valCnt[x], mean[x]-sqrt(S[x]/(valCnt[x]-1)), sqrt(S[x]/(valCnt[x]-1)), valWeighted[x]);
-			val[x]->Print(0);//variance = S/(n - 1)
-			if (x == maxIndex)
-				printf("*");
-			printf("\n");
-		}
+		totals[top->m->getHash()].top += w;
+		weight += w;
 	}
-#endif
+	worlds++;
+	merged.notify_all();
+}
 
-	for (int x = 0; x < MAXMOVES; x++)
+int iiMonteCarloTotals::getBestSlot(decisionRule r) const
+{
+	if (numMoves == 0)
+		return -1;
+	// ties go to the move that came in first
+	int best = order[0];
+	for (int x = 1; x < numMoves; x++)
 	{
-		if (val[x] && (x != maxIndex))
-			delete val[x];
+		const moveTotal &t = totals[order[x]], &b = totals[best];
+		if (((r == kMaxWeighted) && (t.weighted > b.weighted)) ||
+			((r == kMaxAverage) && (t.mean > b.mean)) ||
+			((r == kMaxAvgVar) && (t.mean-sqrt(t.S/(t.count-1)) > b.mean-sqrt(b.S/(b.count-1)))) ||
+			((r == kMaxMinScore) && (t.min > b.min)))
+			best = order[x];
 	}
-	//printf("Using %d for answer!\n", maxIndex);
-	return val[maxIndex];
+	return best;
+}
+
+const Move *iiMonteCarloTotals::getBest(decisionRule r) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int best = getBestSlot(r);
+	return (best == -1)?0:totals[best].m;
+}
+
+double iiMonteCarloTotals::getConfidence(decisionRule r) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int best = getBestSlot(r);
+	return ((best == -1) || (weight <= 0))?0:totals[best].top/weight;
+}
+
+int iiMonteCarloTotals::getWorlds() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return worlds;
+}
+
+bool iiMonteCarloTotals::isDecided(double remaining, double range) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	int best = getBestSlot(kMaxWeighted);
+	if (best == -1)
+		return false;
+	for (int x = 0; x < numMoves; x++)
+		if ((order[x] != best) && !(totals[best].weighted-totals[order[x]].weighted > remaining*range))
+			return false;
+	return true;
+}
+
+void iiMonteCarloTotals::waitForWorlds(int n) const
+{
+	std::unique_lock<std::mutex> guard(lock);
+	merged.wait(guard, [&]{ return worlds >= n; });
 }
 
 void iiMonteCarlo::GetGameStates(GameState *g, Player *p,
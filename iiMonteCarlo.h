@@ -1,5 +1,9 @@
 #include "Algorithm.h"
 #include "algorithmStates.h"
+#include "SearchAffinity.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <thread>
 
@@ -8,12 +12,51 @@
 
 namespace hearts {
 
+class iiMonteCarloTotals;
+
 // Thread work item for parallel model evaluation
 class threadModel {
 public:
 	Algorithm *alg;
 	GameState *gs;
 	returnValue *result;  // Output stored here after thread completes
+	const SearchAffinity *affinity;
+	int slot; // differs from the other worlds running at the same time
+	iiMonteCarloTotals *totals; // the result is merged in here
+	int who;
+	double weight;
+	bool finished; // not cut short by a cancel
+	std::atomic<bool> done;
+};
+
+/*
+ * Told the combined answer so far each time another world finishes, so a
+ * caller can show the search converging or stop it early. Called on the
+ * thread running iiMonteCarlo::Play. confidence is the weight of the searched
+ * worlds whose own best move is the combined best.
+ */
+class iiMonteCarloObserver {
+public:
+	virtual ~iiMonteCarloObserver() {}
+	virtual void WorldsDone(const Move *best, double confidence, int worldsDone, int numWorlds) = 0;
+};
+
+/*
+ * The worlds a search finished, kept so that a later search of the same
+ * decision can pick up from them: they count toward its numModels and go
+ * into its combined answer. Worlds that a cancel cut short are not kept.
+ */
+class iiMonteCarloWorlds {
+public:
+	iiMonteCarloWorlds() {}
+	~iiMonteCarloWorlds() { Clear(); }
+	int size() const { return (int)results.size(); }
+	void Clear();
+	std::vector<returnValue *> results;
+	std::vector<double> weights; // about 1 per world
+private:
+	iiMonteCarloWorlds(const iiMonteCarloWorlds &);
+	iiMonteCarloWorlds &operator=(const iiMonteCarloWorlds &);
 };
 
 enum decisionRule {
@@ -23,6 +66,55 @@ enum decisionRule {
 	kMaxMinScore
 };
 
+enum {
+	kMaxTotalsMoves = 64
+};
+
+/*
+ * The combined answer of the worlds searched so far, by move. Each world's
+ * values go in as soon as it finishes, from the thread that searched it, so
+ * the answer is ready when the last world is. Moves are indexed by
+ * Move::getHash(), the card of a CardMove, which must be below
+ * kMaxTotalsMoves. A merge holds a lock for the dozen moves of one world.
+ */
+class iiMonteCarloTotals {
+public:
+	iiMonteCarloTotals();
+	~iiMonteCarloTotals();
+	void Add(const returnValue *world, int who, double weight);
+	// 0 until a world is in; the move belongs to the totals
+	const Move *getBest(decisionRule r) const;
+	// the weight of the worlds whose own best move is the combined best, 0-1
+	double getConfidence(decisionRule r) const;
+	int getWorlds() const;
+	// true if worlds of total weight remaining can't change the kMaxWeighted
+	// best move, given values no further apart than range. Every world must
+	// offer the same moves, as a player's own hand does.
+	bool isDecided(double remaining, double range) const;
+	// blocks until n worlds are in
+	void waitForWorlds(int n) const;
+private:
+	iiMonteCarloTotals(const iiMonteCarloTotals &);
+	iiMonteCarloTotals &operator=(const iiMonteCarloTotals &);
+	int getBestSlot(decisionRule r) const;
+
+	class moveTotal {
+	public:
+		Move *m;
+		int count;
+		double mean, S;  // Welford, unweighted
+		double weighted; // sum of weight*value
+		double min;
+		double top;      // weight of the worlds with this as their best move
+	};
+	moveTotal totals[kMaxTotalsMoves];
+	int order[kMaxTotalsMoves]; // slots in the order their moves first came in
+	int numMoves, worlds;
+	double weight;
+	mutable std::mutex lock;
+	mutable std::condition_variable merged;
+};
+
 class iiMonteCarlo : public Algorithm {
 public:
 	iiMonteCarlo(Algorithm *a, int numModels, int numChoices = -1);
@@ -34,21 +126,43 @@ public:
 	returnValue *DispatchSearch(unsigned int depth, int cp, GameState *g);
 	Algorithm *getAlgorithm() { return algorithm; }
 	int getNumModels() { return numModels; }
-	void setNumModels(int val) { numModels = val; }
+	void setNumModels(int val);
 	const char *getName();
 	void setDecisionRule(decisionRule r) { dr = r; }
+	void setObserver(iiMonteCarloObserver *o) { observer = o; }
+	iiMonteCarloObserver *getObserver() const { return observer; }
+	// Play starts from the worlds in w and adds the ones it finishes to it
+	void setWorlds(iiMonteCarloWorlds *w) { worlds = w; }
+	void setCancelToken(const CancelToken *token)
+	{ Algorithm::setCancelToken(token); if (algorithm) algorithm->setCancelToken(token); }
+	// with kMaxWeighted, stop searching worlds once the rest can't change the
+	// answer; range bounds how far apart world values can be (1 for
+	// HeartsPlayout utilities), 0 searches every world
+	void setStopWhenDecided(double range) { decidedRange = range; }
+	// with threads, search at most this many worlds at once; 0 for as many
+	// as SearchAffinity gives cores
+	void setMaxThreads(int n) { maxThreads = (n > 0)?n:0; }
 private:
 	const char *getDecisionName();
-	Move *Combine(GameState *g, std::vector<returnValue *> &v, int who, std::vector<double> &probs);
+	void Report(int worldsDone);
+	bool Decided(double remaining);
 	returnValue *CombinedAnalyze(GameState *g, std::vector<returnValue *> &v, int who, std::vector<double> &probs);
 	void doModels(GameState *g, Player *p, std::vector<returnValue *> &v, std::vector<double> &probs);
 	void doThreadedModels(GameState *g, Player *p, std::vector<returnValue *> &v, std::vector<double> &probs);
 	void GetGameStates(GameState *g, Player *p, std::vector<GameState *> &states, std::vector<double> &probs);
 	void NormalizeProbs(std::vector<double> &pr);
+	void WeighLikeKept(std::vector<double> &probs);
 	int numModels, numChoices;
 	Algorithm *algorithm;
 	Player *player;
 	decisionRule dr;
+	double decidedRange;
+	int maxThreads;
+	iiMonteCarloObserver *observer;
+	iiMonteCarloWorlds *worlds;
+	iiMonteCarloTotals *totals; // during a search
+	std::vector<bool> finished; // worlds not cut short by a cancel
+	char name[1024]; // getName()
 };
 
 // Thread worker function
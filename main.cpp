@@ -2,10 +2,12 @@
 #include "Game.h"
 #include "Hearts.h"
 #include "iiMonteCarlo.h"
+#include "HeartsTime.h"
 #include "statistics.h"
 
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 using namespace hearts;
@@ -55,6 +57,21 @@ Player *GetPlayer(int playerType)
 			a->setUseThreads(true);
 			return p;
 		}
+	case 3:
+		{
+			// player 0's total for the hand (13 searches of 10000), spent
+			// where the time manager thinks it matters
+			int sims = 10000;
+			int worlds = 30;
+			SimpleHeartsPlayer *p; iiMonteCarlo *a; UCT *b;
+			p = new SafeSimpleHeartsPlayer(a = new iiMonteCarlo(b = new UCT(sims/worlds, C), worlds));
+			p->setModelLevel(2);
+			p->setTimeManager(new HeartsTimeManager(13*sims, sims/worlds));
+			b->setPlayoutModule(new HeartsPlayout());
+			a->setUseThreads(true);
+			b->setEpsilonPlayout(0.1);
+			return p;
+		}
 	default:
 		{
 			int sims = 1000;
@@ -72,7 +89,8 @@ Player *GetPlayer(int playerType)
 	return 0;
 }
 
-void PlayGame(statistics &s)
+// seats are filled with player 0 and the other player type
+void PlayGame(statistics &s, int other)
 {
 	srand((unsigned int)time(NULL));
 	HeartsGameState *g;
@@ -120,7 +138,7 @@ void PlayGame(statistics &s)
 	int org = rand()%14;
 	for (int x = 0; x < 4; x++)
 	{
-		game.addPlayer(GetPlayer(order[org][x]));
+		game.addPlayer(GetPlayer(order[org][x]?other:0));
 	}
 
 	g->setPassDir(0);	
@@ -130,7 +148,10 @@ void PlayGame(statistics &s)
 
 	// clean up memory
 	for (int x = 0; x < 4; x++)
+	{
+		delete ((SimpleHeartsPlayer*)g->getPlayer(x))->getTimeManager();
 		delete g->getPlayer(x)->getAlgorithm();
+	}
 	g->deletePlayers();
 	delete g;
 	g = 0;
@@ -138,10 +159,12 @@ void PlayGame(statistics &s)
 
 int main(int argc, char **argv)
 {
+	// "budget" plays the time managed player against fixed simulations
+	int other = ((argc > 1) && (strcmp(argv[1], "budget") == 0))?3:1;
 	statistics s;
 	for (int x = 0; x < 100; x++)
 	{
-		PlayGame(s);
+		PlayGame(s, other);
 		s.save();
 	}
 }
@@ -1,8 +1,25 @@
 #include "AIRequestHandler.h"
+#include "InFlightSearches.h"
+#include "Ponderer.h"
+#include "SpeculationCache.h"
+#include "../HeartsDifficulty.h"
+#include "../HeartsEval.h"
+#include "../HeartsFast.h"
+#include "../HeartsPass.h"
+#include "../HeartsStrength.h"
+#include "../HeartsTime.h"
+#include "../SearchContext.h"
+#include "../iiGameState.h"
+#include <atomic>
 #include <chrono>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 
 namespace hearts {
 namespace server {
@@ -17,15 +34,106 @@ static std::string card_to_string(card c) {
     return std::string(ranks[rank]) + suits[suit];
 }
 
+// Number of world models for iiMonteCarlo
+static const int kWorlds = 30;
+
+// Worlds sampled to find the cards an opponent may play
+static const int kSpeculationSamples = 200;
+
+// Pass decisions are shared by every request so the evaluator's
+// suit-isomorphism cache survives across them.
+static HeartsPassEvaluator& shared_pass_evaluator() {
+    static HeartsPassEvaluator evaluator;
+    return evaluator;
+}
+
+// Move priors for "puct" searches. GetPriors only reads it, so every
+// world of every search can use the one copy.
+static HeartsMovePrior& shared_move_prior() {
+    static HeartsMovePrior prior;
+    return prior;
+}
+
+// Engines kept between requests. Shared by every handler, like the pass
+// evaluator, so the ponderer's and /api/speculate's searches use them too.
+static EnginePool& engine_pool() {
+    static EnginePool pool;
+    return pool;
+}
+
+// What an engine is built from: requests with the same key can share one
+static std::string engine_key(const AIConfig& config, int rules) {
+    return config.player_type + "|" + config.difficulty + "|" + std::to_string(config.simulations) + "|" +
+           std::to_string(config.epsilon) + "|" + (config.use_threads ? "t" : "s") + "|" + std::to_string(rules) +
+           "|" + (config.mast ? "m" : "") + std::to_string(config.rave) + "|" + std::to_string(config.puct);
+}
+
+// Sessions whose time managers are kept, see session_timer
+static const size_t kMaxTimedSessions = 256;
+
+// A session's time manager. Its mutex is held for the whole search it
+// budgets, so a session's decisions are budgeted one at a time.
+struct SessionTimer {
+    SessionTimer(int hand_budget, int sims_per_world) : timer(hand_budget, sims_per_world), used(0) {}
+    std::mutex mutex;
+    HeartsTimeManager timer;
+    uint64_t used;  // under the table's mutex
+};
+
+// The session's time manager, so that what the hand has spent and the
+// volatility of its searches carry from one request to the next
+static std::shared_ptr<SessionTimer> session_timer(const std::string& session, int sims_per_world) {
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<SessionTimer>> timers;
+    static uint64_t clock = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = timers.find(session);
+    if (it != timers.end() && it->second->timer.getSimulationsPerWorld() != sims_per_world) {
+        timers.erase(it);  // the search changed; start the budget again
+        it = timers.end();
+    }
+    if (it == timers.end()) {
+        if (timers.size() >= kMaxTimedSessions) {
+            // drop the session that was budgeted longest ago
+            timers.erase(std::min_element(timers.begin(), timers.end(),
+                [](const std::pair<const std::string, std::shared_ptr<SessionTimer>>& a,
+                   const std::pair<const std::string, std::shared_ptr<SessionTimer>>& b) {
+                    return a.second->used < b.second->used;
+                }));
+        }
+        it = timers.emplace(session, std::make_shared<SessionTimer>(0, sims_per_world)).first;
+    }
+    it->second->used = ++clock;
+    return it->second;
+}
+
+// The player's search, or null for a difficulty that plays without one
+static iiMonteCarlo* search_of(Player* player) {
+    return dynamic_cast<iiMonteCarlo*>(player->getAlgorithm());
+}
+
+// Simulations in each of the search's worlds
+static int world_simulations(const AIConfig& config) {
+    tHeartsDifficulty level;
+    if (!config.difficulty.empty() && getDifficulty(config.difficulty.c_str(), level)) {
+        return std::max(1, getDifficultyPreset(level).simsPerWorld);
+    }
+    return std::max(1, config.simulations / kWorlds);
+}
+
 AIRequestHandler::AIRequestHandler() {
 }
 
 AIRequestHandler::~AIRequestHandler() {
 }
 
-std::string AIRequestHandler::handle_get_move(const std::string& json_request) {
-    HeartsGameState* game = nullptr;
-    Player* player = nullptr;
+std::string AIRequestHandler::handle_get_move(const std::string& json_request, const CancelToken* cancel,
+                                              iiMonteCarloObserver* observer, Ponderer* ponderer,
+                                              SpeculationCache* speculated, InFlightSearches* in_flight) {
+    // requests run concurrently; each search gets its own engine context
+    SearchContext context;
+    SearchContext::Scope scope(context);
 
     try {
         auto start_time = std::chrono::high_resolution_clock::now();
@@ -61,100 +169,113 @@ std::string AIRequestHandler::handle_get_move(const std::string& json_request) {
                   << ", threads=" << (config.use_threads ? "yes" : "no")
                   << ", type=" << config.player_type << std::endl;
 
-        // Create game state and player together (player must be registered in game)
-        game = new HeartsGameState(static_cast<int>(time(nullptr)));
-
-        // Create the AI player first (it needs to be in the game's player list)
-        player = create_player(config, nullptr);
-        if (!player) {
-            delete game;
-            return JsonProtocol::format_error("AI_CONFIG_ERROR", "Failed to create AI player");
+        // A session's decision may have been pondered: answer from the
+        // finished search, or pick up from its worlds
+        std::string key = JsonProtocol::state_key(state_data, config);
+        std::string session = request_json.value("session_id", "");
+        bool ponder = ponderer && !session.empty() && request_json.value("ponder", false);
+        std::unique_ptr<Ponderer::Result> pondered;
+        if (ponderer && !session.empty()) {
+            pondered = ponderer->take(session, key);
         }
-
-        // Add players to game: AI player is always player 0
-        for (int i = 0; i < 4; i++) {
-            if (i == 0) {
-                game->addPlayer(player);
-            } else {
-                game->addPlayer(new Player(0));
-            }
+        json info = json::object();
+        if (pondered) {
+            info["pondered_worlds"] = pondered->worlds.size();
         }
-
-        // Now set the game state on the player
-        player->setGameState(game);
-
-        // Reset allocates tricks and deals random cards
-        game->Reset();
-
-        // Set up the game state from input data
-        // Only current player's hand is provided (always player 0)
-        for (int p = 0; p < 4; p++) {
-            game->cards[p].reset();
-            game->original[p].reset();
-        }
-        // Set current player's hand (player 0)
-        for (card c : state_data.player_hand) {
-            game->cards[0].set(c);
-            game->original[0].set(c);
-        }
-
-        game->setPassDir(state_data.pass_direction);
-        // Set first player based on trick lead if there's a current trick,
-        // otherwise default to player 0
-        int first_player = state_data.current_trick_cards.empty() ? 0 : state_data.trick_lead_player;
-        game->setFirstPlayer(first_player);
-        game->setRules(state_data.rules);
-
-        // setFirstPlayer with kLead2Clubs may override currPlr to 0 when passDir != kHold
-        // We need to reset currPlr to the trick lead player before applying current trick moves
-        if (!state_data.current_trick_cards.empty()) {
-            game->currPlr = state_data.trick_lead_player;
+        card early_move;
+        json early_info;
+        if (pondered && pondered->complete) {
+            early_move = pondered->move;
+            early_info = info;
+        } else if (speculated && speculated->get(key, early_move)) {
+            early_info = {{"speculated", true}};
         }
-
-        for (int p = 0; p < 4; p++) {
-            for (card c : state_data.played_cards[p]) {
-                game->taken[p].set(c);
-                game->allplayed.set(c);
+        if (!early_info.is_null()) {
+            auto end_time = std::chrono::high_resolution_clock::now();
+            double time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+            std::cout << "[DEBUG] Move found ahead of time: " << card_to_string(early_move) << std::endl;
+            if (ponder) {
+                ponderer->ponder(session, state_data, config, early_move);
             }
+            return JsonProtocol::format_move_response(early_move, 0, time_ms, early_info);
         }
 
-        // Replay trick history: add cards to hands and apply moves
-        for (const CompletedTrick& trick : state_data.trick_history) {
-            // Set currPlr to the lead player for this trick
-            game->currPlr = trick.lead_player;
-            // First, add all cards in this trick to respective players' hands
-            for (const TrickCard& tc : trick.cards) {
-                game->cards[tc.player].set(tc.c);
-                game->original[tc.player].set(tc.c);
+        // Identical requests (retries, several observers of one table) share
+        // one search: the first leads it, the rest wait for its move
+        std::unique_ptr<InFlightSearches::Lead> lead;
+        if (in_flight && !observer) {
+            // a hand budget is charged to the session searching, so only its
+            // own requests may share the search
+            std::string flight = key;
+            if (config.hand_budget > 0) {
+                flight += "|" + session;
             }
-            // Then apply all moves in order
-            for (const TrickCard& tc : trick.cards) {
-                CardMove* move = new CardMove(tc.c, tc.player);
-                game->ApplyMove(move);
-                delete move;
+            card shared_move;
+            InFlightSearches::Outcome outcome = in_flight->join(flight, cancel, shared_move);
+            if (outcome != InFlightSearches::kLead) {
+                auto end_time = std::chrono::high_resolution_clock::now();
+                double time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+                if (outcome == InFlightSearches::kCancelled) {
+                    std::cout << "[DEBUG] Cancelled waiting for an identical search" << std::endl;
+                    return JsonProtocol::format_error("CANCELLED", "The search was cancelled");
+                }
+                std::cout << "[DEBUG] Answered by an identical search: " << card_to_string(shared_move) << std::endl;
+                if (ponder) {
+                    ponderer->ponder(session, state_data, config, shared_move);
+                }
+                return JsonProtocol::format_move_response(shared_move, 0, time_ms, json{{"coalesced", true}});
             }
+            lead.reset(new InFlightSearches::Lead(*in_flight, flight));
         }
 
-        // For current trick cards, we need to add them to respective players' hands
-        // before applying moves (ApplyMove checks if player has the card)
-        for (const TrickCard& tc : state_data.current_trick_cards) {
-            game->cards[tc.player].set(tc.c);
-            game->original[tc.player].set(tc.c);
+        // A player already seated in its game, from the pool if one is idle
+        std::unique_ptr<Engine> engine = acquire_engine(config, state_data.rules);
+        if (!engine) {
+            return JsonProtocol::format_error("AI_CONFIG_ERROR", "Failed to create AI player");
+        }
+        HeartsGameState* game = engine->game;
+        Player* player = engine->player;
+        iiMonteCarlo* search = search_of(player);
+        if (search) {
+            // a shared search goes on while any request still wants its move
+            search->setCancelToken(lead ? lead->cancel() : cancel);
+        }
+        if (search && observer) {
+            search->setObserver(observer);
+        }
+        if (search && pondered) {
+            std::cout << "[DEBUG] Resuming from " << pondered->worlds.size() << " pondered worlds" << std::endl;
+            search->setWorlds(&pondered->worlds);
         }
 
-        // Now apply the current trick moves
-        for (const TrickCard& tc : state_data.current_trick_cards) {
-            CardMove* move = new CardMove(tc.c, tc.player);
-            game->ApplyMove(move);
-            delete move;
+        // With a hand budget the time manager sets this play's worlds; a
+        // session keeps one from request to request
+        std::shared_ptr<SessionTimer> shared_timer;
+        std::unique_lock<std::mutex> timer_lock;
+        std::unique_ptr<HeartsTimeManager> request_timer;
+        HeartsTimeManager* timer = nullptr;
+        if (config.hand_budget > 0 && search && !pondered) {
+            int world_sims = world_simulations(config);
+            if (!session.empty()) {
+                shared_timer = session_timer(session, world_sims);
+                timer_lock = std::unique_lock<std::mutex>(shared_timer->mutex);
+                timer = &shared_timer->timer;
+            } else {
+                request_timer.reset(new HeartsTimeManager(0, world_sims));
+                timer = request_timer.get();
+            }
+            timer->setHandBudget(config.hand_budget);
+            static_cast<SimpleHeartsPlayer*>(player)->setTimeManager(timer);
         }
+        long long spent_before = timer ? timer->getSpent() : 0;
+
+        load_game_state(game, state_data);
 
         // Validate: check if there are legal moves
         Move* legal_moves = game->getMoves();
         if (!legal_moves) {
             std::cout << "[DEBUG] ERROR: No legal moves!" << std::endl;
-            cleanup_player(player);
-            delete game;
+            release_engine(config, state_data.rules, std::move(engine));
             return JsonProtocol::format_error("NO_LEGAL_MOVES", "No legal moves available in this game state");
         }
 
@@ -177,55 +298,440 @@ std::string AIRequestHandler::handle_get_move(const std::string& json_request) {
             CardMove* card_move = dynamic_cast<CardMove*>(legal_moves);
             move = card_move->c;
             std::cout << "[DEBUG] Single legal move, skipping AI" << std::endl;
-        } else {
+        }
+        game->freeMove(legal_moves);
+        if (num_moves > 1) {
             // Multiple moves - run AI to choose best one
             std::cout << "[DEBUG] Running AI..." << std::endl;
             move = compute_ai_move(game, player);
+            if (timer) {
+                info["simulations"] = timer->getSpent() - spent_before;
+                std::cout << "[DEBUG] Hand budget: " << info["simulations"] << " simulations, "
+                          << timer->getRemaining() << " left" << std::endl;
+            }
         }
 
         auto end_time = std::chrono::high_resolution_clock::now();
         double time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 
+        if (lead && !lead->cancel()->isCancelled()) {
+            lead->answer(move);
+        }
+        if (cancel && cancel->isCancelled() && !observer) {
+            std::cout << "[DEBUG] Search cancelled after " << time_ms << " ms" << std::endl;
+            release_engine(config, state_data.rules, std::move(engine));
+            return JsonProtocol::format_error("CANCELLED", "The search was cancelled");
+        }
+
         std::cout << "[DEBUG] Chosen move: " << card_to_string(move) << std::endl;
         std::cout << "[DEBUG] Computation time: " << time_ms << " ms" << std::endl;
         std::cout << "========================================\n" << std::endl;
 
-        // Format response (always player 0)
-        std::string response = JsonProtocol::format_move_response(move, 0, time_ms);
+        if (ponder) {
+            ponderer->ponder(session, state_data, config, move);
+        }
 
-        // Cleanup
-        if (player) cleanup_player(player);
-        delete game;
+        release_engine(config, state_data.rules, std::move(engine));
 
-        return response;
+        // Format response (always player 0)
+        return JsonProtocol::format_move_response(move, 0, time_ms, info);
 
     } catch (const json::exception& e) {
         std::cout << "[ERROR] JSON parse error: " << e.what() << std::endl;
-        if (player) cleanup_player(player);
-        if (game) delete game;
         return JsonProtocol::format_error("PARSE_ERROR", std::string("JSON parse error: ") + e.what());
+    } catch (const std::invalid_argument& e) {
+        std::cout << "[ERROR] " << e.what() << std::endl;
+        return JsonProtocol::format_error("INVALID_GAME_STATE", e.what());
     } catch (const std::exception& e) {
         std::cout << "[ERROR] Internal error: " << e.what() << std::endl;
-        if (player) cleanup_player(player);
-        if (game) delete game;
         return JsonProtocol::format_error("INTERNAL_ERROR", std::string("Internal error: ") + e.what());
     } catch (...) {
         std::cout << "[ERROR] Unknown error occurred" << std::endl;
-        if (player) cleanup_player(player);
-        if (game) delete game;
         return JsonProtocol::format_error("UNKNOWN_ERROR", "An unknown error occurred");
     }
 }
 
-Player* AIRequestHandler::create_player(const AIConfig& config, HeartsGameState* game) {
+std::unique_ptr<Engine> AIRequestHandler::acquire_engine(const AIConfig& config, int rules) {
+    std::unique_ptr<Engine> engine = engine_pool().acquire(engine_key(config, rules));
+    if (engine) {
+        return engine;
+    }
+    Player* player = create_player(config, nullptr, rules);
+    if (!player) {
+        return nullptr;
+    }
+    // AI player is always player 0; the others only hold seats
+    HeartsGameState* game = new HeartsGameState(static_cast<int>(time(nullptr)));
+    game->addPlayer(player);
+    for (int i = 1; i < 4; i++) {
+        game->addPlayer(new Player(0));
+    }
+    return std::unique_ptr<Engine>(new Engine(game, player));
+}
+
+void AIRequestHandler::release_engine(const AIConfig& config, int rules, std::unique_ptr<Engine> engine) {
+    if (iiMonteCarlo* search = search_of(engine->player)) {
+        search->setCancelToken(nullptr);
+        search->setObserver(nullptr);
+        search->setWorlds(nullptr);
+    }
+    if (SimpleHeartsPlayer* simple = dynamic_cast<SimpleHeartsPlayer*>(engine->player)) {
+        simple->setTimeManager(nullptr);
+    }
+    engine_pool().release(engine_key(config, rules), std::move(engine));
+}
+
+void AIRequestHandler::load_game_state(HeartsGameState* game, const GameStateData& state_data) {
+    // The position goes in as it is: player 0's hand, the tricks so far
+    // and the cards taken outside them. Only player 0's hand is known.
+    HeartsPosition position;
+    position.rules = state_data.rules;
+    position.passDir = state_data.pass_direction;
+    position.who = 0;
+    for (card c : state_data.player_hand) {
+        position.hand.set(c);
+    }
+
+    // a trick is led by its first card's player, who the others follow in turn
+    auto add_trick = [&position](const std::vector<TrickCard>& cards, int lead_player) {
+        HeartsPositionTrick trick(cards.empty() ? lead_player : cards[0].player);
+        for (size_t i = 0; i < cards.size(); i++) {
+            if (cards[i].player != static_cast<int>((trick.leader + i) % 4)) {
+                throw std::invalid_argument("Invalid game state: a trick's cards aren't played in turn");
+            }
+            trick.cards.push_back(cards[i].c);
+        }
+        position.tricks.push_back(trick);
+    };
+    for (const CompletedTrick& trick : state_data.trick_history) {
+        add_trick(trick.cards, trick.lead_player);
+    }
+    // with no tricks at all player 0 leads; otherwise an empty trick is led
+    // by whoever won the last
+    if (!state_data.current_trick_cards.empty() || state_data.trick_history.empty()) {
+        add_trick(state_data.current_trick_cards, 0);
+    }
+    for (size_t p = 0; p < 4 && p < state_data.played_cards.size(); p++) {
+        for (card c : state_data.played_cards[p]) {
+            position.taken[p].set(c);
+        }
+    }
+
+    const char* error = "";
+    if (!game->SetPosition(position, &error)) {
+        throw std::invalid_argument(std::string("Invalid game state: ") + error);
+    }
+}
+
+card AIRequestHandler::search_move(const GameStateData& state_data, const AIConfig& config,
+                                   const CancelToken* cancel, iiMonteCarloWorlds* worlds) {
+    SearchContext context;
+    SearchContext::Scope scope(context);
+    std::unique_ptr<Engine> engine = acquire_engine(config, state_data.rules);
+    if (!engine) {
+        throw std::runtime_error("Failed to create AI player");
+    }
+    HeartsGameState* game = engine->game;
+    if (iiMonteCarlo* search = search_of(engine->player)) {
+        search->setCancelToken(cancel);
+        search->setWorlds(worlds);
+    }
+
+    load_game_state(game, state_data);
+    Move* legal_moves = game->getMoves();
+    if (!legal_moves) {
+        throw std::runtime_error("No legal moves available");
+    }
+    bool forced = !legal_moves->next;
+    card move = static_cast<CardMove*>(legal_moves)->c;
+    game->freeMove(legal_moves);
+    if (!forced) {
+        move = compute_ai_move(game, engine->player);
+    }
+    release_engine(config, state_data.rules, std::move(engine));
+    return move;
+}
+
+std::vector<ReplyLine> AIRequestHandler::likely_replies(const GameStateData& state_data, card played,
+                                                        const AIConfig& config, int samples,
+                                                        const CancelToken* cancel) {
+    SearchContext context;
+    SearchContext::Scope scope(context);
+    std::unique_ptr<Engine> engine = acquire_engine(config, state_data.rules);
+    if (!engine) {
+        throw std::runtime_error("Failed to create AI player");
+    }
+    HeartsGameState* game = engine->game;
+    std::map<std::vector<std::pair<int, card>>, int> counts;
+
+    load_game_state(game, state_data);
+    if (game->donePassing() && (game->getNextPlayerNum() == 0) && game->cards[0].has(played)) {
+        CardMove* move = new CardMove(played, 0);
+        game->ApplyMove(move);
+        delete move;
+    } else {
+        samples = 0;
+    }
+
+    // the worlds are drawn as the search draws them, so the opponents'
+    // cards follow the same model of their hands
+    iiGameState* ii = (samples > 0) ? game->getiiGameState(true, 0, nullptr) : nullptr;
+    HeartsPlayout policy;
+    policy.setSeed(static_cast<uint32_t>(time(nullptr)));
+    for (int s = 0; s < samples && !(cancel && cancel->isCancelled()); s++) {
+        double prob;
+        HeartsGameState* world = static_cast<HeartsGameState*>(ii->getGameState(prob));
+        if (!world) {
+            continue;
+        }
+        std::vector<std::pair<int, card>> line;
+        while (!world->Done() && (world->getNextPlayerNum() != 0)) {
+            int who = world->getNextPlayerNum();
+            Move* m = policy.ChooseMove(world, 0);
+            line.push_back(std::make_pair(who, static_cast<CardMove*>(m)->c));
+            world->ApplyMove(m);
+            world->freeMove(m);
+        }
+        counts[line]++;
+        delete world;
+    }
+    delete ii;
+    release_engine(config, state_data.rules, std::move(engine));
+
+    std::vector<ReplyLine> lines;
+    for (const auto& entry : counts) {
+        ReplyLine line;
+        for (const auto& play : entry.first) {
+            line.plays.push_back(TrickCard{play.first, play.second});
+        }
+        line.count = entry.second;
+        lines.push_back(line);
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](const ReplyLine& a, const ReplyLine& b) {
+        return a.count > b.count;
+    });
+    return lines;
+}
+
+std::string AIRequestHandler::handle_speculate(const std::string& json_request, SpeculationCache& cache,
+                                               const CancelToken* cancel) {
+    try {
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        std::cout << "\n========== /api/speculate REQUEST ==========" << std::endl;
+
+        json request_json = json::parse(json_request);
+        GameStateData state_data = JsonProtocol::parse_game_state(request_json.at("game_state"));
+        AIConfig config = JsonProtocol::parse_ai_config(request_json);
+        bool weighted = request_json.value("weighted", false);
+        int max_branches = request_json.value("max_branches", 13);
+
+        int who = JsonProtocol::next_to_move(state_data);
+        if (who == 0) {
+            return JsonProtocol::format_error("NOT_OPPONENT_TURN", "Player 0 is to move; use /api/move");
+        }
+
+        // the cards that leave player 0 to move next, most likely first
+        std::vector<CardWeight> cards = likely_cards(state_data, who, config, kSpeculationSamples, weighted, cancel);
+        std::vector<SpeculatedBranch> branches;
+        std::vector<GameStateData> states;
+        std::vector<std::string> keys;
+        for (const CardWeight& cw : cards) {
+            if (static_cast<int>(branches.size()) >= max_branches) {
+                break;
+            }
+            GameStateData after = JsonProtocol::advance(state_data, TrickCard{who, cw.c});
+            if (JsonProtocol::next_to_move(after) != 0) {
+                continue;
+            }
+            SpeculatedBranch branch;
+            branch.opponent_card = cw.c;
+            branch.probability = cw.weight;
+            branch.move = 0;
+            keys.push_back(JsonProtocol::state_key(after, config));
+            branch.cached = cache.get(keys.back(), branch.move);
+            branches.push_back(branch);
+            states.push_back(after);
+        }
+        std::cout << "[DEBUG] Player " << who << ": " << branches.size() << " branches" << std::endl;
+
+        // one single-threaded search per core, each on the next branch left
+        AIConfig branch_config = config;
+        branch_config.use_threads = false;
+        std::vector<char> failed(branches.size(), 0);
+        std::atomic<size_t> next(0);
+        auto work = [&]() {
+            for (size_t i = next++; i < branches.size(); i = next++) {
+                if (branches[i].cached) {
+                    continue;
+                }
+                try {
+                    AIRequestHandler handler;
+                    branches[i].move = handler.search_move(states[i], branch_config, cancel, nullptr);
+                } catch (const std::exception& e) {
+                    std::cout << "[ERROR] Branch " << card_to_string(branches[i].opponent_card)
+                              << ": " << e.what() << std::endl;
+                    failed[i] = 1;
+                }
+            }
+        };
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < cores && i < branches.size(); i++) {
+            workers.emplace_back(work);
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        double time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+
+        if (cancel && cancel->isCancelled()) {
+            std::cout << "[DEBUG] Speculation cancelled after " << time_ms << " ms" << std::endl;
+            return JsonProtocol::format_error("CANCELLED", "The search was cancelled");
+        }
+
+        std::vector<SpeculatedBranch> answered;
+        for (size_t i = 0; i < branches.size(); i++) {
+            if (failed[i]) {
+                continue;
+            }
+            if (!branches[i].cached) {
+                cache.put(keys[i], branches[i].move);
+            }
+            answered.push_back(branches[i]);
+        }
+        std::cout << "[DEBUG] Speculation time: " << time_ms << " ms" << std::endl;
+        return JsonProtocol::format_speculation(who, answered, time_ms);
+
+    } catch (const json::exception& e) {
+        return JsonProtocol::format_error("PARSE_ERROR", std::string("JSON parse error: ") + e.what());
+    } catch (const std::invalid_argument& e) {
+        return JsonProtocol::format_error("INVALID_GAME_STATE", e.what());
+    } catch (const std::exception& e) {
+        return JsonProtocol::format_error("INTERNAL_ERROR", std::string("Internal error: ") + e.what());
+    } catch (...) {
+        return JsonProtocol::format_error("UNKNOWN_ERROR", "An unknown error occurred");
+    }
+}
+
+std::vector<CardWeight> AIRequestHandler::likely_cards(const GameStateData& state_data, int who,
+                                                       const AIConfig& config, int samples, bool weighted,
+                                                       const CancelToken* cancel) {
+    SearchContext context;
+    SearchContext::Scope scope(context);
+    std::unique_ptr<Engine> engine = acquire_engine(config, state_data.rules);
+    if (!engine) {
+        throw std::runtime_error("Failed to create AI player");
+    }
+    HeartsGameState* game = engine->game;
+    const card queen = Deck::getcard(SPADES, QUEEN);
+    std::map<card, int> legal, chosen;
+    int choices = 0;
+
+    load_game_state(game, state_data);
+    // load_game_state has player 0 lead an empty trick
+    if (state_data.current_trick_cards.empty()) {
+        game->currPlr = who;
+    }
+    if (!game->donePassing() || game->Done() || (game->getNextPlayerNum() != who)) {
+        samples = 0;
+    }
+
+    iiGameState* ii = (samples > 0) ? game->getiiGameState(true, 0, nullptr) : nullptr;
+    HeartsPlayout policy;
+    policy.setSeed(static_cast<uint32_t>(time(nullptr)));
+    for (int s = 0; s < samples && !(cancel && cancel->isCancelled()); s++) {
+        double prob;
+        HeartsGameState* world = static_cast<HeartsGameState*>(ii->getGameState(prob));
+        if (!world) {
+            continue;
+        }
+        if (world->getNextPlayerNum() == who) {
+            // getMoves lists one card of each run of equivalent ones, so
+            // every card of a listed suit is legal, except a queen of
+            // spades the first trick rule held back
+            Move* moves = world->getMoves();
+            bool suits[4] = {false, false, false, false};
+            std::set<card> listed;
+            for (Move* m = moves; m; m = m->next) {
+                card c = static_cast<CardMove*>(m)->c;
+                suits[Deck::getsuit(c)] = true;
+                listed.insert(c);
+            }
+            world->freeMove(moves);
+            bool queen_barred = (state_data.rules & kQueenPenalty) && (state_data.rules & kNoQueenFirstTrick) &&
+                (world->getCurrTrickNum() == 0) && !listed.count(queen);
+            for (int suit = 0; suit < 4; suit++) {
+                for (int rank = 0; suits[suit] && rank < 13; rank++) {
+                    card c = Deck::getcard(suit, rank);
+                    if (world->cards[who].has(c) && !(queen_barred && c == queen)) {
+                        legal[c]++;
+                    }
+                }
+            }
+            if (weighted) {
+                Move* m = policy.ChooseMove(world, 0);
+                chosen[static_cast<CardMove*>(m)->c]++;
+                choices++;
+                world->freeMove(m);
+            }
+        }
+        delete world;
+    }
+    delete ii;
+    release_engine(config, state_data.rules, std::move(engine));
+
+    std::vector<CardWeight> cards;
+    for (const auto& entry : legal) {
+        double weight = weighted ? static_cast<double>(chosen[entry.first]) / choices : 1.0 / legal.size();
+        cards.push_back(CardWeight{entry.first, weight});
+    }
+    std::stable_sort(cards.begin(), cards.end(), [&legal](const CardWeight& a, const CardWeight& b) {
+        if (a.weight != b.weight) {
+            return a.weight > b.weight;
+        }
+        return legal[a.c] > legal[b.c];
+    });
+    return cards;
+}
+
+Player* AIRequestHandler::create_player(const AIConfig& config, HeartsGameState* game, int rules) {
+    if (!config.difficulty.empty()) {
+        // a preset decides the search, or that there is none
+        tHeartsDifficulty level;
+        if (!getDifficulty(config.difficulty.c_str(), level)) {
+            return nullptr;
+        }
+        Player* player = newDifficultyPlayer(level, rules);
+        iiMonteCarlo* search = search_of(player);
+        if (search && config.use_threads) {
+            search->setUseThreads(true);
+        }
+        if (search) {
+            static_cast<SimpleHeartsPlayer*>(player)->setPassEvaluator(&shared_pass_evaluator());
+        }
+        if (game) {
+            player->setGameState(game);
+        }
+        return player;
+    }
+
     double C = 0.4;  // UCT exploration constant
-    int worlds = 30;  // Number of world models for iiMonteCarlo
-    int sims_per_world = std::max(1, config.simulations / worlds);
+    int worlds = kWorlds;
+    int sims_per_world = world_simulations(config);
 
-    // Create UCT search with playout module
+    // Create UCT search with playout module; the common rule sets get a
+    // playout compiled for them, anything else the generic one
     UCT* uct = new UCT(sims_per_world, C);
-    uct->setPlayoutModule(new HeartsPlayout());
+    uct->setPlayoutModule(newHeartsPlayout(rules));
     uct->setEpsilonPlayout(config.epsilon);
+    uct->setUseHH(config.mast);
+    uct->setUseRAVE(config.rave);
+    if (config.puct > 0) {
+        uct->setPriorModule(&shared_move_prior(), config.puct);
+    }
 
     // Wrap UCT in iiMonteCarlo for proper game state handling
     iiMonteCarlo* iimc = new iiMonteCarlo(uct, worlds);
@@ -249,6 +755,7 @@ Player* AIRequestHandler::create_player(const AIConfig& config, HeartsGameState*
 
     // Set model level for opponent modeling
     player->setModelLevel(2);
+    player->setPassEvaluator(&shared_pass_evaluator());
 
     // Assign game state to player if provided
     if (game) {
@@ -272,18 +779,21 @@ card AIRequestHandler::compute_ai_move(HeartsGameState* game, Player* player) {
         }
     }
 
-    // Extract card from move
+    // Extract card from move; the game is pooled, so its moves go back to it
     CardMove* card_move = dynamic_cast<CardMove*>(move);
     if (!card_move) {
+        game->freeMove(move);
         throw std::runtime_error("Invalid move type returned by AI");
     }
-
-    return card_move->c;
+    card c = card_move->c;
+    game->freeMove(move);
+    return c;
 }
 
-std::string AIRequestHandler::handle_play_one_move(const std::string& json_request) {
-    HeartsGameState* game = nullptr;
-    Player* player = nullptr;
+std::string AIRequestHandler::handle_play_one_move(const std::string& json_request, const CancelToken* cancel) {
+    // requests run concurrently; each search gets its own engine context
+    SearchContext context;
+    SearchContext::Scope scope(context);
 
     try {
         auto start_time = std::chrono::high_resolution_clock::now();
@@ -317,96 +827,22 @@ std::string AIRequestHandler::handle_play_one_move(const std::string& json_reque
         std::cout << "[DEBUG] Using fast defaults: sims=" << config.simulations
                   << ", type=" << config.player_type << std::endl;
 
-        // Create game state
-        game = new HeartsGameState(static_cast<int>(time(nullptr)));
-
-        // Create the AI player
-        player = create_player(config, nullptr);
-        if (!player) {
-            delete game;
+        // Get the AI player, already seated in its game
+        std::unique_ptr<Engine> engine = acquire_engine(config, state_data.rules);
+        if (!engine) {
             return JsonProtocol::format_error("AI_CONFIG_ERROR", "Failed to create AI player");
         }
-
-        // Add players to game (AI player is always player 0)
-        for (int i = 0; i < 4; i++) {
-            if (i == 0) {
-                game->addPlayer(player);
-            } else {
-                game->addPlayer(new Player(0));
-            }
-        }
-
-        player->setGameState(game);
-        game->Reset();
-
-        // Set up the game state from input data
-        // Only current player's hand is provided (always player 0)
-        for (int p = 0; p < 4; p++) {
-            game->cards[p].reset();
-            game->original[p].reset();
-        }
-        // Set current player's hand (player 0)
-        for (card c : state_data.player_hand) {
-            game->cards[0].set(c);
-            game->original[0].set(c);
+        HeartsGameState* game = engine->game;
+        if (iiMonteCarlo* search = search_of(engine->player)) {
+            search->setCancelToken(cancel);
         }
 
-        game->setPassDir(state_data.pass_direction);
-        // Set first player based on trick lead if there's a current trick,
-        // otherwise default to player 0
-        int first_player = state_data.current_trick_cards.empty() ? 0 : state_data.trick_lead_player;
-        game->setFirstPlayer(first_player);
-        game->setRules(state_data.rules);
-
-        // setFirstPlayer with kLead2Clubs may override currPlr to 0 when passDir != kHold
-        // We need to reset currPlr to the trick lead player before applying current trick moves
-        if (!state_data.current_trick_cards.empty()) {
-            game->currPlr = state_data.trick_lead_player;
-        }
-
-        for (int p = 0; p < 4; p++) {
-            for (card c : state_data.played_cards[p]) {
-                game->taken[p].set(c);
-                game->allplayed.set(c);
-            }
-        }
-
-        // Replay trick history: add cards to hands and apply moves
-        for (const CompletedTrick& trick : state_data.trick_history) {
-            // Set currPlr to the lead player for this trick
-            game->currPlr = trick.lead_player;
-            // First, add all cards in this trick to respective players' hands
-            for (const TrickCard& tc : trick.cards) {
-                game->cards[tc.player].set(tc.c);
-                game->original[tc.player].set(tc.c);
-            }
-            // Then apply all moves in order
-            for (const TrickCard& tc : trick.cards) {
-                CardMove* move = new CardMove(tc.c, tc.player);
-                game->ApplyMove(move);
-                delete move;
-            }
-        }
-
-        // For current trick cards, we need to add them to respective players' hands
-        // before applying moves (ApplyMove checks if player has the card)
-        for (const TrickCard& tc : state_data.current_trick_cards) {
-            game->cards[tc.player].set(tc.c);
-            game->original[tc.player].set(tc.c);
-        }
-
-        // Now apply the current trick moves
-        for (const TrickCard& tc : state_data.current_trick_cards) {
-            CardMove* move = new CardMove(tc.c, tc.player);
-            game->ApplyMove(move);
-            delete move;
-        }
+        load_game_state(game, state_data);
 
         // Get legal moves
         Move* legal_moves = game->getMoves();
         if (!legal_moves) {
-            cleanup_player(player);
-            delete game;
+            release_engine(config, state_data.rules, std::move(engine));
             return JsonProtocol::format_error("NO_LEGAL_MOVES", "No legal moves available");
         }
 
@@ -421,50 +857,84 @@ std::string AIRequestHandler::handle_play_one_move(const std::string& json_reque
             CardMove* card_move = dynamic_cast<CardMove*>(legal_moves);
             move = card_move->c;
             std::cout << "[DEBUG] Single legal move, skipping AI" << std::endl;
-        } else {
+        }
+        game->freeMove(legal_moves);
+        if (num_moves > 1) {
             std::cout << "[DEBUG] Running AI for " << num_moves << " options..." << std::endl;
-            move = compute_ai_move(game, player);
+            move = compute_ai_move(game, engine->player);
         }
 
         auto end_time = std::chrono::high_resolution_clock::now();
         double time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
 
+        if (cancel && cancel->isCancelled()) {
+            std::cout << "[DEBUG] Search cancelled after " << time_ms << " ms" << std::endl;
+            release_engine(config, state_data.rules, std::move(engine));
+            return JsonProtocol::format_error("CANCELLED", "The search was cancelled");
+        }
+
         std::cout << "[DEBUG] Chosen move: " << card_to_string(move) << std::endl;
         std::cout << "[DEBUG] Computation time: " << time_ms << " ms" << std::endl;
         std::cout << "============================================\n" << std::endl;
 
-        // Format response (always player 0)
-        std::string response = JsonProtocol::format_move_response(move, 0, time_ms);
-
-        if (player) cleanup_player(player);
-        delete game;
+        release_engine(config, state_data.rules, std::move(engine));
 
-        return response;
+        // Format response (always player 0)
+        return JsonProtocol::format_move_response(move, 0, time_ms);
 
     } catch (const json::exception& e) {
-        if (player) cleanup_player(player);
-        if (game) delete game;
         return JsonProtocol::format_error("PARSE_ERROR", std::string("JSON parse error: ") + e.what());
+    } catch (const std::invalid_argument& e) {
+        return JsonProtocol::format_error("INVALID_GAME_STATE", e.what());
     } catch (const std::exception& e) {
-        if (player) cleanup_player(player);
-        if (game) delete game;
         return JsonProtocol::format_error("INTERNAL_ERROR", std::string("Internal error: ") + e.what());
     } catch (...) {
-        if (player) cleanup_player(player);
-        if (game) delete game;
         return JsonProtocol::format_error("UNKNOWN_ERROR", "An unknown error occurred");
     }
 }
 
-void AIRequestHandler::cleanup_player(Player* player) {
-    // Note: Don't delete the player itself - it's in the game's player list
-    // and will be deleted when the game is deleted.
-    // We only need to delete the algorithm which the player owns.
-    if (player) {
-        Algorithm* alg = player->getAlgorithm();
-        if (alg) {
-            delete alg;
+std::string AIRequestHandler::handle_hand_strength(const std::string& json_request) {
+    try {
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        json request_json = json::parse(json_request);
+        GameStateData state_data = JsonProtocol::parse_game_state(request_json.at("game_state"));
+
+        Deck hand, played;
+        for (card c : state_data.player_hand) {
+            hand.set(c);
         }
+        for (const CompletedTrick& trick : state_data.trick_history) {
+            for (const TrickCard& tc : trick.cards) {
+                played.set(tc.c);
+            }
+        }
+        for (const TrickCard& tc : state_data.current_trick_cards) {
+            played.set(tc.c);
+        }
+        for (const std::vector<card>& cards : state_data.played_cards) {
+            for (card c : cards) {
+                played.set(c);
+            }
+        }
+        if ((hand.getHand() & played.getHand()) != 0) {
+            throw std::invalid_argument("A card in player_hand has already been played");
+        }
+
+        HandStrength strength = evaluateHand(hand, played);
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        double time_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        return JsonProtocol::format_hand_strength(strength, time_ms);
+
+    } catch (const json::exception& e) {
+        return JsonProtocol::format_error("PARSE_ERROR", std::string("JSON parse error: ") + e.what());
+    } catch (const std::invalid_argument& e) {
+        return JsonProtocol::format_error("INVALID_GAME_STATE", e.what());
+    } catch (const std::exception& e) {
+        return JsonProtocol::format_error("INTERNAL_ERROR", std::string("Internal error: ") + e.what());
+    } catch (...) {
+        return JsonProtocol::format_error("UNKNOWN_ERROR", "An unknown error occurred");
     }
 }
 
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include "EnginePool.h"
 #include "JsonProtocol.h"
 #include "../Hearts.h"
 #include "../iiMonteCarlo.h"
@@ -11,26 +13,88 @@
 namespace hearts {
 namespace server {
 
+class InFlightSearches;
+class Ponderer;
+class SpeculationCache;
+
+// Opponents' cards that follow one of player 0's, up to its next decision,
+// and how many sampled worlds played them
+struct ReplyLine {
+    std::vector<TrickCard> plays;
+    int count;
+};
+
+// A card the player to move may play, and how likely it is
+struct CardWeight {
+    card c;
+    double weight;
+};
+
 class AIRequestHandler {
 public:
     AIRequestHandler();
     ~AIRequestHandler();
 
-    // Main entry point for handling move requests
-    std::string handle_get_move(const std::string& json_request);
+    // Main entry point for handling move requests. The search stops early,
+    // answering CANCELLED, once cancel is set. With an observer, which sees
+    // the best move as each world finishes, a stopped search still answers
+    // with its best move so far. With a ponderer, requests carrying a
+    // session_id are answered from what was pondered for them; states in
+    // speculated are answered from there. With in_flight, a request without
+    // an observer that matches one already being searched (same state and
+    // config, and with a hand_budget the same session) waits for that
+    // search's move instead of searching.
+    std::string handle_get_move(const std::string& json_request, const CancelToken* cancel = nullptr,
+                                iiMonteCarloObserver* observer = nullptr, Ponderer* ponderer = nullptr,
+                                SpeculationCache* speculated = nullptr, InFlightSearches* in_flight = nullptr);
+
+    // Speculative endpoint - with an opponent to move, search player 0's
+    // answer to each card they may play, in parallel, and cache the answers
+    std::string handle_speculate(const std::string& json_request, SpeculationCache& cache,
+                                 const CancelToken* cancel = nullptr);
 
     // Simplified endpoint - play exactly one move with minimal config
-    std::string handle_play_one_move(const std::string& json_request);
+    std::string handle_play_one_move(const std::string& json_request, const CancelToken* cancel = nullptr);
+
+    // Suit and hand strength of player 0's hand, scored against the cards
+    // still out (HeartsStrength.h); no search
+    std::string handle_hand_strength(const std::string& json_request);
+
+    // Search a decision outside a request, starting from and adding to
+    // worlds; throws when there is no legal move
+    card search_move(const GameStateData& state_data, const AIConfig& config, const CancelToken* cancel,
+                     iiMonteCarloWorlds* worlds);
+
+    // The lines of opponent cards that most often follow player 0 playing
+    // `played`, over samples worlds played out with the playout policy,
+    // most frequent first. None for pass decisions.
+    std::vector<ReplyLine> likely_replies(const GameStateData& state_data, card played, const AIConfig& config,
+                                          int samples, const CancelToken* cancel);
 
 private:
     // Create AI player with given configuration
-    Player* create_player(const AIConfig& config, HeartsGameState* game);
+    Player* create_player(const AIConfig& config, HeartsGameState* game, int rules);
+
+    // A player for config seated in its own game: an idle one from the pool,
+    // or a new one. Null when config names no player.
+    std::unique_ptr<Engine> acquire_engine(const AIConfig& config, int rules);
+
+    // Clear what this request set on the engine and keep it for the next
+    void release_engine(const AIConfig& config, int rules, std::unique_ptr<Engine> engine);
+
+    // Set the engine's game up from the request in one pass, without dealing
+    // or replaying tricks; throws std::invalid_argument if it isn't a
+    // consistent hand
+    void load_game_state(HeartsGameState* game, const GameStateData& state_data);
+
+    // The cards player who (to move) may play, over samples worlds, most
+    // likely first: weighted by how often the playout policy plays them,
+    // or all equally likely
+    std::vector<CardWeight> likely_cards(const GameStateData& state_data, int who, const AIConfig& config,
+                                         int samples, bool weighted, const CancelToken* cancel);
 
     // Compute AI move using the created player
     card compute_ai_move(HeartsGameState* game, Player* player);
-
-    // Clean up algorithm resources (player is owned by game)
-    void cleanup_player(Player* player);
 };
 
 } // namespace server
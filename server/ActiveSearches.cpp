@@ -0,0 +1,95 @@
+#include "ActiveSearches.h"
+#include <chrono>
+#include <iostream>
+
+namespace hearts {
+namespace server {
+
+// how often the watchdog polls client connections
+static const std::chrono::milliseconds kPollInterval(5);
+
+ActiveSearches::ActiveSearches()
+    : next_key_(0), stopping_(false) {
+    watchdog_ = std::thread(&ActiveSearches::watch, this);
+}
+
+ActiveSearches::~ActiveSearches() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    watchdog_.join();
+}
+
+ActiveSearches::Registration::Registration(ActiveSearches& searches, const std::string& id,
+                                           CancelToken* cancel,
+                                           std::function<bool()> connection_closed)
+    : searches_(searches) {
+    Entry entry;
+    entry.id = id;
+    entry.cancel = cancel;
+    entry.connection_closed = connection_closed;
+    key_ = searches_.add(entry);
+}
+
+ActiveSearches::Registration::~Registration() {
+    searches_.remove(key_);
+}
+
+uint64_t ActiveSearches::add(Entry entry) {
+    uint64_t key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        key = next_key_++;
+        entries_[key] = entry;
+    }
+    wake_.notify_all();
+    return key;
+}
+
+void ActiveSearches::remove(uint64_t key) {
+    // the watchdog polls under the lock, so once this returns it is no longer
+    // touching the request's connection
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(key);
+}
+
+bool ActiveSearches::cancel(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool found = false;
+    for (auto& e : entries_) {
+        if (!id.empty() && e.second.id == id) {
+            e.second.cancel->cancel();
+            found = true;
+        }
+    }
+    return found;
+}
+
+size_t ActiveSearches::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void ActiveSearches::watch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (entries_.empty()) {
+            wake_.wait(lock);
+            continue;
+        }
+        for (auto& e : entries_) {
+            Entry& entry = e.second;
+            if (entry.connection_closed && !entry.cancel->isCancelled() && entry.connection_closed()) {
+                std::cout << "[DEBUG] Client disconnected, cancelling search"
+                          << (entry.id.empty() ? "" : " " + entry.id) << std::endl;
+                entry.cancel->cancel();
+            }
+        }
+        wake_.wait_for(lock, kPollInterval);
+    }
+}
+
+} // namespace server
+} // namespace hearts
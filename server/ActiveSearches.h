@@ -0,0 +1,64 @@
+#ifndef ACTIVE_SEARCHES_H
+#define ACTIVE_SEARCHES_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../SearchContext.h"
+
+namespace hearts {
+namespace server {
+
+// The searches currently running in request threads. A search is cancelled
+// by DELETE /api/move/{id}, or by the watchdog thread once its client has
+// closed the connection.
+class ActiveSearches {
+public:
+    ActiveSearches();
+    ~ActiveSearches();
+
+    // Registers a search for the lifetime of this object. The id may be empty
+    // (not cancellable by id); connection_closed may be null (not watched).
+    class Registration {
+    public:
+        Registration(ActiveSearches& searches, const std::string& id, CancelToken* cancel,
+                     std::function<bool()> connection_closed);
+        ~Registration();
+        Registration(const Registration&) = delete;
+        Registration& operator=(const Registration&) = delete;
+    private:
+        ActiveSearches& searches_;
+        uint64_t key_;
+    };
+
+    // Cancels every search registered under id; false if there were none
+    bool cancel(const std::string& id);
+    size_t size() const;
+
+private:
+    struct Entry {
+        std::string id;
+        CancelToken* cancel;
+        std::function<bool()> connection_closed;
+    };
+
+    uint64_t add(Entry entry);
+    void remove(uint64_t key);
+    void watch();
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::map<uint64_t, Entry> entries_;
+    uint64_t next_key_;
+    bool stopping_;
+    std::thread watchdog_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
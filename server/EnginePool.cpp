@@ -0,0 +1,77 @@
+#include "EnginePool.h"
+
+#include <algorithm>
+
+namespace hearts {
+namespace server {
+
+Engine::~Engine() {
+    // the game deletes the players; the algorithm is the player's own
+    delete player->getAlgorithm();
+    delete game;
+}
+
+EnginePool::EnginePool(size_t per_key, size_t capacity)
+    : per_key_(std::max<size_t>(1, per_key)), capacity_(std::max<size_t>(1, capacity)), size_(0), clock_(0),
+      hits_(0), misses_(0) {
+}
+
+std::unique_ptr<Engine> EnginePool::acquire(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = idle_.find(key);
+    if (it == idle_.end() || it->second.engines.empty()) {
+        misses_++;
+        return nullptr;
+    }
+    std::unique_ptr<Engine> engine = std::move(it->second.engines.back());
+    it->second.engines.pop_back();
+    it->second.used = ++clock_;
+    size_--;
+    hits_++;
+    return engine;
+}
+
+void EnginePool::release(const std::string& key, std::unique_ptr<Engine> engine) {
+    std::unique_ptr<Engine> dropped;  // freed once the lock is released
+    std::lock_guard<std::mutex> lock(mutex_);
+    Idle& idle = idle_[key];
+    idle.used = ++clock_;
+    if (idle.engines.size() >= per_key_) {
+        dropped = std::move(engine);
+        return;
+    }
+    if (size_ >= capacity_) {
+        auto oldest = idle_.end();
+        for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+            if (!it->second.engines.empty() && (oldest == idle_.end() || it->second.used < oldest->second.used)) {
+                oldest = it;
+            }
+        }
+        dropped = std::move(oldest->second.engines.back());
+        oldest->second.engines.pop_back();
+        if (oldest->second.engines.empty() && oldest->first != key) {
+            idle_.erase(oldest);
+        }
+        size_--;
+    }
+    idle.engines.push_back(std::move(engine));
+    size_++;
+}
+
+size_t EnginePool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+uint64_t EnginePool::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t EnginePool::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+} // namespace server
+} // namespace hearts
@@ -0,0 +1,66 @@
+#ifndef ENGINE_POOL_H
+#define ENGINE_POOL_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../Hearts.h"
+
+namespace hearts {
+namespace server {
+
+// A player seated at seat 0 of its own game, with placeholder opponents in
+// the other seats. The game owns the players; the player's algorithm is
+// freed with the engine.
+struct Engine {
+    Engine(HeartsGameState* g, Player* p) : game(g), player(p) {}
+    ~Engine();
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    HeartsGameState* game;
+    Player* player;
+};
+
+// Engines kept between requests, keyed by the configuration they were built
+// for, so a request picks up a seated player instead of building its search
+// again. At most per_key idle engines of one configuration are kept and
+// capacity in all; past that the configuration used longest ago gives one up.
+class EnginePool {
+public:
+    explicit EnginePool(size_t per_key = 8, size_t capacity = 64);
+
+    // an idle engine built for key, or null when there is none
+    std::unique_ptr<Engine> acquire(const std::string& key);
+    // keep engine for the next request with key; the caller has cleared
+    // what was set for its own request
+    void release(const std::string& key, std::unique_ptr<Engine> engine);
+
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Idle {
+        std::vector<std::unique_ptr<Engine>> engines;
+        uint64_t used;
+    };
+
+    mutable std::mutex mutex_;
+    size_t per_key_;
+    size_t capacity_;
+    size_t size_;
+    uint64_t clock_;
+    uint64_t hits_;
+    uint64_t misses_;
+    std::map<std::string, Idle> idle_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
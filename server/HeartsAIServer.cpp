@@ -1,6 +1,11 @@
 #include "HeartsAIServer.h"
 #include "AIRequestHandler.h"
+#include "ActiveSearches.h"
+#include "InFlightSearches.h"
 #include "JsonProtocol.h"
+#include "MoveStream.h"
+#include "Ponderer.h"
+#include "SpeculationCache.h"
 
 #ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
@@ -10,13 +15,19 @@
 
 #include "../third_party/httplib.h"
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 namespace hearts {
 namespace server {
 
-HeartsAIServer::HeartsAIServer(const std::string& host, int port)
-    : host_(host), port_(port), server_(new httplib::Server()) {
+HeartsAIServer::HeartsAIServer(const std::string& host, int port, unsigned ponder_threads)
+    : host_(host), port_(port), server_(new httplib::Server()), searches_(new ActiveSearches()),
+      in_flight_(new InFlightSearches()),
+      ponderer_(new Ponderer(ponder_threads ? ponder_threads : std::thread::hardware_concurrency())),
+      speculation_(new SpeculationCache()) {
     setup_routes();
 }
 
@@ -30,17 +41,36 @@ void HeartsAIServer::setup_routes() {
         res.set_content(JsonProtocol::format_health(), "application/json");
     });
 
-    // Get AI move endpoint
-    server_->Post("/api/move", [](const httplib::Request& req, httplib::Response& res) {
+    // Search counts: /api/move searches run, and requests answered by
+    // another request's search
+    server_->Get("/api/stats", [this](const httplib::Request& req, httplib::Response& res) {
+        res.set_content(JsonProtocol::format_search_stats(in_flight_->searches(), in_flight_->coalesced()),
+                        "application/json");
+    });
+
+    // Get AI move endpoint. The search is cancelled if the client disconnects,
+    // or by DELETE /api/move/{id} when the request carried an X-Request-Id.
+    // Requests with a session_id use, and may start, pondering; states
+    // searched by /api/speculate are answered from its cache. A request
+    // identical to one being searched waits for that search's answer; a
+    // shared search stops only once all its requests are cancelled.
+    server_->Post("/api/move", [this](const httplib::Request& req, httplib::Response& res) {
         std::string response;
         try {
+            CancelToken cancel;
+            ActiveSearches::Registration search(*searches_, req.get_header_value("X-Request-Id"),
+                                                &cancel, req.is_connection_closed);
+            Ponderer::Foreground foreground(*ponderer_);
             AIRequestHandler handler;
-            response = handler.handle_get_move(req.body);
+            response = handler.handle_get_move(req.body, &cancel, nullptr, ponderer_.get(), speculation_.get(),
+                                               in_flight_.get());
 
             // Check if it's an error response
             try {
                 json resp_json = json::parse(response);
-                if (resp_json.value("status", "") == "error") {
+                if (resp_json.value("error_code", "") == "CANCELLED") {
+                    res.status = 409;
+                } else if (resp_json.value("status", "") == "error") {
                     res.status = 400;
                 }
             } catch (...) {
@@ -60,10 +90,97 @@ void HeartsAIServer::setup_routes() {
         res.set_content(response, "application/json");
     });
 
+    // Streaming move endpoint: Server-Sent Events with the best move so far
+    // every interval_ms while the /api/move search runs, then the answer.
+    // Closing the stream or DELETE /api/move/{id} stops the search early.
+    server_->Post("/api/move/stream", [this](const httplib::Request& req, httplib::Response& res) {
+        int interval_ms = 250;
+        try {
+            interval_ms = json::parse(req.body).value("interval_ms", 250);
+        } catch (...) {
+            // the search reports the parse error as its final event
+        }
+        interval_ms = std::max(10, std::min(interval_ms, 10000));
+
+        std::shared_ptr<Ponderer::Foreground> foreground = std::make_shared<Ponderer::Foreground>(*ponderer_);
+        std::shared_ptr<MoveStream> stream = std::make_shared<MoveStream>(req.body, interval_ms);
+        // no connection watch: the request's socket outlives this handler, and
+        // a write to a closed stream fails within one interval anyway
+        std::shared_ptr<ActiveSearches::Registration> search = std::make_shared<ActiveSearches::Registration>(
+            *searches_, req.get_header_value("X-Request-Id"), stream->cancel_token(), nullptr);
+        stream->start();
+
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [stream](size_t, httplib::DataSink& sink) {
+                std::string event;
+                bool more = stream->next_event(event);
+                if (!sink.write(event.data(), event.size())) {
+                    stream->cancel_token()->cancel();
+                    return false;
+                }
+                if (!more) {
+                    sink.done();
+                }
+                return true;
+            },
+            [stream, search, foreground](bool) {
+                stream->cancel_token()->cancel();
+            });
+    });
+
+    // Speculative endpoint: with an opponent to move, player 0's answer to
+    // each card they may play, searched in parallel and cached for /api/move.
+    // Cancellable like /api/move.
+    server_->Post("/api/speculate", [this](const httplib::Request& req, httplib::Response& res) {
+        CancelToken cancel;
+        ActiveSearches::Registration search(*searches_, req.get_header_value("X-Request-Id"),
+                                            &cancel, req.is_connection_closed);
+        Ponderer::Foreground foreground(*ponderer_);
+        AIRequestHandler handler;
+        std::string response = handler.handle_speculate(req.body, *speculation_, &cancel);
+
+        try {
+            json resp_json = json::parse(response);
+            if (resp_json.value("error_code", "") == "CANCELLED") {
+                res.status = 409;
+            } else if (resp_json.value("status", "") == "error") {
+                res.status = 400;
+            }
+        } catch (...) {
+            res.status = 500;
+        }
+
+        res.set_content(response, "application/json");
+    });
+
     // Play one move endpoint - simplified interface with default AI config
-    server_->Post("/api/play-one", [](const httplib::Request& req, httplib::Response& res) {
+    server_->Post("/api/play-one", [this](const httplib::Request& req, httplib::Response& res) {
+        CancelToken cancel;
+        ActiveSearches::Registration search(*searches_, req.get_header_value("X-Request-Id"),
+                                            &cancel, req.is_connection_closed);
+        Ponderer::Foreground foreground(*ponderer_);
+        AIRequestHandler handler;
+        std::string response = handler.handle_play_one_move(req.body, &cancel);
+
+        try {
+            json resp_json = json::parse(response);
+            if (resp_json.value("error_code", "") == "CANCELLED") {
+                res.status = 409;
+            } else if (resp_json.value("status", "") == "error") {
+                res.status = 400;
+            }
+        } catch (...) {
+            res.status = 500;
+        }
+
+        res.set_content(response, "application/json");
+    });
+
+    // Hand strength endpoint - suit danger/control, Q of spades and moon analysis, no search
+    server_->Post("/api/strength", [](const httplib::Request& req, httplib::Response& res) {
         AIRequestHandler handler;
-        std::string response = handler.handle_play_one_move(req.body);
+        std::string response = handler.handle_hand_strength(req.body);
 
         try {
             json resp_json = json::parse(response);
@@ -77,15 +194,57 @@ void HeartsAIServer::setup_routes() {
         res.set_content(response, "application/json");
     });
 
+    // Cancel a running search request by its X-Request-Id. Taking
+    // a content reader stops httplib from waiting for a body that DELETE
+    // requests without Content-Length never send.
+    server_->Delete(R"(/api/move/([^/]+))", [this](const httplib::Request& req, httplib::Response& res,
+                                                   const httplib::ContentReader&) {
+        std::string id = req.matches[1];
+        if (searches_->cancel(id)) {
+            res.set_content(JsonProtocol::format_cancelled(id), "application/json");
+        } else {
+            res.status = 404;
+            res.set_content(JsonProtocol::format_error("NOT_FOUND", "No running search with id " + id),
+                            "application/json");
+        }
+    });
+
     // CORS preflight handling
     server_->Options("/api/move", [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "POST, OPTIONS");
-        res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, X-Request-Id");
+        res.status = 204;
+    });
+
+    server_->Options("/api/move/stream", [](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Access-Control-Allow-Methods", "POST, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, X-Request-Id");
+        res.status = 204;
+    });
+
+    server_->Options(R"(/api/move/([^/]+))", [](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Access-Control-Allow-Methods", "DELETE, OPTIONS");
+        res.status = 204;
+    });
+
+    server_->Options("/api/speculate", [](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Access-Control-Allow-Methods", "POST, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, X-Request-Id");
         res.status = 204;
     });
 
     server_->Options("/api/play-one", [](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Access-Control-Allow-Methods", "POST, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, X-Request-Id");
+        res.status = 204;
+    });
+
+    server_->Options("/api/strength", [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "POST, OPTIONS");
         res.set_header("Access-Control-Allow-Headers", "Content-Type");
@@ -121,16 +280,23 @@ void HeartsAIServer::setup_routes() {
     });
 }
 
-void HeartsAIServer::run() {
+bool HeartsAIServer::run() {
     std::cout << "Hearts AI Server starting on " << host_ << ":" << port_ << std::endl;
     std::cout << "Endpoints:" << std::endl;
     std::cout << "  GET  /api/health   - Health check" << std::endl;
+    std::cout << "  GET  /api/stats    - Searches run and searches saved by sharing" << std::endl;
     std::cout << "  POST /api/move     - Compute AI move (full config)" << std::endl;
+    std::cout << "  POST /api/move/stream - Compute AI move, streaming progress (SSE)" << std::endl;
+    std::cout << "  POST /api/speculate - Answers to each card the opponent to move may play" << std::endl;
     std::cout << "  POST /api/play-one - Play one move (default config)" << std::endl;
+    std::cout << "  POST /api/strength - Suit and hand strength of a hand (no search)" << std::endl;
+    std::cout << "  DELETE /api/move/{id} - Cancel a running search" << std::endl;
 
     if (!server_->listen(host_.c_str(), port_)) {
         std::cerr << "Failed to start server on " << host_ << ":" << port_ << std::endl;
+        return false;
     }
+    return true;
 }
 
 void HeartsAIServer::stop() {
@@ -12,13 +12,19 @@ namespace httplib {
 namespace hearts {
 namespace server {
 
+class ActiveSearches;
+class InFlightSearches;
+class Ponderer;
+class SpeculationCache;
+
 class HeartsAIServer {
 public:
-    HeartsAIServer(const std::string& host = "0.0.0.0", int port = 8080);
+    // ponder_threads 0 ponders on every core
+    HeartsAIServer(const std::string& host = "0.0.0.0", int port = 8080, unsigned ponder_threads = 0);
     ~HeartsAIServer();
 
-    // Start the server (blocking)
-    void run();
+    // Start the server (blocking); false if it couldn't listen
+    bool run();
 
     // Stop the server
     void stop();
@@ -33,6 +39,10 @@ private:
     std::string host_;
     int port_;
     std::unique_ptr<httplib::Server> server_;
+    std::unique_ptr<ActiveSearches> searches_;
+    std::unique_ptr<InFlightSearches> in_flight_;
+    std::unique_ptr<Ponderer> ponderer_;
+    std::unique_ptr<SpeculationCache> speculation_;
 };
 
 } // namespace server
@@ -0,0 +1,133 @@
+#include "InFlightSearches.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace hearts {
+namespace server {
+
+// how often a waiting request checks its own cancel token, and the
+// watchdog those of every request in a flight
+static const std::chrono::milliseconds kPollInterval(5);
+
+InFlightSearches::InFlightSearches()
+    : searches_(0), coalesced_(0), stopping_(false) {
+    watchdog_ = std::thread(&InFlightSearches::watch, this);
+}
+
+InFlightSearches::~InFlightSearches() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    watchdog_.join();
+}
+
+InFlightSearches::Outcome InFlightSearches::join(const std::string& key, const CancelToken* cancel, card& move) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        auto it = flights_.find(key);
+        if (it == flights_.end()) {
+            std::shared_ptr<Flight> flight = std::make_shared<Flight>();
+            flight->waiting.push_back(cancel);
+            flights_[key] = flight;
+            searches_++;
+            wake_.notify_all();
+            return kLead;
+        }
+        std::shared_ptr<Flight> flight = it->second;
+        flight->waiting.push_back(cancel);
+        while (!flight->done) {
+            if (cancel && cancel->isCancelled()) {
+                // the token goes away with the request
+                flight->waiting.erase(std::find(flight->waiting.begin(), flight->waiting.end(), cancel));
+                return kCancelled;
+            }
+            finished_.wait_for(lock, kPollInterval);
+        }
+        if (flight->found) {
+            move = flight->move;
+            coalesced_++;
+            return kAnswered;
+        }
+    }
+}
+
+void InFlightSearches::finish(const std::string& key, bool found, card move) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if (it == flights_.end()) {
+            return;
+        }
+        it->second->done = true;
+        it->second->found = found;
+        it->second->move = move;
+        flights_.erase(it);
+    }
+    finished_.notify_all();
+}
+
+void InFlightSearches::watch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (flights_.empty()) {
+            wake_.wait(lock);
+            continue;
+        }
+        for (auto& f : flights_) {
+            Flight& flight = *f.second;
+            if (flight.cancel.isCancelled()) {
+                continue;
+            }
+            bool wanted = false;
+            for (const CancelToken* cancel : flight.waiting) {
+                if (!cancel || !cancel->isCancelled()) {
+                    wanted = true;
+                    break;
+                }
+            }
+            if (!wanted) {
+                std::cout << "[DEBUG] Every request for a shared search was cancelled, stopping it" << std::endl;
+                flight.cancel.cancel();
+            }
+        }
+        wake_.wait_for(lock, kPollInterval);
+    }
+}
+
+InFlightSearches::Lead::Lead(InFlightSearches& searches, const std::string& key)
+    : searches_(searches), key_(key), answered_(false) {
+    std::lock_guard<std::mutex> lock(searches_.mutex_);
+    auto it = searches_.flights_.find(key);
+    flight_ = (it != searches_.flights_.end()) ? it->second : std::make_shared<Flight>();
+}
+
+InFlightSearches::Lead::~Lead() {
+    if (!answered_) {
+        searches_.finish(key_, false, 0);
+    }
+}
+
+const CancelToken* InFlightSearches::Lead::cancel() const {
+    return &flight_->cancel;
+}
+
+void InFlightSearches::Lead::answer(card move) {
+    answered_ = true;
+    searches_.finish(key_, true, move);
+}
+
+uint64_t InFlightSearches::searches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return searches_;
+}
+
+uint64_t InFlightSearches::coalesced() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return coalesced_;
+}
+
+} // namespace server
+} // namespace hearts
@@ -0,0 +1,88 @@
+#ifndef IN_FLIGHT_SEARCHES_H
+#define IN_FLIGHT_SEARCHES_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../CardGameState.h"
+#include "../SearchContext.h"
+
+namespace hearts {
+namespace server {
+
+// The /api/move searches running right now, keyed by what they search
+// (JsonProtocol::state_key, which covers the config, and the session when
+// the search is charged to its hand budget). A request for a key that is
+// already being searched waits for that search and answers with its move
+// instead of starting another one. A search is cancelled only once the
+// request leading it and every request waiting on it have been: a watchdog
+// thread polls their cancel tokens.
+class InFlightSearches {
+    struct Flight;
+public:
+    InFlightSearches();
+    ~InFlightSearches();
+
+    enum Outcome {
+        kLead,      // nobody is searching key: the caller does, holding a Lead
+        kAnswered,  // another request searched key; move is its answer
+        kCancelled  // the caller's cancel was set while it waited
+    };
+
+    // If the search being waited for fails or is cancelled, the waiting
+    // requests go on as if it had never started: one of them leads next.
+    Outcome join(const std::string& key, const CancelToken* cancel, card& move);
+
+    // Ends a search begun by join; the requests waiting on it get the move
+    // passed to answer, or search for themselves if there was none.
+    class Lead {
+    public:
+        Lead(InFlightSearches& searches, const std::string& key);
+        ~Lead();
+        // The token to search with, rather than the leading request's own
+        const CancelToken* cancel() const;
+        void answer(card move);
+        Lead(const Lead&) = delete;
+        Lead& operator=(const Lead&) = delete;
+    private:
+        InFlightSearches& searches_;
+        std::string key_;
+        std::shared_ptr<Flight> flight_;
+        bool answered_;
+    };
+
+    // Searches started, and requests answered by another request's search
+    uint64_t searches() const;
+    uint64_t coalesced() const;
+
+private:
+    struct Flight {
+        bool done = false;
+        bool found = false;
+        card move = 0;
+        CancelToken cancel;                        // the search's
+        std::vector<const CancelToken*> waiting;   // the leader's and its followers'
+    };
+
+    void finish(const std::string& key, bool found, card move);
+    void watch();
+
+    mutable std::mutex mutex_;
+    std::condition_variable finished_;
+    std::condition_variable wake_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    uint64_t searches_;
+    uint64_t coalesced_;
+    bool stopping_;
+    std::thread watchdog_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
@@ -1,9 +1,22 @@
 #include "JsonProtocol.h"
+#include <algorithm>
 #include <chrono>
 
 namespace hearts {
 namespace server {
 
+// The player who takes a full trick: the highest card of the suit led
+static int trick_winner(const std::vector<TrickCard>& cards) {
+    const TrickCard* winner = &cards[0];
+    for (const TrickCard& tc : cards) {
+        if ((Deck::getsuit(tc.c) == Deck::getsuit(cards[0].c)) &&
+            (Deck::getrank(tc.c) < Deck::getrank(winner->c))) {
+            winner = &tc;
+        }
+    }
+    return winner->player;
+}
+
 // Parse card string like "AS", "10H", "2C" to internal card representation
 // Format: {rank}{suit} where suit is S/D/C/H
 card JsonProtocol::json_to_card(const json& j) {
@@ -52,6 +65,15 @@ json JsonProtocol::card_to_json(card c) {
     return std::string(ranks[rank]) + suits[suit];
 }
 
+json JsonProtocol::suit_to_json(int suit) {
+    static const char* suits[] = {"S", "D", "C", "H"};
+
+    if (suit < 0 || suit > 3) {
+        return nullptr;
+    }
+    return suits[suit];
+}
+
 std::vector<card> JsonProtocol::json_to_hand(const json& j) {
     std::vector<card> hand;
     for (const auto& card_json : j) {
@@ -199,12 +221,107 @@ AIConfig JsonProtocol::parse_ai_config(const json& j) {
         config.epsilon = ai.value("epsilon", 0.1);
         config.use_threads = ai.value("use_threads", true);
         config.player_type = ai.value("player_type", "safe_simple");
+        config.hand_budget = ai.value("hand_budget", 0);
+        config.difficulty = ai.value("difficulty", "");
+        config.mast = ai.value("mast", false);
+        config.rave = ai.value("rave", 0);
+        config.puct = ai.value("puct", 0.0);
     }
 
     return config;
 }
 
-std::string JsonProtocol::format_move_response(card c, int player, double time_ms) {
+std::string JsonProtocol::state_key(const GameStateData& state, const AIConfig& config) {
+    auto plays = [](const std::vector<TrickCard>& cards) {
+        json j = json::array();
+        for (const TrickCard& tc : cards) {
+            j.push_back({tc.player, tc.c});
+        }
+        return j;
+    };
+
+    // the cards each player has taken, however the request listed them
+    std::vector<std::vector<card>> taken(4);
+    json history = json::array();
+    for (const CompletedTrick& trick : state.trick_history) {
+        history.push_back({trick.lead_player, plays(trick.cards)});
+        if (trick.cards.size() == 4) {
+            int winner = trick_winner(trick.cards);
+            for (const TrickCard& tc : trick.cards) {
+                taken[winner].push_back(tc.c);
+            }
+        }
+    }
+    for (size_t p = 0; p < 4 && p < state.played_cards.size(); p++) {
+        taken[p].insert(taken[p].end(), state.played_cards[p].begin(), state.played_cards[p].end());
+    }
+    for (std::vector<card>& cards : taken) {
+        std::sort(cards.begin(), cards.end());
+        cards.erase(std::unique(cards.begin(), cards.end()), cards.end());
+    }
+    std::vector<card> hand = state.player_hand;
+    std::sort(hand.begin(), hand.end());
+
+    json key = {
+        {"hand", hand},
+        {"trick", plays(state.current_trick_cards)},
+        {"lead", state.current_trick_cards.empty() ? 0 : state.trick_lead_player},
+        {"history", history},
+        {"taken", taken},
+        {"pass", state.pass_direction},
+        {"rules", state.rules},
+        {"ai", {config.simulations, config.worlds, config.epsilon, config.player_type, config.hand_budget,
+                config.difficulty, config.mast, config.rave, config.puct}}
+    };
+    return key.dump();
+}
+
+GameStateData JsonProtocol::advance(const GameStateData& state, const TrickCard& play) {
+    GameStateData next = state;
+    if (play.player == 0) {
+        next.player_hand.erase(std::remove(next.player_hand.begin(), next.player_hand.end(), play.c),
+                               next.player_hand.end());
+    }
+    if (next.current_trick_cards.empty()) {
+        next.trick_lead_player = play.player;
+    }
+    next.current_trick_cards.push_back(play);
+    if (Deck::getsuit(play.c) == HEARTS) {
+        next.hearts_broken = true;
+    }
+    if (next.current_trick_cards.size() < 4) {
+        return next;
+    }
+
+    CompletedTrick trick;
+    trick.cards = next.current_trick_cards;
+    trick.lead_player = next.trick_lead_player;
+    trick.winner = trick_winner(trick.cards);
+    next.trick_history.push_back(trick);
+    // keep played_cards up to date for requests that list it
+    bool lists_played = false;
+    for (const std::vector<card>& cards : next.played_cards) {
+        lists_played = lists_played || !cards.empty();
+    }
+    if (lists_played) {
+        next.played_cards.resize(4);
+        for (const TrickCard& tc : trick.cards) {
+            next.played_cards[trick.winner].push_back(tc.c);
+        }
+    }
+    next.current_trick_cards.clear();
+    next.trick_lead_player = trick.winner;
+    return next;
+}
+
+int JsonProtocol::next_to_move(const GameStateData& state) {
+    if (state.current_trick_cards.empty()) {
+        return state.trick_lead_player;
+    }
+    return (state.trick_lead_player + static_cast<int>(state.current_trick_cards.size())) % 4;
+}
+
+std::string JsonProtocol::format_move_response(card c, int player, double time_ms, const json& extra) {
     json response = {
         {"status", "success"},
         {"move", {
@@ -213,6 +330,63 @@ std::string JsonProtocol::format_move_response(card c, int player, double time_m
         }},
         {"computation_time_ms", time_ms}
     };
+    response.update(extra);
+    return response.dump();
+}
+
+std::string JsonProtocol::format_speculation(int player, const std::vector<SpeculatedBranch>& branches, double time_ms) {
+    json moves = json::object();
+    for (const SpeculatedBranch& b : branches) {
+        moves[card_to_json(b.opponent_card).get<std::string>()] = {
+            {"card", card_to_json(b.move)},
+            {"probability", b.probability},
+            {"cached", b.cached}
+        };
+    }
+    json response = {
+        {"status", "success"},
+        {"player", player},
+        {"branches", moves},
+        {"computation_time_ms", time_ms}
+    };
+    return response.dump();
+}
+
+std::string JsonProtocol::format_hand_strength(const HandStrength& strength, double time_ms) {
+    json suits = json::object();
+    for (const SuitStrength& s : strength.suits) {
+        suits[suit_to_json(s.suit).get<std::string>()] = {
+            {"length", s.length},
+            {"danger", s.danger},
+            {"control", s.control},
+            {"void_potential", s.voidPotential},
+            {"overall", s.overall}
+        };
+    }
+    json response = {
+        {"status", "success"},
+        {"suits", suits},
+        {"overall_danger", strength.overallDanger},
+        {"overall_control", strength.overallControl},
+        {"void_opportunities", strength.voidOpportunities},
+        {"spades", {
+            {"has_queen", strength.spades.hasQueen},
+            {"is_protected", strength.spades.isProtected},
+            {"can_safely_flush", strength.spades.canSafelyFlush},
+            {"escape_cards", strength.spades.escapeCards}
+        }},
+        {"moon", {
+            {"viability_score", strength.moon.viabilityScore},
+            {"should_attempt", strength.moon.shouldAttempt},
+            {"controlled_suits", strength.moon.controlledSuits},
+            {"hearts_control", strength.moon.heartsControl},
+            {"missing_high_cards", strength.moon.missingHighCards}
+        }},
+        {"best_suit_to_void", suit_to_json(strength.bestSuitToVoid)},
+        {"best_suit_to_keep", suit_to_json(strength.bestSuitToKeep)},
+        {"recommend_moon_attempt", strength.recommendMoonAttempt},
+        {"computation_time_ms", time_ms}
+    };
     return response.dump();
 }
 
@@ -225,6 +399,14 @@ std::string JsonProtocol::format_error(const std::string& error_code, const std:
     return response.dump();
 }
 
+std::string JsonProtocol::format_cancelled(const std::string& request_id) {
+    json response = {
+        {"status", "cancelled"},
+        {"request_id", request_id}
+    };
+    return response.dump();
+}
+
 std::string JsonProtocol::format_health() {
     json response = {
         {"status", "ok"}
@@ -232,5 +414,14 @@ std::string JsonProtocol::format_health() {
     return response.dump();
 }
 
+std::string JsonProtocol::format_search_stats(uint64_t searches, uint64_t coalesced) {
+    json response = {
+        {"status", "ok"},
+        {"searches", searches},
+        {"coalesced", coalesced}
+    };
+    return response.dump();
+}
+
 } // namespace server
 } // namespace hearts
@@ -5,6 +5,7 @@
 #include <vector>
 #include "../CardGameState.h"
 #include "../Hearts.h"
+#include "../HeartsStrength.h"
 #include "../third_party/json.hpp"
 
 namespace hearts {
@@ -18,6 +19,11 @@ struct AIConfig {
     double epsilon = 0.1;
     bool use_threads = true;
     std::string player_type = "safe_simple";
+    int hand_budget = 0;  // simulations for the whole hand, spread by HeartsTimeManager
+    std::string difficulty;  // "easy", "medium" or "hard" in place of the settings above
+    bool mast = false;  // playouts pick moves by their MAST values
+    int rave = 0;       // RAVE's k, 0 for none
+    double puct = 0;    // PUCT constant for HeartsMovePrior, 0 for plain UCT
 };
 
 struct TrickCard {
@@ -44,6 +50,14 @@ struct GameStateData {
     int rules;
 };
 
+// The answer for player 0 after the opponent to move plays opponent_card
+struct SpeculatedBranch {
+    card opponent_card;
+    double probability;
+    card move;
+    bool cached;  // found in the cache rather than searched
+};
+
 class JsonProtocol {
 public:
     // Parsing
@@ -51,14 +65,29 @@ public:
     static AIConfig parse_ai_config(const json& j);
     static int parse_rules(const json& rules_json);
 
+    // Game states
+    // Identifies a decision: the state as the engine sees it and the search
+    static std::string state_key(const GameStateData& state, const AIConfig& config);
+    // state after one more card, completing the trick after the fourth
+    static GameStateData advance(const GameStateData& state, const TrickCard& play);
+    // The player to play next; the trick's lead player when it is empty
+    static int next_to_move(const GameStateData& state);
+
     // Formatting responses
-    static std::string format_move_response(card c, int player, double time_ms);
+    // extra: fields added to the response, e.g. how the move was found ahead of time
+    static std::string format_move_response(card c, int player, double time_ms, const json& extra = json::object());
+    static std::string format_speculation(int player, const std::vector<SpeculatedBranch>& branches, double time_ms);
+    static std::string format_hand_strength(const HandStrength& strength, double time_ms);
     static std::string format_error(const std::string& error_code, const std::string& message);
     static std::string format_health();
+    static std::string format_search_stats(uint64_t searches, uint64_t coalesced);
+    static std::string format_cancelled(const std::string& request_id);
 
     // Card conversion
     static card json_to_card(const json& j);
     static json card_to_json(card c);
+    // "S", "D", "C" or "H"; null for -1
+    static json suit_to_json(int suit);
 
 private:
     static std::vector<card> json_to_hand(const json& j);
@@ -0,0 +1,78 @@
+#include "MoveStream.h"
+#include "AIRequestHandler.h"
+#include "JsonProtocol.h"
+
+namespace hearts {
+namespace server {
+
+MoveStream::MoveStream(const std::string& json_request, int interval_ms)
+    : request_(json_request), interval_(interval_ms), have_update_(false), best_(-1),
+      confidence_(0), worlds_done_(0), num_worlds_(0), finished_(false) {
+}
+
+MoveStream::~MoveStream() {
+    cancel_.cancel();
+    if (search_.joinable()) {
+        search_.join();
+    }
+}
+
+void MoveStream::start() {
+    start_time_ = std::chrono::steady_clock::now();
+    search_ = std::thread(&MoveStream::run, this);
+}
+
+void MoveStream::run() {
+    AIRequestHandler handler;
+    std::string response = handler.handle_get_move(request_, &cancel_, this);
+    std::lock_guard<std::mutex> lock(mutex_);
+    response_ = response;
+    finished_ = true;
+    changed_.notify_all();
+}
+
+void MoveStream::WorldsDone(const Move* best, double confidence, int worldsDone, int numWorlds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    best_ = static_cast<const CardMove*>(best)->c;
+    confidence_ = confidence;
+    worlds_done_ = worldsDone;
+    num_worlds_ = numWorlds;
+    have_update_ = true;
+}
+
+bool MoveStream::next_event(std::string& event) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait_for(lock, interval_, [this]() { return finished_; });
+
+    if (finished_) {
+        json response = json::parse(response_);
+        bool failed = response.value("status", "") == "error";
+        if (!failed) {
+            response["stopped"] = cancel_.isCancelled();
+        }
+        event = std::string("event: ") + (failed ? "error" : "done") + "\ndata: " + response.dump() + "\n\n";
+        return false;
+    }
+    if (!have_update_) {
+        // keeps the connection alive, and lets a failed write notice the client is gone
+        event = ": searching\n\n";
+        return true;
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time_).count();
+    json update = {
+        {"move", {
+            {"card", JsonProtocol::card_to_json(best_)},
+            {"player", 0}
+        }},
+        {"confidence", confidence_},
+        {"worlds_done", worlds_done_},
+        {"worlds", num_worlds_},
+        {"elapsed_ms", elapsed_ms}
+    };
+    event = "event: update\ndata: " + update.dump() + "\n\n";
+    return true;
+}
+
+} // namespace server
+} // namespace hearts
@@ -0,0 +1,56 @@
+#ifndef MOVE_STREAM_H
+#define MOVE_STREAM_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../CardGameState.h"
+#include "../iiMonteCarlo.h"
+
+namespace hearts {
+namespace server {
+
+// One /api/move/stream request: runs the /api/move search on its own thread
+// and hands out Server-Sent Events with the best move so far. Stopping the
+// search (cancel_token) ends it with the latest answer.
+class MoveStream : public iiMonteCarloObserver {
+public:
+    MoveStream(const std::string& json_request, int interval_ms);
+    ~MoveStream();
+
+    void start();
+    CancelToken* cancel_token() { return &cancel_; }
+
+    // Waits up to the interval and returns the next event: an update with
+    // the current best move, or the final "done"/"error" event. Returns
+    // false once the final event has been handed out.
+    bool next_event(std::string& event);
+
+    // iiMonteCarloObserver, called on the search thread
+    void WorldsDone(const Move* best, double confidence, int worldsDone, int numWorlds) override;
+
+private:
+    void run();
+
+    std::string request_;
+    std::chrono::milliseconds interval_;
+    std::chrono::steady_clock::time_point start_time_;
+    CancelToken cancel_;
+    std::thread search_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool have_update_;
+    card best_;
+    double confidence_;
+    int worlds_done_, num_worlds_;
+    bool finished_;
+    std::string response_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
@@ -0,0 +1,257 @@
+#include "Ponderer.h"
+#include "AIRequestHandler.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace hearts {
+namespace server {
+
+static const size_t kMaxSessions = 64;
+static const size_t kBranches = 4;  // decisions pondered after each answer
+static const int kSamples = 200;    // worlds sampled to find them
+
+Ponderer::Ponderer(unsigned cores) : next_generation_(0), foreground_(0), stopping_(false) {
+    for (unsigned i = 0; i < std::max(1u, cores); i++) {
+        workers_.emplace_back(&Ponderer::work, this);
+    }
+}
+
+Ponderer::~Ponderer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        cancel_running();
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+Ponderer::Foreground::Foreground(Ponderer& ponderer) : ponderer_(ponderer) {
+    std::lock_guard<std::mutex> lock(ponderer_.mutex_);
+    ponderer_.foreground_++;
+    ponderer_.cancel_running();
+}
+
+Ponderer::Foreground::~Foreground() {
+    {
+        std::lock_guard<std::mutex> lock(ponderer_.mutex_);
+        ponderer_.foreground_--;
+    }
+    ponderer_.wake_.notify_all();
+}
+
+std::unique_ptr<Ponderer::Result> Ponderer::take(const std::string& session, const std::string& key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = sessions_.find(session);
+    if (it == sessions_.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<Job> job;
+    for (const std::shared_ptr<Job>& j : it->second.jobs) {
+        if (j->key == key && !j->failed) {
+            job = j;
+        }
+    }
+    // the decision has arrived, so the other lines can't happen any more
+    for (const std::shared_ptr<Job>& j : it->second.jobs) {
+        if (j->cancel) {
+            j->cancel->cancel();
+        }
+    }
+    if (it->second.cancel) {
+        it->second.cancel->cancel();
+    }
+    sessions_.erase(it);
+    if (!job) {
+        return nullptr;
+    }
+    idle_.wait(lock, [&job] { return !job->running; });
+    return std::move(job->result);
+}
+
+void Ponderer::ponder(const std::string& session, const GameStateData& state, const AIConfig& config, card played) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sessions_.find(session);
+        if (it == sessions_.end() && sessions_.size() >= kMaxSessions) {
+            // drop the session that was answered longest ago
+            it = std::min_element(sessions_.begin(), sessions_.end(),
+                [](const std::pair<const std::string, Session>& a, const std::pair<const std::string, Session>& b) {
+                    return a.second.generation < b.second.generation;
+                });
+        }
+        if (it != sessions_.end()) {
+            for (const std::shared_ptr<Job>& j : it->second.jobs) {
+                if (j->cancel) {
+                    j->cancel->cancel();
+                }
+            }
+            if (it->second.cancel) {
+                it->second.cancel->cancel();
+            }
+            sessions_.erase(it);
+        }
+        Session& s = sessions_[session];
+        s.generation = ++next_generation_;
+        s.state = state;
+        s.played = played;
+        s.config = config;
+    }
+    wake_.notify_all();
+}
+
+size_t Ponderer::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t jobs = 0;
+    for (const auto& entry : sessions_) {
+        jobs += entry.second.jobs.size();
+    }
+    return jobs;
+}
+
+bool Ponderer::has_work() const {
+    for (const auto& entry : sessions_) {
+        const Session& s = entry.second;
+        if (!s.expanded && !s.expanding) {
+            return true;
+        }
+        for (const std::shared_ptr<Job>& j : s.jobs) {
+            if (!j->running && !j->failed && !j->result->complete) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Ponderer::cancel_running() {
+    for (auto& entry : sessions_) {
+        if (entry.second.cancel) {
+            entry.second.cancel->cancel();
+        }
+        for (const std::shared_ptr<Job>& j : entry.second.jobs) {
+            if (j->cancel) {
+                j->cancel->cancel();
+            }
+        }
+    }
+}
+
+void Ponderer::work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || ((foreground_ == 0) && has_work()); });
+        if (stopping_) {
+            return;
+        }
+
+        // find the lines of play for a new answer first, then search the
+        // most likely decision not yet searched
+        auto to_expand = std::find_if(sessions_.begin(), sessions_.end(),
+            [](const std::pair<const std::string, Session>& entry) {
+                return !entry.second.expanded && !entry.second.expanding;
+            });
+        if (to_expand != sessions_.end()) {
+            expand(lock, to_expand->first);
+            continue;
+        }
+        std::shared_ptr<Job> best;
+        AIConfig config;
+        for (const auto& entry : sessions_) {
+            for (const std::shared_ptr<Job>& j : entry.second.jobs) {
+                if (!j->running && !j->failed && !j->result->complete && (!best || j->weight > best->weight)) {
+                    best = j;
+                    config = entry.second.config;
+                    config.use_threads = false;  // one core per ponder search
+                }
+            }
+        }
+        if (best) {
+            search(lock, config, best);
+        }
+    }
+}
+
+void Ponderer::expand(std::unique_lock<std::mutex>& lock, const std::string& name) {
+    Session& session = sessions_[name];
+    uint64_t generation = session.generation;
+    GameStateData state = session.state;
+    card played = session.played;
+    AIConfig config = session.config;
+    CancelToken cancel;
+    session.expanding = true;
+    session.cancel = &cancel;
+    lock.unlock();
+
+    std::vector<ReplyLine> lines;
+    try {
+        AIRequestHandler handler;
+        lines = handler.likely_replies(state, played, config, kSamples, &cancel);
+    } catch (const std::exception& e) {
+        std::cout << "[PONDER] Can't ponder after this move: " << e.what() << std::endl;
+    }
+
+    lock.lock();
+    auto it = sessions_.find(name);
+    if (it == sessions_.end() || it->second.generation != generation) {
+        return;
+    }
+    Session& s = it->second;
+    s.expanding = false;
+    s.cancel = nullptr;
+    if (cancel.isCancelled()) {
+        return;  // sampled again once pondering may run
+    }
+    s.expanded = true;
+
+    GameStateData after = JsonProtocol::advance(state, TrickCard{0, played});
+    int samples = 0;
+    for (const ReplyLine& line : lines) {
+        samples += line.count;
+    }
+    for (size_t i = 0; i < lines.size() && i < kBranches; i++) {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->state = after;
+        for (const TrickCard& tc : lines[i].plays) {
+            job->state = JsonProtocol::advance(job->state, tc);
+        }
+        job->key = JsonProtocol::state_key(job->state, config);
+        job->weight = static_cast<double>(lines[i].count) / samples;
+        job->result.reset(new Result());
+        s.jobs.push_back(job);
+    }
+}
+
+void Ponderer::search(std::unique_lock<std::mutex>& lock, const AIConfig& config, std::shared_ptr<Job> job) {
+    CancelToken cancel;
+    job->running = true;
+    job->cancel = &cancel;
+    lock.unlock();
+
+    bool failed = false;
+    card move = 0;
+    try {
+        AIRequestHandler handler;
+        move = handler.search_move(job->state, config, &cancel, &job->result->worlds);
+    } catch (const std::exception& e) {
+        std::cout << "[PONDER] Search failed: " << e.what() << std::endl;
+        failed = true;
+    }
+
+    lock.lock();
+    job->running = false;
+    job->cancel = nullptr;
+    if (failed) {
+        job->failed = true;
+    } else if (!cancel.isCancelled()) {
+        job->result->complete = true;
+        job->result->move = move;
+    }
+    idle_.notify_all();
+}
+
+} // namespace server
+} // namespace hearts
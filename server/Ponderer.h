@@ -0,0 +1,104 @@
+#ifndef PONDERER_H
+#define PONDERER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JsonProtocol.h"
+#include "../iiMonteCarlo.h"
+#include "../SearchContext.h"
+
+namespace hearts {
+namespace server {
+
+// Pondering for sessions. Once a session's move is answered, idle cores
+// search the decisions it is likely to face next, one for each line of
+// opponent cards that leads to them. When one of those decisions arrives,
+// /api/move answers from the finished search or picks up from its worlds.
+class Ponderer {
+public:
+    // cores is the global core budget: pondering runs at most that many
+    // single-threaded searches, and none while a foreground search runs
+    explicit Ponderer(unsigned cores);
+    ~Ponderer();
+    Ponderer(const Ponderer&) = delete;
+    Ponderer& operator=(const Ponderer&) = delete;
+
+    // Holds pondering off for its lifetime. Running ponder searches are
+    // cancelled and keep the worlds they finished.
+    class Foreground {
+    public:
+        explicit Foreground(Ponderer& ponderer);
+        ~Foreground();
+        Foreground(const Foreground&) = delete;
+        Foreground& operator=(const Foreground&) = delete;
+    private:
+        Ponderer& ponderer_;
+    };
+
+    // A pondered decision: its answer once the search finished, and the
+    // worlds searched so far
+    struct Result {
+        bool complete = false;
+        card move = 0;
+        iiMonteCarloWorlds worlds;
+    };
+
+    // The pondered result for the decision with this key, or null. The
+    // session's other pondered decisions are dropped.
+    std::unique_ptr<Result> take(const std::string& session, const std::string& key);
+
+    // Ponders the decisions likely to follow player 0 playing `played` in
+    // state, replacing whatever the session was pondering
+    void ponder(const std::string& session, const GameStateData& state, const AIConfig& config, card played);
+
+    // Number of decisions pondered or waiting to be
+    size_t size() const;
+
+private:
+    struct Job {
+        std::string key;
+        GameStateData state;
+        double weight;  // share of the sampled worlds leading here
+        bool running = false;
+        bool failed = false;
+        CancelToken* cancel = nullptr;
+        std::unique_ptr<Result> result;
+    };
+
+    struct Session {
+        uint64_t generation;
+        GameStateData state;  // the answered decision
+        card played;          // and the answer
+        AIConfig config;
+        bool expanded = false;  // jobs found
+        bool expanding = false;
+        CancelToken* cancel = nullptr;  // while expanding
+        std::vector<std::shared_ptr<Job>> jobs;
+    };
+
+    void work();
+    bool has_work() const;
+    void expand(std::unique_lock<std::mutex>& lock, const std::string& name);
+    void search(std::unique_lock<std::mutex>& lock, const AIConfig& config, std::shared_ptr<Job> job);
+    void cancel_running();
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;  // work to do, or pondering allowed again
+    std::condition_variable idle_;  // a ponder search stopped
+    std::map<std::string, Session> sessions_;
+    uint64_t next_generation_;
+    int foreground_;
+    bool stopping_;
+    std::vector<std::thread> workers_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
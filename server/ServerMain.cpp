@@ -1,12 +1,18 @@
 #include "HeartsAIServer.h"
+#include "WorkerSupervisor.h"
+#include "../SearchAffinity.h"
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 #include <csignal>
+#include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
+using namespace hearts;
 using namespace hearts::server;
 
 static HeartsAIServer* g_server = nullptr;
@@ -35,16 +41,22 @@ void print_usage(const char* program_name) {
     std::cout << "Hearts AI Server" << std::endl;
     std::cout << "Build: " << __DATE__ << " " << __TIME__ << std::endl;
     std::cout << std::endl;
-    std::cout << "Usage: " << program_name << " [port] [host]" << std::endl;
+    std::cout << "Usage: " << program_name << " [--workers N] [--affinity none|node|core] [port] [host]" << std::endl;
     std::cout << std::endl;
     std::cout << "Arguments:" << std::endl;
     std::cout << "  port  - Port number to listen on (default: 8080)" << std::endl;
     std::cout << "  host  - Host address to bind to (default: 0.0.0.0)" << std::endl;
+    std::cout << "  --workers N - Serve from N processes sharing the port, restarted" << std::endl;
+    std::cout << "                if they exit (default: 1, this process; POSIX only)" << std::endl;
+    std::cout << "  --affinity P - Where a threaded search's worlds run: none (any core," << std::endl;
+    std::cout << "                default), node (the NUMA node the request started on)" << std::endl;
+    std::cout << "                or core (one core each on that node; Linux only)" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  " << program_name << "              # Listen on 0.0.0.0:8080" << std::endl;
     std::cout << "  " << program_name << " 3000         # Listen on 0.0.0.0:3000" << std::endl;
     std::cout << "  " << program_name << " 8080 127.0.0.1 # Listen on localhost:8080" << std::endl;
+    std::cout << "  " << program_name << " --workers 4 # Four worker processes on 0.0.0.0:8080" << std::endl;
     std::cout << std::endl;
     std::cout << "API Endpoints:" << std::endl;
     std::cout << "  GET  /api/health  - Health check, returns {\"status\": \"ok\"}" << std::endl;
@@ -56,6 +68,28 @@ void print_usage(const char* program_name) {
     std::cout << R"(    -d '{"game_state": {"player_hands": [[...]], ...}}')" << std::endl;
 }
 
+// Serves in this process until stopped; the exit status
+static int run_server(const std::string& host, int port, unsigned ponder_threads) {
+    // Set up signal handler for graceful shutdown
+#ifdef _WIN32
+    SetConsoleCtrlHandler(console_handler, TRUE);
+#else
+    std::signal(SIGINT, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+#endif
+
+    try {
+        HeartsAIServer server(host, port, ponder_threads);
+        g_server = &server;
+        bool listened = server.run();
+        g_server = nullptr;
+        return listened ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
 int main(int argc, char* argv[]) {
     // Check for help flag
     if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
@@ -66,35 +100,58 @@ int main(int argc, char* argv[]) {
     // Parse arguments
     int port = 8080;
     std::string host = "0.0.0.0";
+    int workers = 1;
 
-    if (argc >= 2) {
-        port = std::atoi(argv[1]);
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--workers") {
+            if (i + 1 >= argc || (workers = std::atoi(argv[++i])) < 1) {
+                std::cerr << "Error: --workers needs a number of processes of at least 1." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--affinity") {
+            tSearchAffinity affinity;
+            if (i + 1 >= argc || !SearchAffinity::getPolicy(argv[++i], affinity)) {
+                std::cerr << "Error: --affinity must be none, node or core." << std::endl;
+                return 1;
+            }
+            SearchAffinity::setPolicy(affinity);
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() >= 1) {
+        port = std::atoi(args[0].c_str());
         if (port <= 0 || port > 65535) {
             std::cerr << "Error: Invalid port number. Must be between 1 and 65535." << std::endl;
             return 1;
         }
     }
 
-    if (argc >= 3) {
-        host = argv[2];
+    if (args.size() >= 2) {
+        host = args[1];
     }
 
-    // Set up signal handler for graceful shutdown
-#ifdef _WIN32
-    SetConsoleCtrlHandler(console_handler, TRUE);
-#else
-    std::signal(SIGINT, signal_handler);
-    std::signal(SIGTERM, signal_handler);
-#endif
+    if (SearchAffinity::getPolicy() != kAffinityNone) {
+        std::cout << "Search affinity: " << SearchAffinity::getPolicyName(SearchAffinity::getPolicy()) << " ("
+                  << SearchAffinity::getNumNodes() << " node" << (SearchAffinity::getNumNodes() == 1 ? "" : "s") << ")"
+                  << std::endl;
+    }
 
-    try {
-        HeartsAIServer server(host, port);
-        g_server = &server;
-        server.run();
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+    if (workers == 1) {
+        return run_server(host, port, 0);
+    }
+    if (!WorkerSupervisor::supported()) {
+        std::cerr << "Error: --workers is not supported on this platform." << std::endl;
         return 1;
     }
-
-    return 0;
+    // the workers share the cores, so each ponders on its share of them
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned ponder_threads = std::max(1u, cores / workers);
+    WorkerSupervisor supervisor(workers, [host, port, ponder_threads]() {
+        return run_server(host, port, ponder_threads);
+    });
+    return supervisor.run();
 }
@@ -0,0 +1,39 @@
+#include "SpeculationCache.h"
+
+namespace hearts {
+namespace server {
+
+SpeculationCache::SpeculationCache(size_t capacity) : capacity_(capacity) {
+}
+
+void SpeculationCache::put(const std::string& key, card move) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.erase(it->second);
+    } else if (entries_.size() >= capacity_) {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+    entries_.emplace_front(key, move);
+    index_[key] = entries_.begin();
+}
+
+bool SpeculationCache::get(const std::string& key, card& move) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    move = it->second->second;
+    return true;
+}
+
+size_t SpeculationCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+} // namespace server
+} // namespace hearts
@@ -0,0 +1,38 @@
+#ifndef SPECULATION_CACHE_H
+#define SPECULATION_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "../CardGameState.h"
+
+namespace hearts {
+namespace server {
+
+// Answers searched by /api/speculate for states that may arrive next, keyed
+// by JsonProtocol::state_key. /api/move answers a request whose state is
+// here without searching. The least recently used answers are dropped once
+// there are capacity of them.
+class SpeculationCache {
+public:
+    explicit SpeculationCache(size_t capacity = 4096);
+
+    void put(const std::string& key, card move);
+    bool get(const std::string& key, card& move);
+    size_t size() const;
+
+private:
+    typedef std::list<std::pair<std::string, card>> Entries;
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    Entries entries_;  // most recently used first
+    std::unordered_map<std::string, Entries::iterator> index_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
@@ -0,0 +1,198 @@
+#include "WorkerSupervisor.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#endif
+
+namespace hearts {
+namespace server {
+
+WorkerSupervisor::WorkerSupervisor(int workers, std::function<int()> worker)
+    : worker_(worker), slots_(std::max(1, workers)) {
+    for (Slot& slot : slots_) {
+        slot.pid = 0;
+        slot.quick_exits = 0;
+    }
+}
+
+#ifdef _WIN32
+
+bool WorkerSupervisor::supported() {
+    return false;
+}
+
+int WorkerSupervisor::run() {
+    std::cerr << "Worker processes are not supported on this platform" << std::endl;
+    return 1;
+}
+
+void WorkerSupervisor::start(size_t) {
+}
+
+void WorkerSupervisor::exited(int, int) {
+}
+
+void WorkerSupervisor::stop_all() {
+}
+
+#else
+
+static volatile sig_atomic_t g_stop_requested = 0;
+
+static void request_stop(int) {
+    g_stop_requested = 1;
+}
+
+bool WorkerSupervisor::supported() {
+    return true;
+}
+
+int WorkerSupervisor::run() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cout << "Supervising " << slots_.size() << " worker processes (supervisor pid " << getpid() << ")"
+              << std::endl;
+    for (size_t x = 0; x < slots_.size(); x++) {
+        start(x);
+    }
+
+    while (!g_stop_requested) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            exited(pid, status);
+        }
+        Clock::time_point now = Clock::now();
+        for (size_t x = 0; x < slots_.size(); x++) {
+            if (slots_[x].pid == 0 && slots_[x].restart_at <= now && !g_stop_requested) {
+                start(x);
+            }
+        }
+        usleep(100 * 1000);
+    }
+
+    stop_all();
+    return 0;
+}
+
+void WorkerSupervisor::start(size_t slot) {
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t supervisor = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "[SUPERVISOR] Can't start worker " << slot << ": " << strerror(errno) << std::endl;
+        slots_[slot].restart_at = Clock::now() + std::chrono::seconds(1);
+        return;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+#ifdef __linux__
+        // don't outlive a supervisor that was killed outright
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != supervisor) {
+            _exit(0);
+        }
+#endif
+        int code = 1;
+        try {
+            code = worker_();
+        } catch (const std::exception& e) {
+            std::cerr << "[WORKER] " << e.what() << std::endl;
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        _exit(code);
+    }
+    slots_[slot].pid = pid;
+    slots_[slot].started = Clock::now();
+    std::cout << "[SUPERVISOR] Worker " << slot << " started (pid " << pid << ")" << std::endl;
+}
+
+void WorkerSupervisor::exited(int pid, int status) {
+    for (size_t x = 0; x < slots_.size(); x++) {
+        Slot& slot = slots_[x];
+        if (slot.pid != pid) {
+            continue;
+        }
+        slot.pid = 0;
+        Clock::time_point now = Clock::now();
+        if (now - slot.started < std::chrono::seconds(1)) {
+            slot.quick_exits++;
+        } else {
+            slot.quick_exits = 0;
+        }
+        // 0, 1, 2, 4 ... 32 seconds
+        int delay = (slot.quick_exits == 0) ? 0 : (1 << std::min(slot.quick_exits - 1, 5));
+        slot.restart_at = now + std::chrono::seconds(delay);
+
+        std::cerr << "[SUPERVISOR] Worker " << x << " (pid " << pid << ") ";
+        if (WIFSIGNALED(status)) {
+            std::cerr << "killed by signal " << WTERMSIG(status);
+        } else {
+            std::cerr << "exited with status " << WEXITSTATUS(status);
+        }
+        std::cerr << "; restarting in " << delay << " s" << std::endl;
+        return;
+    }
+}
+
+void WorkerSupervisor::stop_all() {
+    std::cout << "[SUPERVISOR] Stopping workers" << std::endl;
+    for (const Slot& slot : slots_) {
+        if (slot.pid != 0) {
+            kill(slot.pid, SIGTERM);
+        }
+    }
+    // workers finish the requests they have; anything left after that is killed
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(10);
+    for (;;) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (Slot& slot : slots_) {
+                if (slot.pid == pid) {
+                    slot.pid = 0;
+                }
+            }
+        }
+        bool running = false;
+        for (const Slot& slot : slots_) {
+            running = running || slot.pid != 0;
+        }
+        if (!running) {
+            return;
+        }
+        if (Clock::now() >= deadline) {
+            for (const Slot& slot : slots_) {
+                if (slot.pid != 0) {
+                    kill(slot.pid, SIGKILL);
+                    waitpid(slot.pid, nullptr, 0);
+                }
+            }
+            return;
+        }
+        usleep(100 * 1000);
+    }
+}
+
+#endif
+
+} // namespace server
+} // namespace hearts
@@ -0,0 +1,51 @@
+#ifndef WORKER_SUPERVISOR_H
+#define WORKER_SUPERVISOR_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace hearts {
+namespace server {
+
+// Runs the server in forked worker processes that all listen on the same
+// port; httplib sets SO_REUSEPORT on its listening sockets, so the kernel
+// spreads connections over them. A worker that exits for any reason while
+// the supervisor runs is started again, after a growing delay if it keeps
+// dying within a second of starting. Workers share the pages of what was
+// built before the fork, such as the opponent model tables, which sit in a
+// read-only shared mapping (CardProbabilityData.h). POSIX only.
+class WorkerSupervisor {
+public:
+    // worker runs in each child process and returns its exit status
+    WorkerSupervisor(int workers, std::function<int()> worker);
+
+    // Starts the workers and keeps them running until SIGINT or SIGTERM,
+    // then stops them all. Returns the supervisor's exit status.
+    int run();
+
+    // false where workers can't be forked
+    static bool supported();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Slot {
+        int pid;  // 0 while not running
+        Clock::time_point started;
+        Clock::time_point restart_at;
+        int quick_exits;  // in a row, each within a second of starting
+    };
+
+    void start(size_t slot);
+    void exited(int pid, int status);
+    void stop_all();
+
+    std::function<int()> worker_;
+    std::vector<Slot> slots_;
+};
+
+} // namespace server
+} // namespace hearts
+
+#endif
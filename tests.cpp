@@ -12,7 +12,9 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <ctime>
 #include <chrono>
 #include <vector>
@@ -21,9 +23,20 @@
 #include "Hearts.h"
 #include "UCT.h"
 #include "iiMonteCarlo.h"
+#include "FlatMC.h"
 #include "iiGameState.h"
+#include "HeartsEval.h"
+#include "HeartsFast.h"
+#include "HeartsPass.h"
+#include "HeartsStrength.h"
+#include "HeartsBook.h"
+#include "SearchAffinity.h"
+#include "HeartsDifficulty.h"
+#include "HeartsTime.h"
+#include "SearchContext.h"
 #include "Timer.h"
 #include "statistics.h"
+#include "server/InFlightSearches.h"
 
 using namespace hearts;
 
@@ -154,6 +167,39 @@ TEST(deck_suit_operations)
     ASSERT_TRUE(!d.hasSuit(HEARTS));
 }
 
+TEST(trick_winner)
+{
+    // the winner follows adds and removes, with and without trump
+    Trick t;
+    t.reset(4);
+    t.AddCard(Deck::getcard(CLUBS, TEN), 2);
+    t.AddCard(Deck::getcard(HEARTS, ACE), 3);
+    ASSERT_EQ(t.Winner(), 2);
+    t.AddCard(Deck::getcard(CLUBS, KING), 0);
+    ASSERT_EQ(t.Winner(), 0);
+    ASSERT_EQ(t.WinningCard(), (int)Deck::getcard(CLUBS, KING));
+    t.AddCard(Deck::getcard(CLUBS, QUEEN), 1);
+    ASSERT_EQ(t.Winner(), 0);
+    ASSERT_TRUE(t.Done());
+    ASSERT_EQ(t.RemoveCard(), Deck::getcard(CLUBS, QUEEN));
+    ASSERT_EQ(t.RemoveCard(), Deck::getcard(CLUBS, KING));
+    ASSERT_EQ(t.Winner(), 2);
+    ASSERT_EQ(t.cards, (((uint64_t)1)<<Deck::getcard(CLUBS, TEN))|(((uint64_t)1)<<Deck::getcard(HEARTS, ACE)));
+
+    Trick trumps(SPADES);
+    trumps.reset(4, SPADES);
+    trumps.AddCard(Deck::getcard(CLUBS, ACE), 0);
+    trumps.AddCard(Deck::getcard(SPADES, TWO), 1);
+    trumps.AddCard(Deck::getcard(SPADES, THREE), 2);
+    ASSERT_EQ(trumps.Winner(), 2);
+    trumps.RemoveCard();
+    ASSERT_EQ(trumps.Winner(), 1);
+    trumps.RemoveCard();
+    trumps.RemoveCard();
+    ASSERT_EQ(trumps.Winner(), -1);
+    ASSERT_EQ(trumps.WinningCard(), -1);
+}
+
 TEST(full_deck)
 {
     Deck d;
@@ -242,6 +288,105 @@ TEST(game_state_deal)
     // Game owns the players and game state
 }
 
+TEST(game_state_clear)
+{
+    HeartsGameState *g = new HeartsGameState(12345);
+    HeartsCardGame game(g);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->Reset(12345);
+    g->setPassDir(kHold);
+    g->setFirstPlayer(0);
+    for (int x = 0; x < 6; x++)
+    {
+        Move *m = g->getMoves();
+        g->ApplyMove(m);
+        g->freeMove(m);
+    }
+
+    // Clear empties the position without dealing a new one
+    g->Clear();
+    ASSERT_EQ(g->getCurrTrickNum(), 0);
+    ASSERT_EQ(g->getNextPlayerNum(), 0);
+    ASSERT_EQ(g->allplayed.count(), 0);
+    for (unsigned int p = 0; p < g->getNumPlayers(); p++)
+    {
+        ASSERT_EQ(g->cards[p].count(), 0);
+        ASSERT_EQ(g->taken[p].count(), 0);
+    }
+
+    // and takes a position set up card by card
+    for (int p = 0; p < 4; p++)
+        g->cards[p].set(Deck::getcard(CLUBS, p));
+    g->setPassDir(kHold);
+    g->setFirstPlayer(0);
+    Move *m = g->getMoves();
+    ASSERT_EQ(((CardMove *)m)->c, Deck::getcard(CLUBS, 0));
+    g->freeMove(m);
+}
+
+TEST(game_state_set_position)
+{
+    // play part of a hand, then set a second game up from what player 0 sees
+    const int rules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kLeadClubs;
+    HeartsGameState *g = new HeartsGameState(99);
+    HeartsCardGame game(g);
+    HeartsGameState *h = new HeartsGameState(99);
+    HeartsCardGame game2(h);
+    for (int x = 0; x < 4; x++)
+    {
+        game.addPlayer(new HeartsDucker());
+        game2.addPlayer(new HeartsDucker());
+    }
+    g->setRules(rules);
+    g->Reset(99);
+    g->setPassDir(kHold);
+    g->setFirstPlayer(0);
+    for (int x = 0; x < 22; x++)
+    {
+        Move *m = g->getMoves();
+        g->ApplyMove(m);
+        g->freeMove(m);
+    }
+
+    HeartsPosition p;
+    p.rules = rules;
+    p.hand = g->cards[0];
+    for (int x = 0; x <= g->getCurrTrickNum(); x++)
+    {
+        const Trick *t = g->getTrick(x);
+        p.tricks.push_back(HeartsPositionTrick(t->curr ? t->player[0] : g->getNextPlayerNum()));
+        for (int y = 0; y < t->curr; y++)
+            p.tricks.back().cards.push_back(t->play[y]);
+    }
+    ASSERT_TRUE(h->SetPosition(p));
+
+    ASSERT_EQ(h->getCurrTrickNum(), g->getCurrTrickNum());
+    ASSERT_EQ(h->getNextPlayerNum(), g->getNextPlayerNum());
+    ASSERT_EQ(h->getCurrTrick()->curr, g->getCurrTrick()->curr);
+    ASSERT_EQ(h->allplayed.getHand(), g->allplayed.getHand());
+    ASSERT_EQ(h->cards[0].getHand(), g->cards[0].getHand());
+    ASSERT_EQ(h->original[0].getHand(), g->original[0].getHand());
+    for (int x = 0; x < 4; x++)
+    {
+        ASSERT_EQ(h->taken[x].getHand(), g->taken[x].getHand());
+        ASSERT_EQ(h->played[x].getHand(), g->played[x].getHand());
+    }
+
+    // inconsistent hands are refused
+    const char *error = 0;
+    HeartsPosition twice = p;
+    twice.hand.set(p.tricks[0].cards[1]);
+    ASSERT_TRUE(!h->SetPosition(twice, &error));
+    ASSERT_NE(error, (const char *)0);
+    HeartsPosition wrongLeader = p;
+    wrongLeader.tricks[1].leader = (p.tricks[1].leader+1)%4;
+    ASSERT_TRUE(!h->SetPosition(wrongLeader, &error));
+    HeartsPosition stolen = p;
+    stolen.taken[(g->getTrick(0)->Winner()+1)%4].set(p.tricks[0].cards[0]);
+    ASSERT_TRUE(!h->SetPosition(stolen, &error));
+}
+
 TEST(pass_directions)
 {
     // Test pass direction enum values
@@ -354,6 +499,886 @@ TEST(iiMonteCarlo_decision_rules)
     delete iimc;
 }
 
+TEST(linear_eval_features)
+{
+    HeartsGameState *g = new HeartsGameState(4242);
+    HeartsCardGame game(g);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(kQueenPenalty);
+    g->Reset();
+    g->setPassDir(kHold);
+
+    float f[kNumEvalFeatures];
+    for (int who = 0; who < 4; who++)
+    {
+        HeartsLinearEval::getFeatures(g, who, f);
+        ASSERT_EQ(f[kEvalBias], 1.0f);
+        ASSERT_EQ(f[kEvalPointsTaken], 0.0f);
+        ASSERT_EQ(f[kEvalUnplayedPoints], 26.0f);
+        ASSERT_EQ(f[kEvalHasQueen], (float)g->cards[who].has(SPADES, QUEEN));
+
+        float length = 0;
+        for (int s = 0; s < 4; s++)
+            length += f[kEvalSuitLength+s];
+        ASSERT_EQ(length, 13.0f);
+    }
+}
+
+TEST(linear_eval_playout)
+{
+    HeartsGameState *g = new HeartsGameState(777);
+    HeartsCardGame game(g);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(kQueenPenalty);
+    g->Reset();
+    g->setPassDir(kHold);
+
+    // cutoff 0 evaluates in place, -1 plays the hand out
+    for (int cutoff = -1; cutoff <= 4; cutoff += 5)
+    {
+        HeartsLinearEval eval(cutoff);
+        uint64_t before = g->cards[0].getHand();
+        maxnval *v = eval.DoRandomPlayout(g, g->getPlayer(0), 0.1);
+        ASSERT_NE(v, nullptr);
+        ASSERT_EQ(g->cards[0].getHand(), before);
+
+        double sum = 0;
+        for (int x = 0; x < 4; x++)
+        {
+            ASSERT_TRUE(v->eval[x] >= 0);
+            sum += v->eval[x];
+        }
+        ASSERT_TRUE(fabs(sum-1.0) < 1e-6);
+        delete v;
+    }
+}
+
+TEST(linear_eval_fit)
+{
+    // recover known weights from noiseless synthetic data
+    float truth[kNumEvalFeatures];
+    for (int x = 0; x < kNumEvalFeatures; x++)
+        truth[x] = (float)(x%5)-2.0f;
+
+    mt_random r;
+    r.srand(99);
+    std::vector<float> features, scores;
+    for (int s = 0; s < 2000; s++)
+    {
+        float y = 0;
+        for (int x = 0; x < kNumEvalFeatures; x++)
+        {
+            float v = (x == kEvalBias) ? 1.0f : (float)r.ranged_long(0, 13);
+            features.push_back(v);
+            y += truth[x]*v;
+        }
+        scores.push_back(y);
+    }
+
+    float w[kNumEvalFeatures];
+    HeartsLinearEval::fit(features, scores, w, 0);
+    for (int x = 0; x < kNumEvalFeatures; x++)
+        ASSERT_TRUE(fabs(w[x]-truth[x]) < 1e-2);
+}
+
+TEST(puct_move_prior)
+{
+    HeartsGameState *g = new HeartsGameState(31337);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(200, 0.4);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new SimpleHeartsPlayer(uct));
+    g->setRules(kQueenPenalty);
+    g->Reset();
+    g->setPassDir(kHold);
+
+    HeartsMovePrior prior;
+    std::vector<Move *> moves;
+    Move *legal = g->getMoves();
+    for (Move *m = legal; m; m = m->next)
+        moves.push_back(m);
+    std::vector<double> p(moves.size());
+    prior.GetPriors(g, moves, &p[0]);
+    double sum = 0;
+    for (unsigned int x = 0; x < p.size(); x++)
+    {
+        ASSERT_GT(p[x], 0.0);
+        sum += p[x];
+    }
+    ASSERT_TRUE(fabs(sum-1.0) < 1e-6);
+
+    // PUCT search still returns a legal move and visits every root sample
+    HeartsPlayout playout;
+    uct->setPlayoutModule(&playout);
+    uct->setPriorModule(&prior, 1.0);
+    returnValue *rv = uct->Play(g, g->getNextPlayer());
+    ASSERT_NE(rv->m, nullptr);
+    bool found = false;
+    for (Move *m = legal; m; m = m->next)
+        if (m->equals(rv->m))
+            found = true;
+    ASSERT_TRUE(found);
+
+    std::vector<uint32_t> hashes;
+    std::vector<int> counts;
+    uct->GetLastRootVisits(hashes, counts);
+    ASSERT_EQ(hashes.size(), moves.size());
+    int visits = 0;
+    for (unsigned int x = 0; x < counts.size(); x++)
+        visits += counts[x];
+    ASSERT_EQ(visits, 200);
+
+    g->freeMove(legal);
+    delete rv;
+    delete uct;
+}
+
+TEST(move_prior_fit)
+{
+    // two moves per position; the target always prefers the one with
+    // the larger first feature, so fitting must lower the cross-entropy
+    std::vector<float> features, targets;
+    std::vector<int> groupSize;
+    for (int s = 0; s < 50; s++)
+    {
+        for (int y = 0; y < 2; y++)
+        {
+            for (int x = 0; x < kNumPriorFeatures; x++)
+                features.push_back((x == 0) ? (float)(y*(s%5+1)) : 0.5f);
+            targets.push_back(y ? 0.9f : 0.1f);
+        }
+        groupSize.push_back(2);
+    }
+    float w[kNumPriorFeatures] = {0};
+    double before = HeartsMovePrior::fit(features, targets, groupSize, w, 1);
+    double after = HeartsMovePrior::fit(features, targets, groupSize, w, 200);
+    ASSERT_TRUE(after < before);
+    ASSERT_GT(w[0], 0.0f);
+}
+
+// exposes UCT's MAST and AMAF tables to uct_mast_rave
+class uctProbe : public UCT {
+public:
+    uctProbe(int numRuns, double cval) :UCT(numRuns, cval) {}
+    using UCT::GibbsSample;
+    using UCT::GetAMAFVal;
+    using UCT::ResetHistory;
+    using UCT::history;
+    using UCT::amafReward;
+    using UCT::amafCount;
+    using UCT::tree;
+};
+
+TEST(uct_mast_rave)
+{
+    HeartsGameState *g = new HeartsGameState(2024);
+    HeartsCardGame game(g);
+    uctProbe *uct = new uctProbe(300, 0.4);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new SimpleHeartsPlayer(uct));
+    g->setRules(kQueenPenalty);
+    g->Reset();
+    g->setPassDir(kHold);
+
+    // no playout module, so UCT's own Gibbs/MAST playouts are used
+    uct->setUseHH(true);
+    uct->setUseRAVE(50);
+    uct->setEpsilonPlayout(0.1);
+    ASSERT_TRUE(strstr(uct->getName(), "_RAVE-50") != nullptr);
+    ASSERT_TRUE(strstr(uct->getName(), "_HH") != nullptr);
+
+    uint64_t before = g->cards[0].getHand();
+    returnValue *rv = uct->Play(g, g->getNextPlayer());
+    ASSERT_NE(rv->m, nullptr);
+    ASSERT_EQ(g->cards[0].getHand(), before);
+
+    Move *legal = g->getMoves();
+    bool found = false;
+    for (Move *m = legal; m; m = m->next)
+        if (m->equals(rv->m))
+            found = true;
+    ASSERT_TRUE(found);
+
+    // MAST saw every root move of the player to move
+    int who = g->getNextPlayerNum();
+    for (Move *m = legal; m; m = m->next)
+        ASSERT_GT(uct->history.count[who][g->getMoveHash(m)&(kMoveSlots-1)], 0);
+
+    // AMAF blends in with beta = sqrt(k/(3n+k)): all AMAF at n=0, half at n=k
+    uct->tree.push_back(UCTNode());
+    uct->tree.push_back(UCTNode(legal->clone(g), 0));
+    uct->tree[0].amaf = 0;
+    uct->amafReward.assign(kMoveSlots, 0);
+    uct->amafCount.assign(kMoveSlots, 0);
+    int slot = g->getMoveHash(legal)&(kMoveSlots-1);
+    uct->amafReward[slot] = 0.8;
+    uct->amafCount[slot] = 10;
+    uct->tree[1].reward = 0.2;
+    uct->tree[1].count = 0;
+    ASSERT_TRUE(fabs(uct->GetAMAFVal(g, 0, 1)-0.8) < 1e-9);
+    uct->tree[1].count = 50;
+    ASSERT_TRUE(fabs(uct->GetAMAFVal(g, 0, 1)-0.5) < 1e-9);
+    uct->tree[1].count = 5000;
+    double late = uct->GetAMAFVal(g, 0, 1);
+    ASSERT_TRUE(late > 0.2 && late < 0.25);
+    uct->FreeTree(g);
+
+    // Gibbs playouts favour the move MAST rates highest
+    uct->ResetHistory();
+    Move *favoured = legal;
+    for (Move *m = legal; m; m = m->next)
+    {
+        uct->history.value[who][g->getMoveHash(m)&(kMoveSlots-1)] = 0;
+        uct->history.count[who][g->getMoveHash(m)&(kMoveSlots-1)] = 1;
+        favoured = m;
+    }
+    uct->history.value[who][g->getMoveHash(favoured)&(kMoveSlots-1)] = 1;
+    int picked = 0;
+    for (int x = 0; x < 200; x++)
+    {
+        Move *m = uct->GibbsSample(g);
+        if (m->equals(favoured))
+            picked++;
+        g->freeMove(m);
+    }
+    ASSERT_GT(picked, 190);
+
+    g->freeMove(legal);
+    delete rv;
+    delete uct;
+}
+
+TEST(uct_mast_playout_module)
+{
+    HeartsGameState *g = new HeartsGameState(2024);
+    HeartsCardGame game(g);
+    uctProbe *uct = new uctProbe(300, 0.4);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new SimpleHeartsPlayer(uct));
+    g->setRules(kQueenPenalty);
+    g->Reset();
+    g->setPassDir(kHold);
+
+    // the module's playout moves reach MAST and the root's AMAF, not only the tree's
+    UCTModule *module = newHeartsPlayout(kQueenPenalty);
+    uct->setPlayoutModule(module);
+    uct->setUseHH(true);
+    uct->setUseRAVE(50);
+    uct->setEpsilonPlayout(0.1);
+    returnValue *rv = uct->Play(g, g->getNextPlayer());
+    ASSERT_NE(rv->m, nullptr);
+    int mast = 0, amaf = 0;
+    for (unsigned int p = 0; p < MAXPLAYERS; p++)
+        for (int s = 0; s < kMoveSlots; s++)
+            mast += uct->history.count[p][s];
+    for (int s = 0; s < kMoveSlots; s++)
+        amaf += uct->amafCount[s];
+    ASSERT_GT(mast, 300*10);
+    ASSERT_GT(amaf, 300*3);
+
+    // with mast set, HeartsPlayout leads the card MAST rates highest
+    int who = g->getNextPlayerNum();
+    Move *legal = g->getMoves();
+    Move *favoured = legal;
+    UCTHistory history;
+    history.mast = true;
+    for (Move *m = legal; m; m = m->next)
+    {
+        history.Update(who, g->getMoveHash(m)&(kMoveSlots-1), 0);
+        favoured = m;
+    }
+    history.Update(who, g->getMoveHash(favoured)&(kMoveSlots-1), 2);
+    HeartsPlayout playout;
+    playout.setHistory(&history);
+    int picked = 0;
+    for (int x = 0; x < 200; x++)
+    {
+        Move *m = playout.DoMinPlay(g, false, 0);
+        if (m->equals(favoured))
+            picked++;
+        g->freeMove(m);
+    }
+    ASSERT_GT(picked, 190);
+
+    g->freeMove(legal);
+    delete rv;
+    delete uct;
+    delete module;
+}
+
+TEST(playout_engine_policies)
+{
+    // every statically dispatched policy plays to the end and restores the state
+    HeartsGameState *g = new HeartsGameState(8080);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(20, 0.4);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(uct);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kLeadClubs|kDoPassCards);
+    g->Reset();
+    g->setPassDir(kLeftDir);
+    g->setFirstPlayer(0);
+
+    HeartsPlayout playout;
+    HeartsPlayoutCheckShoot checkShoot;
+    UCTModule *modules[3] = {&playout, &checkShoot, player};
+    for (int pass = 0; pass < 2; pass++)
+    {
+        uint64_t hands[4];
+        for (int x = 0; x < 4; x++)
+            hands[x] = g->cards[x].getHand();
+        int next = g->getNextPlayerNum();
+        for (int m = 0; m < 3; m++)
+        {
+            for (int x = 0; x < 20; x++)
+            {
+                maxnval *v = modules[m]->DoRandomPlayout(g, player, 0.1);
+                ASSERT_NE(v, nullptr);
+                delete v;
+            }
+            for (int x = 0; x < 4; x++)
+                ASSERT_EQ(g->cards[x].getHand(), hands[x]);
+            ASSERT_EQ(g->getNextPlayerNum(), next);
+            ASSERT_EQ(g->numCardsPassed, 0);
+        }
+        // and again from the play phase
+        g->setPassDir(kHold);
+        g->setFirstPlayer(0);
+    }
+    delete uct;
+}
+
+TEST(fast_playout_matches_generic)
+{
+    // the specialized state generates the same moves and scores as HeartsGameState
+    int ruleSets[3] = {kStandardRules, kStandard2ClubsRules, kOmnibusRules|kNoTrickBonus};
+    mt_random r(99);
+    for (int rs = 0; rs < 3; rs++)
+    {
+        for (int deal = 0; deal < 20; deal++)
+        {
+            HeartsGameState *g = new HeartsGameState(300+deal);
+            HeartsCardGame game(g);
+            for (int x = 0; x < 4; x++)
+                game.addPlayer(new HeartsDucker());
+            g->setRules(ruleSets[rs]);
+            g->Reset();
+            g->setPassDir(kHold);
+            g->setFirstPlayer(deal%4);
+
+            fastHeartsState<kStandardRules, 4> fs;
+            fastHeartsState<kStandard2ClubsRules, 4> fs2;
+            fastHeartsState<kOmnibusRules|kNoTrickBonus, 4> fs3;
+            fs.load(g);
+            fs2.load(g);
+            fs3.load(g);
+            while (!g->Done())
+            {
+                card fast[16];
+                int n = (rs == 0)?fs.getMoves(fast):((rs == 1)?fs2.getMoves(fast):fs3.getMoves(fast));
+                Move *legal = g->getMoves();
+                int count = 0;
+                for (Move *m = legal; m; m = m->next)
+                {
+                    // same list, in reverse order
+                    ASSERT_TRUE(count < n);
+                    ASSERT_EQ(((CardMove*)m)->c, fast[n-1-count]);
+                    count++;
+                }
+                ASSERT_EQ(count, n);
+                g->freeMove(legal);
+
+                card c = fast[r.ranged_long(0, n-1)];
+                Move *m = g->getMoves();
+                Move *pick = 0;
+                for (Move *t = m; t; t = t->next)
+                    if (((CardMove*)t)->c == c)
+                        pick = t->clone(g);
+                g->freeMove(m);
+                g->ApplyMove(pick);
+                g->freeMove(pick);
+                fs.apply(c);
+                fs2.apply(c);
+                fs3.apply(c);
+                ASSERT_EQ(fs.allplayed, g->allplayed.getHand());
+                ASSERT_EQ(fs.currPlr, g->getNextPlayerNum());
+            }
+            for (int x = 0; x < 4; x++)
+            {
+                double expected = g->score(x);
+                ASSERT_EQ((rs == 0)?fs.score(x):((rs == 1)?fs2.score(x):fs3.score(x)), expected);
+            }
+            g->deletePlayers();
+        }
+    }
+
+    // the factory only specializes the configured rule sets
+    UCTModule *fastModule = newHeartsPlayout(kStandardRules|kDoPassCards);
+    UCTModule *slowModule = newHeartsPlayout(kQueenPenalty);
+    ASSERT_TRUE(hasFastPlayout(kStandardRules|kDoPassCards));
+    ASSERT_TRUE(!hasFastPlayout(kQueenPenalty));
+    ASSERT_TRUE(strcmp(fastModule->GetModuleName(), "HFastPlayout") == 0);
+    ASSERT_TRUE(strcmp(slowModule->GetModuleName(), "HPlayout") == 0);
+    delete fastModule;
+    delete slowModule;
+}
+
+TEST(playout_settling)
+{
+    // a settled hand scores what playing it out scores, whatever is played
+    int ruleSets[3] = {kStandardRules, kStandard2ClubsRules, kOmnibusRules|kNoTrickBonus};
+    mt_random r(7);
+    int settled = 0;
+    for (int rs = 0; rs < 3; rs++)
+    {
+        for (int deal = 0; deal < 40; deal++)
+        {
+            HeartsGameState *g = new HeartsGameState(500+deal);
+            HeartsCardGame game(g);
+            for (int x = 0; x < 4; x++)
+                game.addPlayer(new HeartsDucker());
+            g->setRules(ruleSets[rs]);
+            g->Reset();
+            g->setPassDir(kHold);
+            g->setFirstPlayer(deal%4);
+
+            fastHeartsState<kStandardRules, 4> fs;
+            fastHeartsState<kStandard2ClubsRules, 4> fs2;
+            fastHeartsState<kOmnibusRules|kNoTrickBonus, 4> fs3;
+            fs.load(g);
+            fs2.load(g);
+            fs3.load(g);
+            double expected[4] = {0, 0, 0, 0};
+            bool haveExpected = false;
+            while (!g->Done())
+            {
+                uint64_t taken[4], allplayed;
+                bool generic = g->getSettledPiles(taken, allplayed);
+                fastHeartsState<kStandardRules, 4> s = fs;
+                fastHeartsState<kStandard2ClubsRules, 4> s2 = fs2;
+                fastHeartsState<kOmnibusRules|kNoTrickBonus, 4> s3 = fs3;
+                bool fast = (rs == 0)?s.settle():((rs == 1)?s2.settle():s3.settle());
+                ASSERT_EQ(generic, fast);
+                if (fast && !haveExpected)
+                {
+                    haveExpected = true;
+                    settled++;
+                    for (int x = 0; x < 4; x++)
+                        expected[x] = (rs == 0)?s.score(x):((rs == 1)?s2.score(x):s3.score(x));
+                }
+
+                Move *m = g->getMoves();
+                int n = 0;
+                for (Move *t = m; t; t = t->next)
+                    n++;
+                int which = r.ranged_long(0, n-1);
+                Move *pick = m;
+                while (which-- > 0)
+                    pick = pick->next;
+                card c = ((CardMove*)pick)->c;
+                pick = pick->clone(g);
+                g->freeMove(m);
+                g->ApplyMove(pick);
+                g->freeMove(pick);
+                fs.apply(c);
+                fs2.apply(c);
+                fs3.apply(c);
+            }
+            for (int x = 0; haveExpected && (x < 4); x++)
+                ASSERT_EQ(expected[x], g->score(x));
+            g->deletePlayers();
+        }
+    }
+    ASSERT_GT(settled, 0);
+
+    // playouts from the first lead stop early and leave the state as it was
+    HeartsGameState *g = new HeartsGameState(42);
+    HeartsCardGame game(g);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(kStandardRules);
+    g->Reset();
+    g->setPassDir(kHold);
+    HeartsPlayout playout;
+    for (int x = 0; x < 100; x++)
+        delete playout.DoRandomPlayout(g, 0, 0.1);
+    ASSERT_GT((int)playout.getSettledPlayouts(), 0);
+    ASSERT_GT((int)playout.getPliesSaved(), (int)playout.getSettledPlayouts());
+    ASSERT_EQ(g->allplayed.getHand(), (uint64_t)0);
+
+    // a copy for another thread counts with the module it was made from
+    uint64_t before = playout.getSettledPlayouts();
+    UCTModule *copy = playout.cloneModule();
+    for (int x = 0; x < 100; x++)
+        delete copy->DoRandomPlayout(g, 0, 0.1);
+    ASSERT_GT((int)(playout.getSettledPlayouts()-before), 0);
+    ASSERT_EQ(playout.getSettledPlayouts(), ((HeartsPlayout *)copy)->getSettledPlayouts());
+    delete copy;
+    g->deletePlayers();
+}
+
+TEST(suit_isomorphic_states)
+{
+    // two deals that differ only by swapping diamonds and clubs
+    const int rules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts;
+    std::vector<std::vector<card> > cardsA(4), cardsB(4);
+    Deck deal;
+    deal.Shuffle(77);
+    for (int x = 0; x < 52; x++)
+    {
+        card c = deal.getRandomCard();
+        int suit = Deck::getsuit(c);
+        if (suit == DIAMONDS)
+            suit = CLUBS;
+        else if (suit == CLUBS)
+            suit = DIAMONDS;
+        cardsA[x%4].push_back(c);
+        cardsB[x%4].push_back(Deck::getcard(suit, Deck::getrank(c)));
+    }
+    HeartsGameState *a = new HeartsGameState(cardsA);
+    HeartsGameState *b = new HeartsGameState(cardsB);
+    HeartsCardGame gameA(a), gameB(b);
+    UCT *uct = new UCT(20, 0.4);
+    for (int x = 0; x < 4; x++)
+    {
+        gameA.addPlayer(new SimpleHeartsPlayer(uct));
+        gameB.addPlayer(new SimpleHeartsPlayer(uct));
+    }
+    a->setRules(rules);
+    b->setRules(rules);
+    a->SetInitialCards(cardsA);
+    b->SetInitialCards(cardsB);
+    a->setFirstPlayer(0);
+    b->setFirstPlayer(0);
+    ASSERT_EQ(a->getInterchangeableSuits(), (1<<DIAMONDS)|(1<<CLUBS));
+
+    // the whole deal, and what player 0 sees of it, in canonical suits
+    suitPermutation pa, pb;
+    a->getCanonicalSuits(pa);
+    b->getCanonicalSuits(pb);
+    for (int w = 0; w < 4; w++)
+        ASSERT_EQ(pa.map(a->cards[w].getHand()), pb.map(b->cards[w].getHand()));
+    a->getCanonicalSuits(0, pa);
+    b->getCanonicalSuits(0, pb);
+    ASSERT_EQ(pa.map(a->cards[0].getHand()), pb.map(b->cards[0].getHand()));
+
+    // a move found in canonical suits maps back to each deal's own card
+    for (unsigned int x = 0; x < cardsA[0].size(); x++)
+    {
+        card canon = pa.map(cardsA[0][x]);
+        ASSERT_EQ(pb.unmap(canon), cardsB[0][x]);
+        ASSERT_EQ(pa.unmap(canon), cardsA[0][x]);
+    }
+
+    // clubs are fixed until the first lead when clubs must be led
+    a->setRules(rules|kLeadClubs);
+    ASSERT_EQ(a->getInterchangeableSuits(), 1<<DIAMONDS);
+    delete uct;
+}
+
+TEST(pass_evaluator_canonical)
+{
+    // swapping diamonds and clubs only changes the hand when clubs are special
+    Deck a, b;
+    int suits[3] = {SPADES, DIAMONDS, CLUBS};
+    for (int x = 0; x < 13; x++)
+        a.set(suits[x%3], x);
+    for (int x = 0; x < 64; x++)
+    {
+        if (!a.has(x))
+            continue;
+        int suit = Deck::getsuit(x);
+        if (suit == DIAMONDS)
+            suit = CLUBS;
+        else if (suit == CLUBS)
+            suit = DIAMONDS;
+        b.set(suit, Deck::getrank(x));
+    }
+    suitPermutation mapA, mapB;
+    ASSERT_EQ(HeartsPassEvaluator::canonicalHand(a.getHand(), kQueenPenalty, mapA),
+              HeartsPassEvaluator::canonicalHand(b.getHand(), kQueenPenalty, mapB));
+    ASSERT_EQ(mapA.to[HEARTS], (int)HEARTS);
+    ASSERT_EQ(mapA.to[SPADES], (int)SPADES);
+    ASSERT_NE(HeartsPassEvaluator::canonicalHand(a.getHand(), kQueenPenalty|kLeadClubs, mapA),
+              HeartsPassEvaluator::canonicalHand(b.getHand(), kQueenPenalty|kLeadClubs, mapB));
+
+    // the isomorphic hand is served from the cache, mapped back to its own suits
+    HeartsPassEvaluator pe(400, 8);
+    card passA[3], passB[3];
+    pe.selectPassCards(a.getHand(), kLeftDir, kQueenPenalty, passA);
+    pe.selectPassCards(b.getHand(), kLeftDir, kQueenPenalty, passB);
+    ASSERT_EQ(pe.getCacheMisses(), 1);
+    ASSERT_EQ(pe.getCacheHits(), 1);
+    for (int x = 0; x < 3; x++)
+    {
+        ASSERT_TRUE(a.has(passA[x]));
+        ASSERT_TRUE(b.has(passB[x]));
+        int suit = Deck::getsuit(passA[x]);
+        bool found = false;
+        for (int y = 0; y < 3; y++)
+            if ((Deck::getrank(passB[y]) == Deck::getrank(passA[x])) &&
+                ((Deck::getsuit(passB[y]) == suit) == ((suit == SPADES) || (suit == HEARTS))))
+                found = true;
+        ASSERT_TRUE(found);
+    }
+}
+
+TEST(pass_evaluator_player)
+{
+    const int rules = kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kLeadClubs|kDoPassCards;
+    HeartsGameState *g = new HeartsGameState(4242);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(20, 0.4);
+    HeartsPassEvaluator pe(400, 8);
+    pe.setUseThreads(false);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(uct);
+    player->setPassEvaluator(&pe);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new SimpleHeartsPlayer(uct));
+    g->setRules(rules);
+    g->Reset();
+    g->setPassDir(kRightDir);
+    g->setFirstPlayer(0);
+
+    std::vector<passSet> sets;
+    HeartsPassEvaluator::rankPassSets(g->cards[0].getHand(), rules, sets);
+    ASSERT_EQ((int)sets.size(), 286);
+
+    card expected[3];
+    pe.selectPassCards(g, 0, expected);
+    ASSERT_TRUE((expected[0] < expected[1]) && (expected[1] < expected[2]));
+
+    // the player passes the evaluator's set one card at a time
+    for (int x = 0; x < 3; x++)
+    {
+        Move *m = player->Play();
+        ASSERT_EQ(((CardMove*)m)->c, expected[x]);
+        g->ApplyMove(m);
+        g->freeMove(m);
+    }
+    ASSERT_EQ((int)g->passes[0].size(), 3);
+    ASSERT_EQ(pe.getCacheHits(), 1);
+    delete uct;
+}
+
+TEST(flat_mc)
+{
+    HeartsGameState *g = new HeartsGameState(42);
+    HeartsCardGame game(g);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(kStandardRules);
+    g->Reset();
+    g->setPassDir(kHold);
+    Move *legal = g->getMoves();
+    int numMoves = 0;
+    for (Move *m = legal; m; m = m->next)
+        numMoves++;
+    g->freeMove(legal);
+    ASSERT_GT(numMoves, 1);
+
+    // paired playouts depend only on the round seeds, not on where the
+    // module's generator was, and leave the state's generator alone
+    HeartsPlayout used, fresh;
+    for (int x = 0; x < 10; x++)
+        delete used.DoRandomPlayout(g, 0, 0.1);
+    FlatMC paired(20*numMoves), repeat(20*numMoves);
+    paired.setPlayoutModule(&used);
+    repeat.setPlayoutModule(&fresh);
+    mt_random before = g->r;
+    returnValue *a = paired.Analyze(g, 0);
+    returnValue *b = repeat.Analyze(g, 0);
+    ASSERT_EQ(g->r.rand_long(), before.rand_long());
+    int count = 0;
+    for (returnValue *x = a, *y = b; x && y; x = x->next, y = y->next, count++)
+    {
+        ASSERT_EQ(((CardMove *)x->m)->c, ((CardMove *)y->m)->c);
+        ASSERT_EQ(x->getValue(0), y->getValue(0));
+    }
+    ASSERT_EQ(count, numMoves);
+    delete a;
+    delete b;
+    ASSERT_EQ(g->allplayed.getHand(), (uint64_t)0);
+
+    // and as the search of each world
+    FlatMC *flat = new FlatMC(200);
+    flat->setPlayoutModule(new HeartsPlayout());
+    iiMonteCarlo *iimc = new iiMonteCarlo(flat, 4);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+    player->setModelLevel(1);
+    HeartsGameState *g2 = new HeartsGameState(12345);
+    HeartsCardGame game2(g2);
+    game2.addPlayer(player);
+    for (int x = 0; x < 3; x++)
+        game2.addPlayer(new HeartsDucker());
+    g2->Reset();
+    g2->setPassDir(kHold);
+    Move *m = player->Play();
+    ASSERT_NE(m, nullptr);
+    bool isLegal = false;
+    Move *moves = g2->getMoves();
+    for (Move *t = moves; t; t = t->next)
+        isLegal = isLegal || (((CardMove *)t)->c == ((CardMove *)m)->c);
+    g2->freeMove(moves);
+    g2->freeMove(m);
+    ASSERT_TRUE(isLegal);
+}
+
+TEST(hand_strength)
+{
+    Deck hand;
+    hand.set(SPADES, ACE); hand.set(SPADES, QUEEN); hand.set(SPADES, FIVE); hand.set(SPADES, THREE);
+    for (int r = ACE; r <= EIGHT; r++)
+        hand.set(HEARTS, r);
+    hand.set(DIAMONDS, TWO);
+    hand.set(CLUBS, ACE);
+    HandStrength h = evaluateHand(hand);
+
+    // A+Q+Q of spades; 60 = A+Q+4 cards; 25 for 4 cards
+    ASSERT_EQ(h.suits[SPADES].danger, 65);
+    ASSERT_EQ(h.suits[SPADES].control, 60);
+    ASSERT_EQ(h.suits[SPADES].voidPotential, 25);
+    ASSERT_EQ(h.suits[SPADES].overall, 60-65/2+25/4);
+    ASSERT_EQ(h.suits[HEARTS].danger, 99);
+    ASSERT_EQ(h.suits[HEARTS].control, 100);
+    ASSERT_EQ(h.suits[DIAMONDS].danger, 0);
+    ASSERT_EQ(h.suits[DIAMONDS].control, 0);
+    ASSERT_EQ(h.suits[CLUBS].danger, 5);
+    ASSERT_EQ(h.suits[CLUBS].control, 10);
+    ASSERT_EQ(h.overallDanger, (65+99+0+5)/4);
+    ASSERT_EQ(h.voidOpportunities, 2);
+    ASSERT_EQ(h.bestSuitToVoid, (int)CLUBS);
+    ASSERT_EQ(h.bestSuitToKeep, (int)HEARTS);
+
+    ASSERT_TRUE(h.spades.hasQueen);
+    ASSERT_TRUE(h.spades.isProtected);
+    ASSERT_TRUE(!h.spades.canSafelyFlush);
+    ASSERT_EQ(h.spades.escapeCards, 2);
+
+    ASSERT_EQ(h.moon.viabilityScore, 100);
+    ASSERT_EQ(h.moon.controlledSuits, 3);
+    ASSERT_EQ(h.moon.heartsControl, 100);
+    ASSERT_EQ(h.moon.missingHighCards, 4);
+    ASSERT_TRUE(h.recommendMoonAttempt);
+
+    // once the ace is played the king heads spades, but there is no queen
+    // left to flush when it is gone too
+    Deck spades, played;
+    spades.set(SPADES, KING); spades.set(SPADES, FOUR); spades.set(SPADES, THREE);
+    ASSERT_EQ(evaluateHand(spades).moon.controlledSuits, 0);
+    ASSERT_TRUE(evaluateHand(spades).spades.canSafelyFlush);
+    played.set(SPADES, ACE);
+    ASSERT_EQ(evaluateHand(spades, played).moon.controlledSuits, 1);
+    ASSERT_EQ(evaluateHand(spades, played).suits[SPADES].control, evaluateHand(spades).suits[SPADES].control+5);
+    ASSERT_EQ(evaluateHand(spades, played).spades.escapeCards, 2);
+    played.set(SPADES, QUEEN);
+    ASSERT_TRUE(!evaluateHand(spades, played).spades.canSafelyFlush);
+    ASSERT_EQ(evaluateHand(spades, played).spades.escapeCards, 0);
+
+    // the tables agree with the bit loops they replace
+    for (int mask = 0; mask < (1<<13); mask++)
+    {
+        int rankSum = 0, len = 0;
+        for (int r = 0; r < 13; r++)
+            if ((mask>>r)&1)
+            {
+                rankSum += r;
+                len++;
+            }
+        ASSERT_EQ(getRankSum(mask), rankSum);
+        ASSERT_EQ(getSpadeAnalysis(mask).escapeCards, len-(mask&1)-((mask>>1)&1)-((mask>>2)&1));
+        ASSERT_EQ(getSuitStrength(DIAMONDS, mask).length, len);
+    }
+}
+
+TEST(opening_book)
+{
+    const int rules = kQueenPenalty|kMustBreakHearts|kLeadClubs|kDoPassCards;
+    HeartsGameState *g = new HeartsGameState(5150);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(20, 0.4);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(uct);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new SimpleHeartsPlayer(uct));
+    g->setRules(rules);
+    g->Reset();
+    g->setPassDir(kAcrossDir);
+    g->setFirstPlayer(0);
+
+    // a one-entry book whose best pass is the three lowest cards
+    card low[3];
+    int n = 0;
+    for (int c = 63; (c >= 0) && (n < 3); c--)
+        if (g->cards[0].has(c))
+            low[n++] = c;
+    bookEntry e;
+    suitPermutation suits;
+    HeartsOpeningBook::getPassKey(g->cards[0].getHand(), kAcrossDir, rules, e, suits);
+    e.numMoves = 2;
+    for (int x = 0; x < 3; x++)
+    {
+        e.moves[0].c[x] = suits.map(low[x]);
+        e.moves[1].c[x] = suits.map(low[x])-1;
+    }
+    e.moves[0].weight = 0.3f;
+    e.moves[1].weight = 0.2f;
+    std::vector<bookEntry> entries(1, e);
+    ASSERT_TRUE(HeartsOpeningBook::write("opening_book_test.bin", entries));
+
+    HeartsOpeningBook book;
+    ASSERT_TRUE(book.load("opening_book_test.bin"));
+    std::remove("opening_book_test.bin");
+    ASSERT_EQ(book.size(), 1);
+
+    card pass[3];
+    ASSERT_TRUE(!book.getPass(g->cards[0].getHand(), kLeftDir, rules, pass));
+    ASSERT_TRUE(!book.getPass(g->cards[1].getHand(), kAcrossDir, rules, pass));
+    ASSERT_TRUE(book.getPass(g->cards[0].getHand(), kAcrossDir, rules, pass));
+
+    // the player passes the book set without searching
+    player->setOpeningBook(&book);
+    for (int x = 0; x < 3; x++)
+    {
+        ASSERT_EQ(pass[x], low[2-x]);
+        Move *m = player->Play();
+        ASSERT_EQ(((CardMove*)m)->c, pass[x]);
+        g->ApplyMove(m);
+        g->freeMove(m);
+    }
+    delete uct;
+}
+
+TEST(card_prob_data_tables)
+{
+    // the four tables in file order: [64][64], [64][64][64], [64][64], [64][64][64]
+    char file[] = "card_prob_test.txt";
+    FILE *f = fopen(file, "w");
+    ASSERT_TRUE(f != 0);
+    const int counts[4] = {64*64, 64*64*64, 64*64, 64*64*64};
+    for (int t = 0; t < 4; t++)
+        for (int x = 0; x < counts[t]; x++)
+            fprintf(f, "%d ", (t+1)*1000+x%997);
+    fclose(f);
+
+    cardProbData model(file);
+    std::remove(file);
+    ASSERT_EQ((int)model.probGivenLead[1][2], 1000+(64+2)%997);
+    ASSERT_EQ((int)model.probGivenLeadAndPlay[3][4][5], 2000+(3*4096+4*64+5)%997);
+    ASSERT_EQ((int)model.freq1[63][63], 3000+4095%997);
+    ASSERT_EQ((int)model.freq2[63][63][63], 4000+262143%997);
+
+    // a model without a file is all zeroes
+    cardProbData empty;
+    ASSERT_EQ((int)empty.freq2[10][20][30], 0);
+    ASSERT_EQ((int)empty.probGivenLead[5][6], 0);
+}
+
 // ============================================================================
 // 5. MULTI-THREADING TESTS
 // ============================================================================
@@ -405,6 +1430,50 @@ TEST(threaded_iiMonteCarlo)
     // Game owns all players and game state
 }
 
+// the move a threaded search picks in a fixed deal
+static card threadedSearchMove()
+{
+    srand(12345);
+    HeartsGameState *g = new HeartsGameState(12345);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(50, 0.4);
+    uct->setPlayoutModule(new HeartsPlayout());
+    iiMonteCarlo *iimc = new iiMonteCarlo(uct, 6);
+    iimc->setUseThreads(true);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+    player->setModelLevel(1);
+    game.addPlayer(player);
+    game.addPlayer(new HeartsDucker());
+    game.addPlayer(new HeartsDucker());
+    game.addPlayer(new HeartsDucker());
+    g->Reset();
+    g->setPassDir(kHold);
+
+    Move *m = player->Play();
+    card c = ((CardMove *)m)->c;
+    g->freeMove(m);
+    return c;
+}
+
+TEST(search_affinity)
+{
+    tSearchAffinity a;
+    ASSERT_TRUE(SearchAffinity::getPolicy("node", a));
+    ASSERT_EQ(a, kAffinityNode);
+    ASSERT_TRUE(!SearchAffinity::getPolicy("socket", a));
+    ASSERT_GT(SearchAffinity::getNumNodes(), 0);
+
+    // where the worlds run doesn't change what they find
+    card unpinned = threadedSearchMove();
+    SearchAffinity::setPolicy(kAffinityCore);
+    SearchAffinity affinity;
+    ASSERT_GT(affinity.getThreads(), 0);
+    ASSERT_TRUE(affinity.getNode() < SearchAffinity::getNumNodes());
+    card pinned = threadedSearchMove();
+    SearchAffinity::setPolicy(kAffinityNone);
+    ASSERT_EQ(pinned, unpinned);
+}
+
 TEST(single_threaded_iiMonteCarlo)
 {
     srand(12345);
@@ -441,6 +1510,415 @@ TEST(single_threaded_iiMonteCarlo)
 // 6. PLAYER TESTS
 // ============================================================================
 
+class recordingObserver : public iiMonteCarloObserver {
+public:
+    void WorldsDone(const Move *best, double confidence, int worldsDone, int numWorlds)
+    {
+        cards.push_back(((const CardMove *)best)->c);
+        confidences.push_back(confidence);
+        done.push_back(worldsDone);
+        total = numWorlds;
+    }
+    std::vector<card> cards;
+    std::vector<double> confidences;
+    std::vector<int> done;
+    int total = 0;
+};
+
+TEST(iiMonteCarlo_observer)
+{
+    for (int threaded = 0; threaded < 2; threaded++)
+    {
+        HeartsGameState *g = new HeartsGameState(4242);
+        HeartsCardGame game(g);
+        UCT *uct = new UCT(50, 0.4);
+        uct->setPlayoutModule(new HeartsPlayout());
+        iiMonteCarlo *iimc = new iiMonteCarlo(uct, 6);
+        iimc->setUseThreads(threaded);
+        recordingObserver observer;
+        iimc->setObserver(&observer);
+        SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+        player->setModelLevel(1);
+        game.addPlayer(player);
+        for (int x = 1; x < 4; x++)
+            game.addPlayer(new HeartsDucker());
+        g->Reset();
+        g->setPassDir(kHold);
+
+        Move *m = player->Play();
+        ASSERT_NE(m, nullptr);
+        // one report per world, and the last one is the answer
+        ASSERT_EQ((int)observer.done.size(), 6);
+        ASSERT_EQ(observer.total, 6);
+        for (int x = 0; x < 6; x++)
+        {
+            ASSERT_EQ(observer.done[x], x+1);
+            ASSERT_TRUE((observer.confidences[x] >= 0) && (observer.confidences[x] <= 1));
+        }
+        ASSERT_EQ(observer.cards.back(), ((CardMove *)m)->c);
+        g->freeMove(m);
+    }
+}
+
+// one world's values for the given cards, best first in the list
+static returnValue *totalsWorld(const card *cards, const double *values, int n)
+{
+    returnValue *rv = 0;
+    for (int x = n-1; x >= 0; x--)
+    {
+        returnValue *v = new minimaxval(values[x], new CardMove(cards[x], 0));
+        v->next = rv;
+        rv = v;
+    }
+    return rv;
+}
+
+TEST(iiMonteCarlo_totals)
+{
+    iiMonteCarloTotals totals;
+    ASSERT_TRUE(totals.getBest(kMaxWeighted) == 0);
+    card cards[3] = {Deck::getcard(SPADES, ACE), Deck::getcard(HEARTS, TWO), Deck::getcard(CLUBS, FIVE)};
+    double first[3] = {0.9, 0.5, 0.1}, second[3] = {0.2, 0.5, 0.1};
+    returnValue *a = totalsWorld(cards, first, 3);
+    returnValue *b = totalsWorld(cards, second, 3);
+    totals.Add(a, 0, 1.0);
+    totals.Add(b, 0, 1.0);
+    delete a;
+    delete b;
+    ASSERT_EQ(totals.getWorlds(), 2);
+
+    // 1.1 weighted against 1.0, but a minimum of 0.2 against 0.5
+    ASSERT_EQ(((const CardMove *)totals.getBest(kMaxWeighted))->c, cards[0]);
+    ASSERT_EQ(((const CardMove *)totals.getBest(kMaxAverage))->c, cards[0]);
+    ASSERT_EQ(((const CardMove *)totals.getBest(kMaxMinScore))->c, cards[1]);
+    ASSERT_EQ(((const CardMove *)totals.getBest(kMaxAvgVar))->c, cards[1]);
+    // each was the best move of one world
+    ASSERT_EQ(totals.getConfidence(kMaxWeighted), 0.5);
+    ASSERT_EQ(totals.getConfidence(kMaxMinScore), 0.5);
+
+    // a lead of 0.1 survives less than 0.1 of weight to come
+    ASSERT_TRUE(totals.isDecided(0.05, 1.0));
+    ASSERT_TRUE(!totals.isDecided(0.5, 1.0));
+}
+
+TEST(iiMonteCarlo_stop_when_decided)
+{
+    for (int threaded = 0; threaded < 2; threaded++)
+    {
+        HeartsGameState *g = new HeartsGameState(4242);
+        HeartsCardGame game(g);
+        UCT *uct = new UCT(50, 0.4);
+        uct->setPlayoutModule(new HeartsPlayout());
+        iiMonteCarlo *iimc = new iiMonteCarlo(uct, 20);
+        iimc->setUseThreads(threaded);
+        // fewer threads than worlds on any host, so some are never started
+        iimc->setMaxThreads(2);
+        // a range no two worlds keep to, so any lead settles it
+        iimc->setStopWhenDecided(1e-9);
+        recordingObserver observer;
+        iimc->setObserver(&observer);
+        SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+        player->setModelLevel(1);
+        game.addPlayer(player);
+        for (int x = 1; x < 4; x++)
+            game.addPlayer(new HeartsDucker());
+        g->Reset();
+        g->setPassDir(kHold);
+
+        Move *m = player->Play();
+        ASSERT_NE(m, nullptr);
+        ASSERT_GT((int)observer.done.size(), 0);
+        ASSERT_TRUE((int)observer.done.size() < 20);
+        ASSERT_EQ(observer.total, 20);
+        ASSERT_EQ(observer.cards.back(), ((CardMove *)m)->c);
+        g->freeMove(m);
+    }
+}
+
+TEST(iiMonteCarlo_kept_worlds)
+{
+    HeartsGameState *g = new HeartsGameState(4343);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(50, 0.4);
+    uct->setPlayoutModule(new HeartsPlayout());
+    iiMonteCarlo *iimc = new iiMonteCarlo(uct, 4);
+    iiMonteCarloWorlds worlds;
+    iimc->setWorlds(&worlds);
+    recordingObserver observer;
+    iimc->setObserver(&observer);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+    player->setModelLevel(1);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->Reset();
+    g->setPassDir(kHold);
+
+    Move *m = player->Play();
+    ASSERT_NE(m, nullptr);
+    ASSERT_EQ(worlds.size(), 4);
+    g->freeMove(m);
+
+    // a bigger search picks up after the kept worlds
+    iimc->setNumModels(6);
+    observer.done.clear();
+    m = player->Play();
+    ASSERT_EQ(worlds.size(), 6);
+    ASSERT_EQ((int)observer.done.size(), 2);
+    ASSERT_EQ(observer.done[0], 5);
+    ASSERT_EQ(observer.total, 6);
+    card answer = ((CardMove *)m)->c;
+    g->freeMove(m);
+
+    // with every world kept there is nothing left to search
+    observer.done.clear();
+    m = player->Play();
+    ASSERT_EQ((int)observer.done.size(), 0);
+    ASSERT_EQ(((CardMove *)m)->c, answer);
+    g->freeMove(m);
+
+    // a world cut short by a cancel is not kept
+    CancelToken cancel;
+    cancel.cancel();
+    iimc->setCancelToken(&cancel);
+    iimc->setNumModels(8);
+    m = player->Play();
+    ASSERT_NE(m, nullptr);
+    ASSERT_EQ(worlds.size(), 6);
+    g->freeMove(m);
+    iimc->setWorlds(0);
+}
+
+TEST(search_cancellation)
+{
+    HeartsGameState *g = new HeartsGameState(321);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(1000000, 0.4);  // far more than the test waits for
+    uct->setPlayoutModule(new HeartsPlayout());
+    iiMonteCarlo *iimc = new iiMonteCarlo(uct, 8);
+    iimc->setUseThreads(true);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+    player->setModelLevel(1);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->Reset();
+    g->setPassDir(kHold);
+
+    CancelToken cancel;
+    iimc->setCancelToken(&cancel);
+    ASSERT_TRUE(!uct->searchCancelled());
+    std::thread canceller([&cancel]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        cancel.cancel();
+    });
+    auto start = std::chrono::steady_clock::now();
+    Move *m = player->Play();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    canceller.join();
+
+    // a legal move, long before the search would have finished
+    ASSERT_NE(m, nullptr);
+    ASSERT_TRUE(uct->searchCancelled());
+    ASSERT_TRUE(elapsed.count() < 2000);
+    std::cout << "(" << elapsed.count() << "ms) ";
+    bool legal = false;
+    Move *moves = g->getMoves();
+    for (Move *t = moves; t; t = t->next)
+        legal = legal || t->equals(m);
+    g->freeMove(moves);
+    ASSERT_TRUE(legal);
+    g->freeMove(m);
+
+    // cancelled before it starts, a search still expands the root
+    m = player->Play();
+    ASSERT_NE(m, nullptr);
+    g->freeMove(m);
+}
+
+TEST(shared_search_cancellation)
+{
+    using hearts::server::InFlightSearches;
+    HeartsGameState *g = new HeartsGameState(321);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(200, 0.4);
+    uct->setPlayoutModule(new HeartsPlayout());
+    iiMonteCarlo *iimc = new iiMonteCarlo(uct, 8);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+    player->setModelLevel(1);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->Reset();
+    g->setPassDir(kHold);
+
+    InFlightSearches flights;
+    CancelToken leaderCancel, followerCancel;
+    card move = 0, shared = 0;
+    ASSERT_EQ(flights.join("table", &leaderCancel, move), InFlightSearches::kLead);
+    InFlightSearches::Lead *lead = new InFlightSearches::Lead(flights, "table");
+    InFlightSearches::Outcome outcome = InFlightSearches::kCancelled;
+    std::thread follower([&]() { outcome = flights.join("table", &followerCancel, shared); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // the leader's client goes away, but the follower still wants the move
+    leaderCancel.cancel();
+    iimc->setCancelToken(lead->cancel());
+    Move *m = player->Play();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_NE(m, nullptr);
+    ASSERT_TRUE(!uct->searchCancelled());
+    ASSERT_TRUE(!lead->cancel()->isCancelled());
+    lead->answer(((CardMove *)m)->c);
+    follower.join();
+    ASSERT_EQ(outcome, InFlightSearches::kAnswered);
+    ASSERT_EQ(shared, ((CardMove *)m)->c);
+    ASSERT_EQ((int)flights.coalesced(), 1);
+    delete lead;
+    g->freeMove(m);
+
+    // with nobody left wanting it, the search is stopped
+    CancelToken alone;
+    ASSERT_EQ(flights.join("table", &alone, move), InFlightSearches::kLead);
+    lead = new InFlightSearches::Lead(flights, "table");
+    alone.cancel();
+    for (int x = 0; x < 200 && !lead->cancel()->isCancelled(); x++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT_TRUE(lead->cancel()->isCancelled());
+    delete lead;
+    ASSERT_EQ((int)flights.searches(), 2);
+}
+
+TEST(search_context_scope)
+{
+    SearchContext &threadDefault = SearchContext::current();
+    SearchContext outer, inner;
+    {
+        SearchContext::Scope a(outer);
+        ASSERT_EQ(&SearchContext::current(), &outer);
+        {
+            SearchContext::Scope b(inner);
+            ASSERT_EQ(SearchContext::current().newNodeNum(), 0);
+            ASSERT_EQ(SearchContext::current().newNodeNum(), 1);
+        }
+        ASSERT_EQ(&SearchContext::current(), &outer);
+        ASSERT_EQ(outer.getNodesCreated(), 0);
+    }
+    ASSERT_EQ(&SearchContext::current(), &threadDefault);
+    ASSERT_EQ(inner.getNodesCreated(), 2);
+}
+
+// one world of a threaded search: a clone of the search on its own state
+static void cloneAnalyze(Algorithm *alg, int seed, int rules, returnValue **result)
+{
+    HeartsGameState *g = new HeartsGameState(seed);
+    HeartsCardGame game(g);
+    for (int x = 0; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(rules);
+    g->Reset();
+    g->setPassDir(kHold);
+    g->setFirstPlayer(0);
+    *result = alg->Analyze(g, g->getNextPlayer());
+    g->deletePlayers();
+}
+
+// one server request per hand: a fresh game and player, one decision
+static void concurrentDecisions(int first, int count, int *done)
+{
+    for (int d = first; d < first+count; d++)
+    {
+        SearchContext context;
+        SearchContext::Scope scope(context);
+        HeartsGameState *g = new HeartsGameState(d);
+        HeartsCardGame game(g);
+        UCT *uct = new UCT(10, 0.4);
+        HeartsPlayout *playout = new HeartsPlayout();
+        uct->setPlayoutModule(playout);
+        iiMonteCarlo *iimc = new iiMonteCarlo(uct, 4);
+        iimc->setUseThreads(true);
+        SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+        player->setModelLevel(2);
+        game.addPlayer(player);
+        for (int x = 1; x < 4; x++)
+            game.addPlayer(new HeartsDucker());
+        g->setRules(kQueenPenalty|kMustBreakHearts|kQueenBreaksHearts|kNoHeartsFirstTrick|kNoQueenFirstTrick);
+        g->Reset();
+        g->setPassDir(kHold);
+        g->setFirstPlayer(0);
+
+        // a few tricks in, so world generation has history to model
+        for (int x = 0; (x < 4*(d%4)) || (g->getNextPlayerNum() != 0); x++)
+        {
+            Move *m = g->getMoves();
+            Move *pick = m->clone(g);
+            g->freeMove(m);
+            g->ApplyMove(pick);
+            g->freeMove(pick);
+        }
+        std::string name = player->getName();
+        Move *m = player->Play();
+        if (m && (name.size() > 0))
+            (*done)++;
+        g->freeMove(m);
+
+        g->deletePlayers();
+        delete iimc;
+        delete uct;
+        delete playout;
+        delete g;
+    }
+}
+
+TEST(concurrent_decisions)
+{
+    // independent searches on many threads share no mutable engine state;
+    // build with -DHEARTS_SANITIZE=thread to have ThreadSanitizer check it
+    const int numThreads = 8, perThread = 40;
+    std::vector<std::thread> threads;
+    int done[numThreads];
+    for (int t = 0; t < numThreads; t++)
+    {
+        done[t] = 0;
+        threads.push_back(std::thread(concurrentDecisions, 1000+t*perThread, perThread, &done[t]));
+    }
+    int total = 0;
+    for (int t = 0; t < numThreads; t++)
+    {
+        threads[t].join();
+        total += done[t];
+    }
+    ASSERT_EQ(total, numThreads*perThread);
+
+    // clones of one search (the worlds of a threaded iiMonteCarlo) each play
+    // out with their own copy of its module, so they don't share a generator
+    // and two clones on the same deal search alike
+    const int rules = kStandardRules;
+    UCT *uct = new UCT(300, 0.4);
+    UCTModule *playout = newHeartsPlayout(rules);
+    uct->setPlayoutModule(playout);
+    Algorithm *clones[2] = {uct->clone(), uct->clone()};
+    returnValue *results[2];
+    std::thread a(cloneAnalyze, clones[0], 77, rules, &results[0]);
+    std::thread b(cloneAnalyze, clones[1], 77, rules, &results[1]);
+    a.join();
+    b.join();
+    returnValue *x = results[0], *y = results[1];
+    for (; x && y; x = x->next, y = y->next)
+    {
+        ASSERT_TRUE(x->m->equals(y->m));
+        ASSERT_TRUE(fabs(x->getValue(0)-y->getValue(0)) < 1e-12);
+    }
+    ASSERT_TRUE(x == y);
+    delete results[0];
+    delete results[1];
+    delete clones[0];
+    delete clones[1];
+    delete uct;
+    delete playout;
+}
+
 TEST(simple_hearts_player)
 {
     srand(12345);
@@ -520,6 +1998,102 @@ TEST(hearts_shooter_player)
     // Game owns all players and game state
 }
 
+TEST(hearts_difficulty_presets)
+{
+    tHeartsDifficulty d;
+    ASSERT_TRUE(getDifficulty("medium", d));
+    ASSERT_EQ(d, kDifficultyMedium);
+    ASSERT_TRUE(!getDifficulty("expert", d));
+
+    // cheaper tiers search less
+    ASSERT_EQ(getDifficultyPreset(kDifficultyEasy).worlds, 0);
+    ASSERT_TRUE(getDifficultyPreset(kDifficultyMedium).worlds*getDifficultyPreset(kDifficultyMedium).simsPerWorld <
+                getDifficultyPreset(kDifficultyHard).worlds*getDifficultyPreset(kDifficultyHard).simsPerWorld);
+
+    // seat 0 leads: without kLeadClubs the 2♣ doesn't decide who starts
+    const int rules = kQueenPenalty|kMustBreakHearts;
+    for (int x = 0; x < kNumDifficulties; x++)
+    {
+        HeartsGameState *g = new HeartsGameState(77);
+        HeartsCardGame game(g);
+        Player *player = newDifficultyPlayer((tHeartsDifficulty)x, rules);
+        game.addPlayer(player);
+        for (int y = 1; y < 4; y++)
+            game.addPlayer(new HeartsDucker());
+        g->setRules(rules);
+        g->Reset(77);
+        g->setPassDir(kHold);
+        g->setFirstPlayer(0);
+
+        if (x == kDifficultyEasy)
+            ASSERT_EQ(player->getAlgorithm(), nullptr);
+        else
+            ASSERT_EQ(((iiMonteCarlo *)player->getAlgorithm())->getNumModels(),
+                      getDifficultyPreset((tHeartsDifficulty)x).worlds);
+        Move *m = player->Play();
+        ASSERT_NE(m, nullptr);
+        ASSERT_TRUE(g->IsLegalMove(m));
+        g->freeMove(m);
+    }
+}
+
+TEST(hearts_time_manager)
+{
+    HeartsGameState *g = new HeartsGameState(2024);
+    HeartsCardGame game(g);
+    UCT *uct = new UCT(20, 0.4);
+    uct->setPlayoutModule(new HeartsPlayout());
+    iiMonteCarlo *iimc = new iiMonteCarlo(uct, 4);
+    HeartsTimeManager timer(2000, 20);
+    SimpleHeartsPlayer *player = new SimpleHeartsPlayer(iimc);
+    player->setModelLevel(1);
+    player->setTimeManager(&timer);
+    game.addPlayer(player);
+    for (int x = 1; x < 4; x++)
+        game.addPlayer(new HeartsDucker());
+    g->setRules(kQueenPenalty|kMustBreakHearts|kLeadClubs);
+    g->Reset();
+    g->setPassDir(kHold);
+    g->setFirstPlayer(0);
+
+    // the hand's total is spent on the plays that aren't forced
+    int searched = 0;
+    while (!g->Done())
+    {
+        int who = g->getNextPlayerNum();
+        Move *moves = g->getMoves();
+        bool forced = (moves->next == 0);
+        g->freeMove(moves);
+        long long before = timer.getSpent();
+        Move *m = g->getPlayer(who)->Play();
+        if (who == 0)
+        {
+            if (forced)
+                ASSERT_EQ(timer.getSpent(), before);
+            else
+                searched++;
+        }
+        g->ApplyMove(m);
+        g->freeMove(m);
+    }
+    ASSERT_GT(searched, 0);
+    ASSERT_GT(timer.getSpent(), 1000);
+    // at most the total and the few worlds every search gets
+    ASSERT_TRUE(timer.getSpent() <= 2000 + searched*3*20);
+    ASSERT_EQ(iimc->getNumModels(), 4);
+
+    // searches whose worlds agree make the next ones smaller
+    HeartsTimeManager steady(2000, 20), erratic(2000, 20);
+    steady.Spent(0, 1.0);
+    erratic.Spent(0, 0.0);
+    ASSERT_TRUE(steady.getVolatility() < 0.5);
+    ASSERT_TRUE(erratic.getVolatility() > 0.5);
+    g->Reset();
+    g->setPassDir(kHold);
+    g->setFirstPlayer(0);
+    ASSERT_TRUE(steady.Budget(g, 0) < erratic.Budget(g, 0));
+}
+
 // ============================================================================
 // 7. GAME SIMULATION TESTS
 // ============================================================================
@@ -921,12 +2495,15 @@ int main(int argc, char **argv)
     RUN_TEST(deck_operations);
     RUN_TEST(deck_suit_operations);
     RUN_TEST(full_deck);
+    RUN_TEST(trick_winner);
     std::cout << std::endl;
 
     // 2. Game state tests
     std::cout << "--- Game State Tests ---" << std::endl;
     RUN_TEST(game_state_creation);
     RUN_TEST(game_state_deal);
+    RUN_TEST(game_state_clear);
+    RUN_TEST(game_state_set_position);
     RUN_TEST(pass_directions);
     std::cout << std::endl;
 
@@ -942,6 +2519,23 @@ int main(int argc, char **argv)
     RUN_TEST(uct_clone);
     RUN_TEST(iiMonteCarlo_creation);
     RUN_TEST(iiMonteCarlo_decision_rules);
+    RUN_TEST(linear_eval_features);
+    RUN_TEST(linear_eval_playout);
+    RUN_TEST(linear_eval_fit);
+    RUN_TEST(puct_move_prior);
+    RUN_TEST(move_prior_fit);
+    RUN_TEST(uct_mast_rave);
+    RUN_TEST(uct_mast_playout_module);
+    RUN_TEST(playout_engine_policies);
+    RUN_TEST(fast_playout_matches_generic);
+    RUN_TEST(playout_settling);
+    RUN_TEST(suit_isomorphic_states);
+    RUN_TEST(pass_evaluator_canonical);
+    RUN_TEST(pass_evaluator_player);
+    RUN_TEST(hand_strength);
+    RUN_TEST(flat_mc);
+    RUN_TEST(opening_book);
+    RUN_TEST(card_prob_data_tables);
     std::cout << std::endl;
 
     // 5. Multi-threading tests
@@ -949,6 +2543,15 @@ int main(int argc, char **argv)
     RUN_TEST(threading_enabled);
     RUN_TEST(single_threaded_iiMonteCarlo);
     RUN_TEST(threaded_iiMonteCarlo);
+    RUN_TEST(search_affinity);
+    RUN_TEST(iiMonteCarlo_observer);
+    RUN_TEST(iiMonteCarlo_totals);
+    RUN_TEST(iiMonteCarlo_stop_when_decided);
+    RUN_TEST(iiMonteCarlo_kept_worlds);
+    RUN_TEST(search_cancellation);
+    RUN_TEST(shared_search_cancellation);
+    RUN_TEST(search_context_scope);
+    RUN_TEST(concurrent_decisions);
     std::cout << std::endl;
 
     // 6. Player tests
@@ -956,6 +2559,8 @@ int main(int argc, char **argv)
     RUN_TEST(simple_hearts_player);
     RUN_TEST(hearts_ducker_player);
     RUN_TEST(hearts_shooter_player);
+    RUN_TEST(hearts_difficulty_presets);
+    RUN_TEST(hearts_time_manager);
     std::cout << std::endl;
 
     // 7. Game simulation tests